@@ -0,0 +1,49 @@
+﻿#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "BenchContext.h"
+
+namespace
+{
+    constexpr std::string_view DEFAULT_RESULT_FILE_NAME = "vmpx_bench.json";
+}
+
+std::filesystem::path& vmpx::bench::ExecutableDir()
+{
+    static std::filesystem::path executable_dir;
+    return executable_dir;
+}
+
+/**
+ * vmpx_bench [google benchmark参数]
+ * 未指定--benchmark_out时结果以JSON写入程序所在目录，便于与上次运行对比
+ */
+int main(int argc, char* argv[])
+{
+    vmpx::bench::ExecutableDir() = std::filesystem::absolute(argv[0]).parent_path();
+    std::vector<char*> args(argv, argv + argc);
+    std::string out_arg, out_format_arg;
+    bool has_out = std::ranges::any_of(args, [](std::string_view arg)
+    {
+        return arg.starts_with("--benchmark_out=");
+    });
+    if (!has_out)
+    {
+        auto result_path = vmpx::bench::ExecutableDir() / DEFAULT_RESULT_FILE_NAME;
+        out_arg = std::format("--benchmark_out={}", result_path.string());
+        out_format_arg = "--benchmark_out_format=json";
+        args.push_back(out_arg.data());
+        args.push_back(out_format_arg.data());
+    }
+    int bench_argc = static_cast<int>(args.size());
+    benchmark::Initialize(&bench_argc, args.data());
+    if (benchmark::ReportUnrecognizedArguments(bench_argc, args.data())) return -1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
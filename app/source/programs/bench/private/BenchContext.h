@@ -0,0 +1,14 @@
+﻿#pragma once
+#include <filesystem>
+
+namespace vmpx
+{
+    namespace bench
+    {
+        /**
+         * vmpx_bench所在目录，vmpx_fake_packer与它生成在同一目录，由main设置
+         * @return 
+         */
+        std::filesystem::path& ExecutableDir();
+    }
+}
@@ -0,0 +1,204 @@
+﻿#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <zip.h>
+
+#include "AppPackService.h"
+#include "BenchContext.h"
+#include "Utils.h"
+
+namespace
+{
+    const std::filesystem::path PIPELINE_DATA_DIR{"./vmpx_bench_data/pipeline"};
+    // 加壳本身的耗时固定，测出的时间超出理想值的部分即为服务自身排队、调度和IO的开销
+    constexpr auto FAKE_PACK_DURATION = std::chrono::milliseconds(50);
+    constexpr uint64_t FAKE_APP_BYTES = 1 << 20;
+
+    std::filesystem::path FakePackerPath()
+    {
+#if defined(_WIN32)
+        return vmpx::bench::ExecutableDir() / "vmpx_fake_packer.exe";
+#else
+        return vmpx::bench::ExecutableDir() / "vmpx_fake_packer";
+#endif
+    }
+
+    void SetEnv(const char* name, const std::string& value)
+    {
+#if defined(_WIN32)
+        _putenv_s(name, value.c_str());
+#else
+        setenv(name, value.c_str(), 1);
+#endif
+    }
+
+    /**
+     * 加壳进程继承这些环境变量
+     */
+    void ConfigureFakePacker()
+    {
+        SetEnv("VMPX_FAKE_PACK_DURATION_MS", std::to_string(FAKE_PACK_DURATION.count()));
+        SetEnv("VMPX_FAKE_PACK_DISTRIBUTION", "fixed");
+        SetEnv("VMPX_FAKE_PACK_CPU_MS", "0");
+        SetEnv("VMPX_FAKE_PACK_OUTPUT_BYTES", std::to_string(FAKE_APP_BYTES));
+        SetEnv("VMPX_FAKE_PACK_FAILURE_RATE", "0");
+    }
+
+    /**
+     * 内容随index和revision变化，换revision即可让加壳缓存失效
+     * @param index 
+     * @param revision 
+     * @return 
+     */
+    std::vector<uint8_t> MakeAppZip(size_t index, uint64_t revision)
+    {
+        static constexpr std::string_view vmp_content =
+            R"(<?xml version="1.0" encoding="UTF-8" standalone="yes"?>)"
+            R"(<Document><Protection InputFileName="app.exe"/></Document>)";
+        auto exe_content = std::format("fake app {} revision {}", index, revision);
+        exe_content.resize(FAKE_APP_BYTES, 'x');
+        auto zip_path = PIPELINE_DATA_DIR / std::format("app{}.zip", index);
+        std::error_code ec;
+        std::filesystem::create_directories(PIPELINE_DATA_DIR, ec);
+        int err = 0;
+        zip* za = zip_open(zip_path.string().c_str(), ZIP_CREATE | ZIP_TRUNCATE, &err);
+        if (!za) return {};
+        zip_file_add(za, "app.exe", zip_source_buffer(za, exe_content.data(), exe_content.size(), 0), 0);
+        zip_file_add(za, "app.vmp", zip_source_buffer(za, vmp_content.data(), vmp_content.size(), 0), 0);
+        zip_close(za);
+        auto zip_data = vmpx::ReadFile(zip_path).value_or(std::vector<uint8_t>{});
+        std::filesystem::remove(zip_path, ec);
+        return zip_data;
+    }
+
+    bool AddApps(vmpx::app_pack::AppPackService& service, const std::vector<std::string>& names, uint64_t revision,
+                 benchmark::State& state)
+    {
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            auto zip_data = MakeAppZip(i, revision);
+            if (auto result = service.Add(names[i], zip_data); !result)
+            {
+                state.SkipWithError(std::format("unable to add app:{}", result.error()).c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * 每次迭代重新添加一批内容不同的app再批量加壳，避免命中加壳缓存
+     * 参数为app数和加壳并发上限，ideal_ms为只算加壳耗时的理想用时
+     */
+    void BM_PackPipeline(benchmark::State& state)
+    {
+        auto num_apps = static_cast<size_t>(state.range(0));
+        auto max_concurrency = static_cast<size_t>(state.range(1));
+        if (!std::filesystem::exists(FakePackerPath()))
+        {
+            state.SkipWithError("vmpx_fake_packer not found");
+            return;
+        }
+        ConfigureFakePacker();
+        std::error_code ec;
+        std::filesystem::remove_all(PIPELINE_DATA_DIR, ec);
+        uint64_t failed = 0;
+        {
+            vmpx::app_pack::AppPackService service(FakePackerPath(), PIPELINE_DATA_DIR / "data", max_concurrency);
+            std::vector<std::string> names;
+            for (size_t i = 0; i < num_apps; ++i)
+            {
+                names.push_back(std::format("app{}", i));
+            }
+            uint64_t revision = 0;
+            for (auto _ : state)
+            {
+                state.PauseTiming();
+                bool added = AddApps(service, names, revision++, state);
+                state.ResumeTiming();
+                if (!added) break;
+                for (const auto& [name, profile, result] : service.PackBatch(names))
+                {
+                    if (!result) ++failed;
+                }
+            }
+            auto metrics = service.GetPackMetrics();
+            auto packs = static_cast<double>(metrics.submitted);
+            state.counters["packs"] = benchmark::Counter(packs, benchmark::Counter::kIsRate);
+            state.counters["queue_wait_ms"] = packs > 0 ? static_cast<double>(metrics.queue_wait_ms) / packs : 0;
+            state.counters["busy_ms"] = packs > 0 ? static_cast<double>(metrics.busy_ms) / packs : 0;
+            state.counters["utilisation"] = metrics.utilisation;
+        }
+        auto waves = (num_apps + max_concurrency - 1) / max_concurrency;
+        state.counters["ideal_ms"] = static_cast<double>(waves * FAKE_PACK_DURATION.count());
+        state.counters["failed"] = static_cast<double>(failed);
+        std::filesystem::remove_all(PIPELINE_DATA_DIR, ec);
+    }
+
+    /**
+     * 输入不变时重复加壳，只走缓存键计算、硬链接和注册表更新
+     */
+    void BM_PackCacheHit(benchmark::State& state)
+    {
+        if (!std::filesystem::exists(FakePackerPath()))
+        {
+            state.SkipWithError("vmpx_fake_packer not found");
+            return;
+        }
+        ConfigureFakePacker();
+        std::error_code ec;
+        std::filesystem::remove_all(PIPELINE_DATA_DIR, ec);
+        {
+            vmpx::app_pack::AppPackService service(FakePackerPath(), PIPELINE_DATA_DIR / "data");
+            std::vector<std::string> names{"app0"};
+            if (!AddApps(service, names, 0, state)) return;
+            if (auto result = service.Pack(names.front()); !result)
+            {
+                state.SkipWithError(std::format("unable to pack app:{}", result.error()).c_str());
+                return;
+            }
+            for (auto _ : state)
+            {
+                if (auto result = service.Pack(names.front()); !result)
+                {
+                    state.SkipWithError(std::format("unable to pack app:{}", result.error()).c_str());
+                    break;
+                }
+            }
+        }
+        std::filesystem::remove_all(PIPELINE_DATA_DIR, ec);
+    }
+
+    /**
+     * 添加app：解压、存入BlobStore、记录清单和注册表
+     */
+    void BM_AddApp(benchmark::State& state)
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(PIPELINE_DATA_DIR, ec);
+        {
+            vmpx::app_pack::AppPackService service(FakePackerPath(), PIPELINE_DATA_DIR / "data");
+            auto zip_data = MakeAppZip(0, 0);
+            for (auto _ : state)
+            {
+                if (auto result = service.Add("app0", zip_data); !result)
+                {
+                    state.SkipWithError(std::format("unable to add app:{}", result.error()).c_str());
+                    break;
+                }
+            }
+            state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * FAKE_APP_BYTES));
+        }
+        std::filesystem::remove_all(PIPELINE_DATA_DIR, ec);
+    }
+}
+
+BENCHMARK(BM_PackPipeline)->Args({1, 1})->Args({8, 1})->Args({8, 4})->Args({32, 8})
+                          ->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PackCacheHit)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_AddApp)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,202 @@
+﻿#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <tobiaslocker_base64/base64.hpp>
+
+#include "Utils.h"
+#include "VMPX.h"
+
+namespace
+{
+    constexpr std::string_view SAMPLE_HWID = "eENCrFnwMIMzwzPH3pgmMMInHQUy5rsv7qM52r5jO30=";
+    constexpr std::string_view SAMPLE_TEXT = "VMProtect加壳服务 serial number 序列号生成 ";
+
+    /**
+     * 生成RSA密钥很慢，每种长度只生成一次，供各个基准共用
+     * @param key_size 
+     * @return 
+     */
+    const vmpx::ProductInfo& CachedProductInfo(size_t key_size)
+    {
+        static std::mutex mutex;
+        static std::map<size_t, vmpx::ProductInfo> product_infos;
+        std::lock_guard lock(mutex);
+        auto it = product_infos.find(key_size);
+        if (it == product_infos.end())
+            it = product_infos.emplace(key_size, vmpx::GenRandomProductInfo(key_size)).first;
+        return it->second;
+    }
+
+    std::vector<uint8_t> RandomBytes(size_t size)
+    {
+        std::mt19937_64 rng{size};
+        std::vector<uint8_t> bytes(size);
+        std::ranges::generate(bytes, [&rng] { return static_cast<uint8_t>(rng()); });
+        return bytes;
+    }
+
+    std::string RepeatText(std::string_view text, size_t size)
+    {
+        std::string result;
+        result.reserve(size + text.size());
+        while (result.size() < size)
+        {
+            result.append(text);
+        }
+        return result;
+    }
+
+    void BM_GenSerialNumber(benchmark::State& state)
+    {
+        const auto& product_info = CachedProductInfo(static_cast<size_t>(state.range(0)));
+        vmpx::SerialInfo serial_info{
+            .user_name = "John Doe",
+            .email = "john@doe.com",
+            .hwid = std::string{SAMPLE_HWID},
+            .exp_year = 2030,
+            .exp_month = 1,
+            .exp_day = 1,
+        };
+        for (auto _ : state)
+        {
+            auto result = vmpx::GenSerialNumber(product_info, serial_info);
+            if (!result)
+            {
+                state.SkipWithError(result.error().c_str());
+                break;
+            }
+            benchmark::DoNotOptimize(result);
+        }
+    }
+
+    void BM_GenRandomProductInfo(benchmark::State& state)
+    {
+        auto key_size = static_cast<size_t>(state.range(0));
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(vmpx::GenRandomProductInfo(key_size));
+        }
+    }
+
+    void BM_HWIDFromBase64(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            auto hwid = vmpx::HWID::FromBase64(SAMPLE_HWID);
+            if (!hwid)
+            {
+                state.SkipWithError(hwid.error().c_str());
+                break;
+            }
+            benchmark::DoNotOptimize(hwid);
+        }
+    }
+
+    void BM_HWIDToBase64(benchmark::State& state)
+    {
+        auto hwid = vmpx::HWID::FromBase64(SAMPLE_HWID);
+        if (!hwid)
+        {
+            state.SkipWithError(hwid.error().c_str());
+            return;
+        }
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(hwid->ToBase64());
+        }
+    }
+
+    void BM_ProductInfoEntityToJson(benchmark::State& state)
+    {
+        auto entity = vmpx::ProductInfoEntity::FromProductInfo(CachedProductInfo(static_cast<size_t>(state.range(0))));
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(entity.ToJson());
+        }
+    }
+
+    void BM_ProductInfoEntityFromJson(benchmark::State& state)
+    {
+        auto json = vmpx::ProductInfoEntity::FromProductInfo(CachedProductInfo(static_cast<size_t>(state.range(0))))
+            .ToJson();
+        for (auto _ : state)
+        {
+            auto entity = vmpx::ProductInfoEntity::FromJson(json);
+            if (!entity)
+            {
+                state.SkipWithError(entity.error().c_str());
+                break;
+            }
+            benchmark::DoNotOptimize(entity);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * json.size()));
+    }
+
+    /**
+     * 与/gen_serial_number一致：ProductInfo转实体、序列化、解析、再转回ProductInfo
+     */
+    void BM_ProductInfoEntityRoundTrip(benchmark::State& state)
+    {
+        const auto& product_info = CachedProductInfo(static_cast<size_t>(state.range(0)));
+        for (auto _ : state)
+        {
+            auto json = vmpx::ProductInfoEntity::FromProductInfo(product_info).ToJson();
+            auto entity = vmpx::ProductInfoEntity::FromJson(json);
+            if (!entity)
+            {
+                state.SkipWithError(entity.error().c_str());
+                break;
+            }
+            benchmark::DoNotOptimize(entity->ToProductInfo());
+        }
+    }
+
+    void BM_DetCharset(benchmark::State& state)
+    {
+        auto text = RepeatText(SAMPLE_TEXT, static_cast<size_t>(state.range(0)));
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(vmpx::Charset::DetCharset(std::span<const char>(text)));
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    }
+
+    void BM_Base64Encode(benchmark::State& state)
+    {
+        auto bytes = RandomBytes(static_cast<size_t>(state.range(0)));
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(base64::encode_into<std::string>(bytes.begin(), bytes.end()));
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes.size()));
+    }
+
+    void BM_Base64Decode(benchmark::State& state)
+    {
+        auto bytes = RandomBytes(static_cast<size_t>(state.range(0)));
+        auto encoded = base64::encode_into<std::string>(bytes.begin(), bytes.end());
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(base64::decode_into<std::vector<uint8_t>>(encoded));
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes.size()));
+    }
+}
+
+BENCHMARK(BM_GenSerialNumber)->Arg(1024)->Arg(2048)->Arg(4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_GenRandomProductInfo)->Arg(1024)->Arg(2048)->Arg(4096)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_HWIDFromBase64);
+BENCHMARK(BM_HWIDToBase64);
+BENCHMARK(BM_ProductInfoEntityToJson)->Arg(1024)->Arg(2048)->Arg(4096);
+BENCHMARK(BM_ProductInfoEntityFromJson)->Arg(1024)->Arg(2048)->Arg(4096);
+BENCHMARK(BM_ProductInfoEntityRoundTrip)->Arg(1024)->Arg(2048)->Arg(4096);
+BENCHMARK(BM_DetCharset)->RangeMultiplier(16)->Range(256, 64 << 10);
+BENCHMARK(BM_Base64Encode)->RangeMultiplier(16)->Range(64, 1 << 20);
+BENCHMARK(BM_Base64Decode)->RangeMultiplier(16)->Range(64, 1 << 20);
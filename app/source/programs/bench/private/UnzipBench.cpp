@@ -0,0 +1,121 @@
+﻿#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <zip.h>
+
+#include "AppManifest.h"
+#include "AppPackService.h"
+#include "BlobStore.h"
+
+namespace
+{
+    const std::filesystem::path BENCH_DATA_DIR{"./vmpx_bench_data"};
+
+    /**
+     * 生成num_files个文件、每个file_size字节的压缩包，内容为可压缩的伪随机文本
+     * @param num_files 
+     * @param file_size 
+     * @return 压缩包路径
+     */
+    std::filesystem::path MakeBenchZip(size_t num_files, size_t file_size)
+    {
+        auto zip_path = BENCH_DATA_DIR / std::format("unzip_{}x{}.zip", num_files, file_size);
+        std::error_code ec;
+        if (std::filesystem::exists(zip_path, ec)) return zip_path;
+        std::filesystem::create_directories(BENCH_DATA_DIR, ec);
+        std::mt19937 rng{static_cast<uint32_t>(num_files ^ file_size)};
+        std::vector<std::string> contents(num_files);
+        int err = 0;
+        zip* za = zip_open(zip_path.string().c_str(), ZIP_CREATE | ZIP_TRUNCATE, &err);
+        if (!za) return {};
+        for (size_t i = 0; i < num_files; ++i)
+        {
+            auto& content = contents[i];
+            content.resize(file_size);
+            for (auto& c : content)
+            {
+                c = static_cast<char>('a' + rng() % 16);
+            }
+            auto name = std::format("dir{}/file{}.bin", i % 8, i);
+            zip_file_add(za, name.c_str(), zip_source_buffer(za, content.data(), content.size(), 0), 0);
+        }
+        // 压缩包持有内容的指针，关闭时才真正写入
+        if (zip_close(za) != 0) return {};
+        return zip_path;
+    }
+
+    void BM_UnzipToDir(benchmark::State& state)
+    {
+        auto num_files = static_cast<size_t>(state.range(0));
+        auto file_size = static_cast<size_t>(state.range(1));
+        auto zip_path = MakeBenchZip(num_files, file_size);
+        if (zip_path.empty())
+        {
+            state.SkipWithError("unable to create zip");
+            return;
+        }
+        auto output_dir = BENCH_DATA_DIR / "unzip";
+        std::error_code ec;
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            std::filesystem::remove_all(output_dir, ec);
+            state.ResumeTiming();
+            if (!vmpx::app_pack::UnzipToDir(zip_path, output_dir))
+            {
+                state.SkipWithError("unable to unzip");
+                break;
+            }
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * num_files * file_size));
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_files));
+        std::filesystem::remove_all(output_dir, ec);
+    }
+
+    /**
+     * 与/app/add一致：内容存入BlobStore并记录清单
+     */
+    void BM_UnzipToDirWithBlobStore(benchmark::State& state)
+    {
+        auto num_files = static_cast<size_t>(state.range(0));
+        auto file_size = static_cast<size_t>(state.range(1));
+        auto zip_path = MakeBenchZip(num_files, file_size);
+        if (zip_path.empty())
+        {
+            state.SkipWithError("unable to create zip");
+            return;
+        }
+        auto output_dir = BENCH_DATA_DIR / "unzip_blobs";
+        auto blob_dir = BENCH_DATA_DIR / "blobs";
+        std::error_code ec;
+        std::filesystem::remove_all(blob_dir, ec);
+        vmpx::app_pack::BlobStore blob_store(blob_dir);
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            std::filesystem::remove_all(output_dir, ec);
+            vmpx::app_pack::AppManifest manifest;
+            state.ResumeTiming();
+            if (!vmpx::app_pack::UnzipToDir(zip_path, output_dir, &blob_store, &manifest))
+            {
+                state.SkipWithError("unable to unzip");
+                break;
+            }
+            benchmark::DoNotOptimize(manifest);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * num_files * file_size));
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * num_files));
+        std::filesystem::remove_all(output_dir, ec);
+        std::filesystem::remove_all(blob_dir, ec);
+    }
+}
+
+// 少量大文件、中等、大量小文件
+BENCHMARK(BM_UnzipToDir)->Args({1, 16 << 20})->Args({64, 256 << 10})->Args({1024, 4 << 10})
+                        ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_UnzipToDirWithBlobStore)->Args({1, 16 << 20})->Args({64, 256 << 10})->Args({1024, 4 << 10})
+                                     ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,16 @@
+local target_name = "vmpx_bench"
+local kind = "binary"
+local group_name = "bench"
+local pkgs = { "benchmark", "yalantinglibs", "libzip", "utfcpp", "uchardet", "cryptopp" }
+local deps = { "runtime" }
+local syslinks = {}
+local function callback()
+    set_default(false)
+    -- 加壳流水线基准用它代替VMProtect_Con
+    add_deps("vmpx_fake_packer")
+    -- vmpx_server是binary无法链接，直接编译其private下的源文件，入口和HTTP服务除外
+    local server_dir = path.join(os.scriptdir(), "..", "http_server")
+    add_includedirs(server_dir, path.join(server_dir, "private"))
+    add_files(path.join(server_dir, "private", "*.cpp|Server.cpp|PackProgressHub.cpp|ChunkedStream.cpp"))
+end
+CreateTarget(target_name, kind, os.scriptdir(), group_name, pkgs, deps, syslinks, callback)
@@ -0,0 +1,199 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <pugixml.hpp>
+
+namespace
+{
+    /**
+     * 行为由环境变量控制，PackApp只传.vmp和输出文件两个参数
+     */
+    struct FakePackOptions
+    {
+        // 平均耗时
+        std::chrono::milliseconds duration{1000};
+        // fixed、uniform（0~2倍平均值）、exponential、lognormal
+        std::string distribution = "fixed";
+        // lognormal的形状参数
+        double sigma = 0.5;
+        // 期间占满一个核的时间，超过耗时则以它为准
+        std::chrono::milliseconds cpu{0};
+        // 输出文件大小，0表示与输入程序相同
+        uint64_t output_bytes = 0;
+        // 0~1
+        double failure_rate = 0;
+        std::optional<uint64_t> seed;
+    };
+
+    template <typename T>
+    T GetEnv(const char* name, T default_value)
+    {
+        const char* value = std::getenv(name);
+        if (!value || !*value) return default_value;
+        if constexpr (std::is_same_v<T, std::string>) return value;
+        else if constexpr (std::is_floating_point_v<T>) return static_cast<T>(std::strtod(value, nullptr));
+        else return static_cast<T>(std::strtoull(value, nullptr, 10));
+    }
+
+    FakePackOptions LoadOptions()
+    {
+        FakePackOptions options;
+        options.duration = std::chrono::milliseconds(GetEnv<uint64_t>("VMPX_FAKE_PACK_DURATION_MS", 1000));
+        options.distribution = GetEnv<std::string>("VMPX_FAKE_PACK_DISTRIBUTION", "fixed");
+        options.sigma = GetEnv<double>("VMPX_FAKE_PACK_SIGMA", 0.5);
+        options.cpu = std::chrono::milliseconds(GetEnv<uint64_t>("VMPX_FAKE_PACK_CPU_MS", 0));
+        options.output_bytes = GetEnv<uint64_t>("VMPX_FAKE_PACK_OUTPUT_BYTES", 0);
+        options.failure_rate = std::clamp(GetEnv<double>("VMPX_FAKE_PACK_FAILURE_RATE", 0), 0.0, 1.0);
+        if (std::getenv("VMPX_FAKE_PACK_SEED")) options.seed = GetEnv<uint64_t>("VMPX_FAKE_PACK_SEED", 0);
+        return options;
+    }
+
+    std::chrono::milliseconds SampleDuration(const FakePackOptions& options, std::mt19937_64& rng)
+    {
+        auto mean = static_cast<double>(options.duration.count());
+        double sample = mean;
+        if (options.distribution == "uniform")
+            sample = std::uniform_real_distribution<double>(0, 2 * mean)(rng);
+        else if (options.distribution == "exponential" && mean > 0)
+            sample = std::exponential_distribution<double>(1 / mean)(rng);
+        else if (options.distribution == "lognormal" && mean > 0)
+        {
+            // 使分布的均值等于mean
+            auto mu = std::log(mean) - options.sigma * options.sigma / 2;
+            sample = std::lognormal_distribution<double>(mu, options.sigma)(rng);
+        }
+        return std::chrono::milliseconds(static_cast<int64_t>(sample));
+    }
+
+    /**
+     * 与加壳程序一样从.vmp中读取待加壳的程序，相对路径相对于.vmp所在目录
+     * @param vmp_file_path 
+     * @return 
+     */
+    std::optional<std::filesystem::path> ReadInputFilePath(const std::filesystem::path& vmp_file_path)
+    {
+        pugi::xml_document doc;
+        if (!doc.load_file(vmp_file_path.c_str())) return std::nullopt;
+        auto input_file_name = doc.child("Document").child("Protection").attribute("InputFileName");
+        if (!input_file_name) return std::nullopt;
+        std::filesystem::path input_file_path{input_file_name.as_string()};
+        if (input_file_path.is_relative()) input_file_path = vmp_file_path.parent_path() / input_file_path;
+        return input_file_path;
+    }
+
+    void BurnCpu(std::chrono::steady_clock::duration duration)
+    {
+        auto end = std::chrono::steady_clock::now() + duration;
+        volatile uint64_t sink = 0;
+        uint64_t x = 0x9E3779B97F4A7C15ull;
+        while (std::chrono::steady_clock::now() < end)
+        {
+            for (int i = 0; i < 4096; ++i)
+            {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+            }
+            sink = sink + x;
+        }
+    }
+
+    bool WriteOutput(const std::filesystem::path& input_file_path, const std::filesystem::path& output_path,
+                     uint64_t output_bytes, std::mt19937_64& rng)
+    {
+        std::ifstream ifs(input_file_path, std::ios::binary);
+        if (!ifs.is_open()) return false;
+        std::ofstream ofs(output_path, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) return false;
+        std::vector<char> buffer(64 * 1024);
+        uint64_t written = 0;
+        // 先写输入程序的内容，再用随机数据补齐到指定大小
+        while (ifs && (output_bytes == 0 || written < output_bytes))
+        {
+            auto to_read = output_bytes == 0
+                               ? buffer.size()
+                               : static_cast<size_t>(std::min<uint64_t>(buffer.size(), output_bytes - written));
+            ifs.read(buffer.data(), static_cast<std::streamsize>(to_read));
+            ofs.write(buffer.data(), ifs.gcount());
+            written += static_cast<uint64_t>(ifs.gcount());
+        }
+        while (written < output_bytes)
+        {
+            auto chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size(), output_bytes - written));
+            std::ranges::generate(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(chunk),
+                                  [&rng] { return static_cast<char>(rng()); });
+            ofs.write(buffer.data(), static_cast<std::streamsize>(chunk));
+            written += chunk;
+        }
+        return static_cast<bool>(ofs);
+    }
+}
+
+/**
+ * 代替VMProtect_Con用于测试和压测：vmpx_fake_packer <.vmp文件> <输出文件>
+ * 按与加壳程序相同的格式输出进度，成功时最后一行为Compilation completed
+ */
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cout << "Usage: vmpx_fake_packer <project.vmp> <output file>" << std::endl;
+        return 1;
+    }
+    auto options = LoadOptions();
+    std::mt19937_64 rng{options.seed.value_or(std::random_device{}())};
+    auto begin = std::chrono::steady_clock::now();
+    auto duration = std::max<std::chrono::steady_clock::duration>(SampleDuration(options, rng), options.cpu);
+    bool fail = std::bernoulli_distribution(options.failure_rate)(rng);
+
+    std::filesystem::path vmp_file_path{argv[1]};
+    std::filesystem::path output_path{argv[2]};
+    std::cout << std::format("Loading file {}...", vmp_file_path.filename().string()) << std::endl;
+    auto input_file_path = ReadInputFilePath(vmp_file_path);
+    if (!input_file_path)
+    {
+        std::cout << "Error: unable to read project file" << std::endl;
+        return 1;
+    }
+    // 分析和编译各占一半时间，CPU占用均摊在各个进度点之间
+    constexpr int STEPS = 10;
+    auto step_duration = duration / (2 * STEPS);
+    auto step_cpu = std::chrono::duration_cast<std::chrono::steady_clock::duration>(options.cpu) / (2 * STEPS);
+    auto next_step = begin;
+    for (std::string_view phase : {"Analyzing", "Compiling"})
+    {
+        for (int step = 1; step <= STEPS; ++step)
+        {
+            BurnCpu(step_cpu);
+            next_step += step_duration;
+            std::this_thread::sleep_until(next_step);
+            std::cout << std::format("{}... {}%", phase, step * 100 / STEPS) << std::endl;
+            if (fail && phase == "Compiling" && step == STEPS / 2)
+            {
+                std::cout << "Error: simulated pack failure" << std::endl;
+                return 1;
+            }
+        }
+    }
+    std::cout << "Saving file..." << std::endl;
+    if (!WriteOutput(input_file_path.value(), output_path, options.output_bytes, rng))
+    {
+        std::cout << "Error: unable to write output file" << std::endl;
+        return 1;
+    }
+    std::cout << "Compilation completed" << std::endl;
+    return 0;
+}
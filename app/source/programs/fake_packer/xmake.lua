@@ -0,0 +1,10 @@
+local target_name = "vmpx_fake_packer"
+local kind = "binary"
+local group_name = "bench"
+local pkgs = { "pugixml" }
+local deps = {}
+local syslinks = {}
+local function callback()
+    set_default(false)
+end
+CreateTarget(target_name, kind, os.scriptdir(), group_name, pkgs, deps, syslinks, callback)
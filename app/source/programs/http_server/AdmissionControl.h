@@ -0,0 +1,104 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace vmpx
+{
+    namespace admission
+    {
+        struct AdmissionOptions
+        {
+            // 每个客户端每秒补充的令牌数，0表示不限制
+            uint32_t rate = 0;
+            // 桶容量，即允许的突发量，0表示rate的两倍
+            uint32_t burst = 0;
+            // 以该请求头区分客户端，如X-Api-Key或反向代理的X-Real-IP；为空时按连接的IP区分
+            // 请求头由客户端提供，只应在前面有网关校验的情况下使用
+            std::string client_header;
+        };
+
+        struct AdmissionDecision
+        {
+            bool admitted;
+            // 被拒绝时，至少等待多久再重试
+            std::chrono::milliseconds retry_after;
+        };
+
+        struct AdmissionStats
+        {
+            uint64_t admitted;
+            uint64_t rejected;
+            // 没有空闲槽位，与其它客户端共用桶的次数
+            uint64_t shared;
+        };
+
+        /**
+         * 按客户端的令牌桶准入控制，以GCRA实现：每个桶只有一个原子的理论到达时间，扣除令牌为一次CAS，无锁
+         * 客户端放在固定大小的开放寻址表里，桶已满（一段时间没有请求）的槽位可以被其它客户端回收
+         */
+        class AdmissionController
+        {
+        public:
+            static constexpr size_t TABLE_SIZE = 1 << 14;
+            static constexpr size_t MAX_PROBES = 16;
+
+            explicit AdmissionController(const AdmissionOptions& options);
+            AdmissionController(const AdmissionController& other) = delete;
+            AdmissionController(AdmissionController&& other) noexcept = delete;
+            AdmissionController& operator=(const AdmissionController& other) = delete;
+            AdmissionController& operator=(AdmissionController&& other) noexcept = delete;
+
+            bool Enabled() const noexcept
+            {
+                return options_.rate > 0;
+            }
+
+            const AdmissionOptions& Options() const noexcept
+            {
+                return options_;
+            }
+
+            /**
+             * 扣除令牌
+             * @param client 客户端标识
+             * @param cost 令牌数，超过桶容量时只在桶满时通过，并按全部代价扣除
+             * @return 
+             */
+            AdmissionDecision TryAcquire(std::string_view client, uint32_t cost) noexcept;
+
+            AdmissionStats Stats() const noexcept;
+
+        private:
+            struct Slot
+            {
+                // 客户端标识的hash，0表示空闲
+                std::atomic_uint64_t key{0};
+                // 理论到达时间，不晚于当前时间即桶已满
+                std::atomic_int64_t tat{0};
+            };
+
+            Slot& FindSlot(uint64_t key, int64_t now) noexcept;
+
+            AdmissionOptions options_;
+            // 补充一个令牌的时间
+            int64_t emission_interval_ns_;
+            std::unique_ptr<Slot[]> slots_;
+            std::atomic_uint64_t admitted_{0};
+            std::atomic_uint64_t rejected_{0};
+            std::atomic_uint64_t shared_{0};
+        };
+
+        /**
+         * 请求的代价，便宜的接口为1，生成密钥的代价随密钥长度近似按三次方增长
+         * 只在请求体里查找key_size，不解析整个JSON
+         * @param path 
+         * @param body 
+         * @return 
+         */
+        uint32_t RequestCost(std::string_view path, std::string_view body) noexcept;
+    }
+}
@@ -0,0 +1,102 @@
+﻿#pragma once
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        enum class FileKind : uint8_t
+        {
+            OTHER,
+            VMP_PROJECT,
+            EXECUTABLE,
+            LIBRARY
+        };
+
+        /**
+         * 按扩展名判断文件类型
+         * @param path 
+         * @return 
+         */
+        FileKind ClassifyFile(std::string_view path);
+
+        std::string_view FileKindName(FileKind kind);
+
+        struct ManifestEntry
+        {
+            // zip内的相对路径（UTF-8，'/'分隔）
+            std::string path;
+            uint64_t size;
+            uint32_t crc32;
+            FileKind kind;
+            // 存入BlobStore时为内容的SHA256，否则为空
+            std::string sha256;
+        };
+
+        /**
+         * 解压时生成的文件清单，.vmp查找、变化检测和文件列表都基于它，不再遍历目录
+         */
+        struct AppManifest
+        {
+            // 按path排序
+            std::vector<ManifestEntry> files;
+
+            const ManifestEntry* Find(std::string_view path) const;
+
+            std::vector<const ManifestEntry*> FilesOfKind(FileKind kind) const;
+
+            uint64_t TotalSize() const;
+        };
+
+        /**
+         * 清单中的文件解压后所在的路径
+         * @param root_dir app的解压目录
+         * @param path 清单中的相对路径
+         * @return 
+         */
+        std::filesystem::path ManifestFilePath(const std::filesystem::path& root_dir, std::string_view path);
+
+        /**
+         * 每个app一个清单文件，和注册表放在同一个数据目录下，读过的清单缓存在内存中
+         * 线程安全，同一app的读写由调用者串行化
+         */
+        class ManifestStore
+        {
+        public:
+            using ManifestPtr = std::shared_ptr<const AppManifest>;
+
+            explicit ManifestStore(const std::filesystem::path& dir);
+            ManifestStore(const ManifestStore& other) = delete;
+            ManifestStore(ManifestStore&& other) noexcept = delete;
+            ManifestStore& operator=(const ManifestStore& other) = delete;
+            ManifestStore& operator=(ManifestStore&& other) noexcept = delete;
+
+            std::expected<ManifestPtr, std::string> Load(std::string_view name);
+
+            /**
+             * 原子地写入清单，并替换缓存
+             * @param name 
+             * @param manifest 
+             * @return 
+             */
+            bool Save(std::string_view name, AppManifest manifest);
+
+            void Remove(std::string_view name);
+
+        private:
+            std::filesystem::path ManifestPath(std::string_view name) const;
+
+            std::filesystem::path dir_;
+            std::mutex mutex_;
+            std::unordered_map<std::string, ManifestPtr> cache_;
+        };
+    }
+}
@@ -1,33 +1,152 @@
 ﻿#pragma once
 #include <expected>
 #include <filesystem>
+#include <functional>
+#include <map>
 #include <span>
+#include <string>
 #include <unordered_map>
 #include <memory>
+#include <optional>
+#include <stop_token>
+#include <utility>
+#include <vector>
 
+#include "AppManifest.h"
+#include "PackCache.h"
+#include "PackExecutor.h"
+#include "RegistryIndex.h"
 #include "VMPX.h"
 
 namespace vmpx
 {
     namespace app_pack
     {
-        bool UnzipToDir(const std::filesystem::path& zip_path, const std::filesystem::path& output_dir);
+        class BlobStore;
 
-        struct AppInfo
-        {
-            // std::filesystem::path vmp_file_path;
-            // std::filesystem::path packed_app_path;
-            std::string vmp_file_path;
-            std::string packed_app_path;
-        };
+        /**
+         * 解压zip到目录
+         * @param zip_path 
+         * @param output_dir 
+         * @param blob_store 不为空时，文件内容存入仓库，解压出的文件为指向仓库的硬链接
+         * @param manifest 不为空时，依次追加每个已解压文件的清单项
+         * @return 
+         */
+        bool UnzipToDir(const std::filesystem::path& zip_path, const std::filesystem::path& output_dir,
+                        BlobStore* blob_store = nullptr, AppManifest* manifest = nullptr);
 
+        /**
+         * 旧版本的YAML配置，仅用于迁移
+         */
         struct Config
         {
             std::unordered_map<std::string, AppInfo> apps;
         };
 
+        struct BatchPackResult
+        {
+            std::string name;
+            // 加壳配置，default为默认配置
+            std::string profile;
+            PackResult result;
+        };
+
+        struct ProfilePackResult
+        {
+            std::string profile;
+            PackResult result;
+        };
+
+        /**
+         * 增量更新时客户端持有的文件
+         */
+        struct UpdateFile
+        {
+            // zip内的相对路径（UTF-8，'/'分隔）
+            std::string path;
+            std::string sha256;
+        };
+
+        /**
+         * 增量更新的第一步结果，客户端只需上传changed中的文件
+         */
+        struct UpdateDiff
+        {
+            std::string session_id;
+            // 服务端缺失或内容不同的文件
+            std::vector<std::string> changed;
+            // 服务端多出、应用更新时删除的文件
+            std::vector<std::string> removed;
+        };
+
+        struct UpdateResult
+        {
+            AppInfo app_info;
+            uint64_t updated;
+            uint64_t removed;
+            // .vmp或待加壳程序发生变化，已清除加壳结果
+            bool pack_invalidated;
+            // 被清除加壳结果的配置
+            std::vector<std::string> invalidated_profiles;
+        };
+
+        /**
+         * .vmp工程中的一个元素
+         */
+        struct ProjectNode
+        {
+            // 以'/'分隔的元素路径，如Document/Protection
+            std::string path;
+            std::map<std::string, std::string> attributes;
+            // 子元素的名字
+            std::vector<std::string> children;
+        };
+
+        /**
+         * 修改.vmp工程中某个元素的属性
+         */
+        struct ProjectPatch
+        {
+            std::string path;
+            std::string attribute;
+            // 为空表示删除该属性
+            std::optional<std::string> value;
+        };
+
+        /**
+         * 启动时载入注册表的耗时
+         */
+        struct RegistryLoadStats
+        {
+            uint64_t apps;
+            uint64_t pages;
+            // 上次快照之后回放的日志记录数
+            uint64_t journal_records;
+            uint64_t load_ms;
+            uint64_t replay_ms;
+            uint64_t total_ms;
+        };
+
+        /**
+         * 后台核对注册表与解压、加壳目录的结果
+         */
+        struct ReconcileReport
+        {
+            uint64_t checked;
+            // 重新解压或清除了失效的加壳结果
+            uint64_t repaired;
+            uint64_t broken;
+            uint64_t elapsed_ms;
+            std::vector<std::string> broken_apps;
+        };
+
         /**
-         * TODO：线程安全
+         * 加壳进度回调，在加壳线程上调用
+         */
+        using PackEventListener = std::function<void(std::string_view name, const PackEvent& event)>;
+
+        /**
+         * 线程安全，注册表以快照发布，读操作无锁；解压、加壳等耗时操作只锁住所操作的app
          */
         class AppPackService
         {
@@ -35,9 +154,18 @@ namespace vmpx
             //还得是PImpl
             struct Impl;
 
+            /**
+             * 
+             * @param vmp_console_app_path VMProtect_Con.exe
+             * @param data_dir 数据目录
+             * @param max_concurrent_packs 同时运行的加壳进程数上限，0表示CPU核数
+             * @param pack_timeout 单次加壳的时长上限，超时后杀掉加壳进程
+             */
             AppPackService(
                 const std::filesystem::path& vmp_console_app_path,
-                const std::filesystem::path& data_dir);
+                const std::filesystem::path& data_dir,
+                size_t max_concurrent_packs = 0,
+                std::chrono::milliseconds pack_timeout = PackExecutor::DEFAULT_TIMEOUT);
             ~AppPackService();
             AppPackService(const AppPackService& other) = delete;
             AppPackService(AppPackService&& other) noexcept = default;
@@ -48,12 +176,53 @@ namespace vmpx
              * 添加或覆盖已有程序
              * @param name 程序名，必须全局唯一
              * @param zip_file_data 压缩包文件 
-             * @param vmp_file_path .vmp文件在压缩包内的相对路径，默认则自动搜索
+             * @param vmp_file_path 默认配置的.vmp文件在压缩包内的相对路径，默认则自动搜索
+             * 压缩包内其它.vmp文件各自作为一套加壳配置，以文件名命名
              * @return 如果成功则返回AppInfo，否则返回错误原因
              */
             std::expected<AppInfo, std::string> Add(std::string_view name, std::span<uint8_t> zip_file_data,
                                                     std::filesystem::path vmp_file_path = "");
 
+            /**
+             * 增量更新第一步：比较客户端的文件列表与当前清单，返回需要上传的文件
+             * @param name 
+             * @param files 客户端更新后的完整文件列表
+             * @return 
+             */
+            std::expected<UpdateDiff, std::string> BeginUpdate(std::string_view name,
+                                                               std::span<const UpdateFile> files);
+
+            /**
+             * 增量更新第二步：在原解压目录上应用上传的文件，并删除客户端已没有的文件
+             * 只有.vmp或待加壳程序变化时才清除加壳结果
+             * @param session_id BeginUpdate返回的会话，只能使用一次
+             * @param zip_file_data 只包含changed中文件的压缩包，没有需要上传的文件时可以为空
+             * @return 
+             */
+            std::expected<UpdateResult, std::string> ApplyUpdate(std::string_view session_id,
+                                                                 std::span<uint8_t> zip_file_data);
+
+            /**
+             * 读取.vmp工程中的元素，DOM按app缓存，.vmp文件变化后重新解析
+             * @param name 
+             * @param path 以'/'分隔的元素路径
+             * @param profile 加壳配置，为空表示默认配置
+             * @return 
+             */
+            std::expected<ProjectNode, std::string> GetProjectNode(std::string_view name, std::string_view path,
+                                                                   std::string_view profile = {});
+
+            /**
+             * 修改.vmp工程的属性并原子地写回，只清除该配置的加壳结果，不重新解压
+             * @param name 
+             * @param patches 依次应用，任一元素不存在则全部不生效
+             * @param profile 加壳配置，为空表示默认配置
+             * @return 
+             */
+            std::expected<AppInfo, std::string> PatchProject(std::string_view name,
+                                                             std::span<const ProjectPatch> patches,
+                                                             std::string_view profile = {});
+
             /**
              * 移除某个已添加的应用
              * @param name 
@@ -67,37 +236,192 @@ namespace vmpx
              */
             std::vector<std::string> List() const;
 
+            /**
+             * 按名字顺序分页列出程序
+             * @param prefix 只列出以此开头的名字
+             * @param cursor 上一页返回的next_cursor，为空则从头开始
+             * @param limit 本页最多返回的个数
+             * @return 
+             */
+            AppListPage ListPage(std::string_view prefix, std::string_view cursor, size_t limit) const;
+
+            /**
+             * 自since版本以来增删的程序名
+             * @param since 客户端持有的版本
+             * @return 
+             */
+            AppListDelta ListDelta(uint64_t since) const;
+
+            /**
+             * 注册表当前版本，每次修改递增
+             * @return 
+             */
+            uint64_t RegistryVersion() const;
+
             /**
              * 
              * @param name 
+             * @param profile 加壳配置，为空表示默认配置
              * @return 返回已打包程序的所在路径，如果不存在则返回empty
              */
-            std::filesystem::path GetPacked(std::string_view name);
+            std::filesystem::path GetPacked(std::string_view name, std::string_view profile = {});
 
             /**
              * 打包程序，这个函数非常耗时，最好放在线程池
+             * 不同app可以并发打包，同一app的打包、添加、移除互斥
              * @param name 
+             * @param priority 排队时的优先级
              * @return 
              */
-            std::expected<std::filesystem::path, std::string> Pack(std::string_view name);
+            std::expected<std::filesystem::path, std::string> Pack(std::string_view name,
+                                                                   PackPriority priority = PackPriority::NORMAL);
+
+            /**
+             * 按指定的加壳配置打包，输出到该配置单独的目录
+             * @param name 
+             * @param profile 为空表示默认配置
+             * @param priority 
+             * @return 
+             */
+            std::expected<std::filesystem::path, std::string> PackProfile(std::string_view name,
+                                                                          std::string_view profile,
+                                                                          PackPriority priority =
+                                                                              PackPriority::NORMAL);
+
+            /**
+             * 并发打包app的所有加壳配置，各配置共用只读的解压目录，输出互不干扰
+             * @param name 
+             * @param priority 
+             * @return 默认配置在前，其余按添加时的顺序
+             */
+            std::expected<std::vector<ProfilePackResult>, std::string> PackAllProfiles(
+                std::string_view name, PackPriority priority = PackPriority::NORMAL);
+
+            /**
+             * 批量加壳，各app并发排队，已打包的直接返回结果
+             * 同时等待的线程数不超过加壳执行器的并发上限
+             * @param names 
+             * @param priority 
+             * @param profiles 每个app要打包的加壳配置，为空表示只打包默认配置；app没有的配置在结果中报错
+             * @param stop_token 请求停止后不再开始新的加壳，进行中的加壳被取消
+             * @return 按names、profiles的顺序排列的结果
+             */
+            std::vector<BatchPackResult> PackBatch(std::span<const std::string> names,
+                                                   PackPriority priority = PackPriority::NORMAL,
+                                                   std::span<const std::string> profiles = {},
+                                                   std::stop_token stop_token = {});
+
+            /**
+             * 设置加壳进度回调，需在开始提供服务前设置
+             * @param listener 
+             */
+            void SetPackEventListener(PackEventListener listener);
+
+            /**
+             * 取消某个app正在排队或运行的加壳，包括所有加壳配置
+             * @param name 
+             * @return 没有正在进行的加壳则返回false
+             */
+            bool CancelPack(std::string_view name);
+
+            /**
+             * 加壳执行器的排队、运行和占用率等统计
+             * @return 
+             */
+            PackExecutorMetrics GetPackMetrics() const;
 
             bool Has(std::string_view name) const;
 
             std::expected<ProductInfo, std::string> GetProductInfo(std::string_view name);
 
+            /**
+             * 加壳结果缓存的命中、淘汰等统计
+             * @return 
+             */
+            PackCacheStats GetPackCacheStats() const;
+
+            /**
+             * 解压时生成的文件清单
+             * @param name 
+             * @return 
+             */
+            std::expected<ManifestStore::ManifestPtr, std::string> GetManifest(std::string_view name);
+
+            /**
+             * 构造时载入注册表的统计
+             * @return 
+             */
+            RegistryLoadStats GetLoadStats() const;
+
+            /**
+             * 在后台线程并行核对每个app的.vmp文件和加壳结果，不阻塞服务启动
+             * 解压文件缺失时从zip重新解压，加壳结果缺失时清除记录，无法修复的app标记为损坏，加壳时直接报错
+             * @param on_finished 核对结束后在后台线程上调用
+             */
+            void StartReconcile(std::function<void(const ReconcileReport& report)> on_finished = {});
+
         private:
             /**
-             * 保存配置文件
+             * 移除app，调用者需持有该app的锁
+             * @param name 
+             * @return 
+             */
+            bool RemoveUnlocked(std::string_view name);
+
+            /**
+             * 清理旧的解压目录并从zip重新解压，同时重写文件清单，调用者需持有该app的锁
+             * @param name 
+             * @return 
+             */
+            bool UnzipUnlocked(std::string_view name);
+
+            /**
+             * 按清单从BlobStore重新链接解压目录，用于增量更新后已没有对应zip的app，调用者需持有该app的锁
+             * @param name 
+             * @return 
+             */
+            bool RestoreFromBlobsUnlocked(std::string_view name);
+
+            /**
+             * 删除某套配置的加壳结果文件，不修改注册表，调用者需持有该app的锁
+             * @param name 
+             * @param profile 
+             */
+            void RemovePackedOutput(std::string_view name, const AppProfile& profile);
+
+            ReconcileReport Reconcile(std::stop_token stop_token);
+
+            /**
+             * 加壳，调用者需持有该app的锁
+             * 同一app的不同配置可以在多个线程上同时调用
+             * @param name 
+             * @param profile 
+             * @param priority 
+             * @return 
+             */
+            std::expected<std::filesystem::path, std::string> PackUnlocked(std::string_view name,
+                                                                           std::string_view profile,
+                                                                           PackPriority priority);
+
+            void NotifyPackEvent(std::string_view name, const PackEvent& event) const;
+
+            /**
+             * 将一次修改追加到日志，日志过大时把index的变化页写入分页存储并清空日志
+             * 在注册表的更新回调中调用，日志顺序与快照发布顺序一致
+             * @param index 即将发布的快照
+             * @param name 
+             * @param app_info 为空表示删除
+             * @return 日志序号，更新回调返回后再等待落盘
              */
-            void SaveConfig();
+            uint64_t LogMutation(const RegistryIndex& index, std::string_view name,
+                                 const std::optional<AppInfo>& app_info);
 
-            void LoadConfig();
+            Config LoadConfig();
             std::unique_ptr<Impl> impl_;
             std::filesystem::path vmp_console_app_path_;
             std::filesystem::path data_dir_;
             std::filesystem::path zip_dir_, unzip_dir_, packed_dir_;
             std::filesystem::path config_path_;
-            Config config_;
         };
     }
 }
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <expected>
+#include <filesystem>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        /**
+         * 按内容寻址的文件仓库，以文件内容的SHA256作为键
+         * 解压出的文件通过硬链接引用仓库中的blob；每个引用者的引用记录在refs/<owner>.refs中，
+         * blob只有在没有任何引用记录、且除仓库自身外没有其它硬链接（正在解压还未记录引用）时才会被回收
+         */
+        class BlobStore
+        {
+        public:
+            explicit BlobStore(const std::filesystem::path& root_dir);
+            BlobStore(const BlobStore& other) = delete;
+            BlobStore(BlobStore&& other) noexcept = delete;
+            BlobStore& operator=(const BlobStore& other) = delete;
+            BlobStore& operator=(BlobStore&& other) noexcept = delete;
+
+            /**
+             * 计算数据的SHA256
+             * @param data
+             * @return 小写16进制字符串
+             */
+            static std::string Hash(std::span<const uint8_t> data);
+
+            /**
+             * 将数据存入仓库（已存在则复用），并在dst_path处创建指向它的硬链接
+             * 不退化为复制：复制出的文件不计入硬链接数，回收时无法得知blob正在被使用
+             * @param data 文件内容
+             * @param dst_path 目标文件路径
+             * @return 如果成功则返回内容的hash，否则返回错误原因
+             */
+            std::expected<std::string, std::string> Emplace(std::span<const uint8_t> data,
+                                                            const std::filesystem::path& dst_path);
+
+            /**
+             * 在dst_path处创建指向已有blob的硬链接
+             * @param hash 
+             * @param dst_path 
+             * @return blob不存在或链接失败则返回false
+             */
+            bool Link(std::string_view hash, const std::filesystem::path& dst_path);
+
+            /**
+             * 记录owner引用的所有blob，覆盖之前的记录
+             * @param owner 引用者，一般为app名
+             * @param hashes
+             */
+            void AddRefs(std::string_view owner, const std::vector<std::string>& hashes);
+
+            /**
+             * 释放owner的所有引用，并删除不再被引用的blob
+             * @param owner
+             */
+            void Release(std::string_view owner);
+
+            /**
+             * 删除hashes中不再被引用的blob，用于回收存入后未被记录引用的blob
+             * @param hashes 
+             */
+            void Collect(std::span<const std::string> hashes);
+
+            std::filesystem::path BlobPath(std::string_view hash) const;
+
+        private:
+            std::filesystem::path RefsPath(std::string_view owner) const;
+            /**
+             * 删除没有引用记录也没有其它硬链接的blob，调用时需独占持有锁
+             * @param hashes 
+             */
+            void CollectLocked(std::span<const std::string> hashes);
+
+            std::filesystem::path objects_dir_, refs_dir_, tmp_dir_;
+            // Emplace、Link共享持有，修改引用和回收时独占持有，避免blob在链接前被回收
+            std::shared_mutex mutex_;
+            // 以下由mutex_保护，启动时从refs目录载入；每个引用者引用的blob（去重）和每个blob的引用者数
+            std::unordered_map<std::string, std::vector<std::string>> owner_refs_;
+            std::unordered_map<std::string, size_t> ref_counts_;
+        };
+    }
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+#include <condition_variable>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string_view>
+#include <utility>
+
+#include <hv/HttpResponseWriter.h>
+
+namespace vmpx
+{
+    namespace stream
+    {
+        /**
+         * 以chunked编码分块写出响应，连接上未发出的数据超过上限时阻塞写入方
+         * 写缓冲由IO线程发出，每次发出后由写完成回调唤醒写入方，因此只能在IO线程之外调用Write
+         */
+        class ChunkedStream
+        {
+        public:
+            static constexpr size_t DEFAULT_MAX_PENDING_BYTES = 1024 * 1024;
+
+            /**
+             * 发送状态行和响应头
+             * @param writer 
+             * @param content_type 
+             * @param headers 其它响应头
+             * @param max_pending_bytes 
+             */
+            ChunkedStream(hv::HttpResponseWriterPtr writer, std::string_view content_type,
+                          std::initializer_list<std::pair<std::string_view, std::string_view>> headers = {},
+                          size_t max_pending_bytes = DEFAULT_MAX_PENDING_BYTES);
+            ChunkedStream(const ChunkedStream& other) = delete;
+            ChunkedStream(ChunkedStream&& other) noexcept = delete;
+            ChunkedStream& operator=(const ChunkedStream& other) = delete;
+            ChunkedStream& operator=(ChunkedStream&& other) noexcept = delete;
+
+            /**
+             * 写出一块，写缓冲超过上限时等到回落
+             * @param data 
+             * @param stop_token 请求停止后不再等待
+             * @return 连接已断开或已请求停止时返回false
+             */
+            bool Write(std::string_view data, std::stop_token stop_token = {});
+
+            /**
+             * 写出结束块
+             */
+            void End();
+
+            /**
+             * 响应体写出一半时出错，直接断开连接，客户端不会把截断的内容当作完整的响应
+             */
+            void Abort();
+
+            bool Connected() const;
+
+        private:
+            struct State
+            {
+                std::mutex mutex;
+                std::condition_variable_any cv;
+            };
+
+            hv::HttpResponseWriterPtr writer_;
+            size_t max_pending_bytes_;
+            std::shared_ptr<State> state_;
+        };
+    }
+}
@@ -0,0 +1,150 @@
+﻿#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "VMPX.h"
+
+namespace vmpx
+{
+    namespace issue
+    {
+        enum class IssueFormat : uint8_t
+        {
+            // 每行 user_name,email,hwid,exp_date（YYYY-MM-DD），首行可为表头
+            CSV,
+            // 每行一个SerialInfo对象
+            NDJSON
+        };
+
+        struct IssueJobInfo
+        {
+            std::string id;
+            // 产品（App）名称
+            std::string name;
+            std::string format;
+            // queued、running、done、failed、cancelled
+            std::string state;
+            uint64_t total_rows;
+            uint64_t rows_done;
+            uint64_t rows_failed;
+            // 本次运行以来的速度
+            double rows_per_second;
+            uint64_t elapsed_ms;
+            uint64_t eta_ms;
+            // 重启后从检查点恢复的次数
+            uint64_t resumed;
+            std::string message;
+        };
+
+        /**
+         * 后台批量签发序列号
+         * 输入文件、输出文件和检查点保存在root_dir/<id>下，任务按提交顺序逐个运行，
+         * 每块数据用上所有CPU核生成并按输入顺序写出；每块写完后落盘并更新检查点，重启后从最后一个检查点继续
+         * 已结束的任务只保留最近的若干个，更早的连同文件一起删除
+         */
+        class IssueJobService
+        {
+        public:
+            // 每块的行数，也是检查点的间隔
+            static constexpr uint64_t DEFAULT_CHECKPOINT_ROWS = 4096;
+            static constexpr size_t DEFAULT_MAX_FINISHED_JOBS = 100;
+
+            /**
+             * 载入root_dir下已有的任务，未完成的任务重新排队
+             * @param root_dir
+             * @param num_threads 生成序列号的线程数，0表示CPU核数
+             * @param checkpoint_rows
+             * @param max_finished_jobs 保留的已结束（完成、失败、取消）任务数，至少为1
+             */
+            explicit IssueJobService(const std::filesystem::path& root_dir, size_t num_threads = 0,
+                                     uint64_t checkpoint_rows = DEFAULT_CHECKPOINT_ROWS,
+                                     size_t max_finished_jobs = DEFAULT_MAX_FINISHED_JOBS);
+            /**
+             * 停止当前任务，未写完的块丢弃，下次启动时从检查点继续
+             */
+            ~IssueJobService();
+            IssueJobService(const IssueJobService& other) = delete;
+            IssueJobService(IssueJobService&& other) noexcept = delete;
+            IssueJobService& operator=(const IssueJobService& other) = delete;
+            IssueJobService& operator=(IssueJobService&& other) noexcept = delete;
+
+            /**
+             * 保存输入文件并排队
+             * @param name 产品名称，只用于展示
+             * @param product_info
+             * @param format
+             * @param input 输入文件内容
+             * @param ignore_network_adapters 去掉HWID中的网卡
+             * @return
+             */
+            std::expected<IssueJobInfo, std::string> Submit(std::string_view name,
+                                                            const ProductInfoEntity& product_info,
+                                                            IssueFormat format, std::span<const uint8_t> input,
+                                                            bool ignore_network_adapters = false);
+
+            std::expected<IssueJobInfo, std::string> Get(std::string_view id) const;
+
+            /**
+             * @return 按提交顺序排列
+             */
+            std::vector<IssueJobInfo> List() const;
+
+            /**
+             * 取消排队中或运行中的任务，已写出的结果保留
+             * @param id
+             * @return 任务不存在或已结束则返回false
+             */
+            bool Cancel(std::string_view id);
+
+            /**
+             * 删除已结束的任务及其文件
+             * @param id
+             * @return 任务不存在或未结束时返回错误
+             */
+            std::expected<void, std::string> Remove(std::string_view id);
+
+            /**
+             * 已完成任务的输出文件
+             * @param id
+             * @return 任务不存在或未完成时返回错误
+             */
+            std::expected<std::filesystem::path, std::string> OutputPath(std::string_view id) const;
+
+            static std::expected<IssueFormat, std::string> ParseFormat(std::string_view format);
+
+        private:
+            struct Job;
+
+            void RunLoop(std::stop_token stop_token);
+            void RunJob(Job& job, std::stop_token stop_token);
+            IssueJobInfo MakeInfo(const Job& job) const;
+            /**
+             * 删除超出保留数量的已结束任务，先提交的先删，调用时需持有锁
+             */
+            void PruneFinishedLocked();
+
+            std::filesystem::path root_dir_;
+            size_t num_threads_;
+            uint64_t checkpoint_rows_;
+            size_t max_finished_jobs_;
+            uint64_t next_seq_{1};
+            mutable std::mutex mutex_;
+            std::condition_variable_any cv_;
+            std::map<std::string, std::shared_ptr<Job>> jobs_;
+            std::deque<std::shared_ptr<Job>> queue_;
+            std::jthread runner_;
+        };
+    }
+}
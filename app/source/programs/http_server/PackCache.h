@@ -0,0 +1,88 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        struct PackCacheStats
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t stores;
+            uint64_t evictions;
+            uint64_t entries;
+            uint64_t bytes;
+        };
+
+        /**
+         * 持久化的加壳结果缓存
+         * 键为输入程序、.vmp工程文件内容以及加壳程序本身的hash，按最近使用时间淘汰
+         */
+        class PackCache
+        {
+        public:
+            static constexpr uint64_t DEFAULT_MAX_BYTES = 8ull << 30;
+            static constexpr uint64_t DEFAULT_MAX_ENTRIES = 1024;
+
+            PackCache(const std::filesystem::path& root_dir, const std::filesystem::path& vmp_console_app_path,
+                      uint64_t max_bytes = DEFAULT_MAX_BYTES, uint64_t max_entries = DEFAULT_MAX_ENTRIES);
+            PackCache(const PackCache& other) = delete;
+            PackCache(PackCache&& other) noexcept = delete;
+            PackCache& operator=(const PackCache& other) = delete;
+            PackCache& operator=(PackCache&& other) noexcept = delete;
+
+            /**
+             * 计算某个.vmp工程的缓存键
+             * @param vmp_file_path
+             * @param input_file_path 待加壳的程序
+             * @param output_file_name 加壳输出文件名，参与计算
+             * @return
+             */
+            std::expected<std::string, std::string> Key(const std::filesystem::path& vmp_file_path,
+                                                        const std::filesystem::path& input_file_path,
+                                                        std::string_view output_file_name) const;
+
+            /**
+             * 查找缓存，命中时将结果链接（或复制）到dst_path
+             * @param key
+             * @param dst_path
+             * @return 命中并成功链接则返回true
+             */
+            bool Fetch(std::string_view key, const std::filesystem::path& dst_path);
+
+            /**
+             * 保存加壳结果，必要时淘汰最久未使用的条目
+             * @param key
+             * @param artifact_path
+             */
+            void Store(std::string_view key, const std::filesystem::path& artifact_path);
+
+            PackCacheStats Stats() const;
+
+        private:
+            struct Entry
+            {
+                uint64_t bytes;
+                std::filesystem::file_time_type last_used;
+            };
+
+            std::filesystem::path EntryPath(std::string_view key) const;
+            void EvictLocked();
+
+            std::filesystem::path root_dir_;
+            std::string packer_identity_;
+            uint64_t max_bytes_, max_entries_;
+            mutable std::mutex mutex_;
+            std::unordered_map<std::string, Entry> entries_;
+            PackCacheStats stats_{};
+        };
+    }
+}
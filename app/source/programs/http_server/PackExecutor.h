@@ -0,0 +1,115 @@
+﻿#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "VMPX.h"
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        enum class PackPriority : uint8_t
+        {
+            LOW,
+            NORMAL,
+            HIGH
+        };
+
+        using PackResult = std::expected<std::filesystem::path, std::string>;
+
+        struct PackTicket
+        {
+            uint64_t id;
+            std::shared_future<PackResult> result;
+        };
+
+        struct PackExecutorMetrics
+        {
+            uint64_t max_concurrency;
+            uint64_t running;
+            uint64_t queued;
+            uint64_t submitted;
+            uint64_t completed;
+            uint64_t failed;
+            uint64_t cancelled;
+            uint64_t timed_out;
+            // 累计排队等待、运行时间
+            uint64_t queue_wait_ms;
+            uint64_t busy_ms;
+            // 启动以来加壳进程槽位的平均占用率
+            double utilisation;
+        };
+
+        /**
+         * 加壳任务执行器，限制同时运行的加壳进程数
+         * 任务按优先级、提交顺序出队，支持超时和取消
+         */
+        class PackExecutor
+        {
+        public:
+            using Job = std::function<PackResult(const PackOptions& options)>;
+
+            static constexpr auto DEFAULT_TIMEOUT = std::chrono::minutes(30);
+
+            /**
+             * @param max_concurrency 同时运行的任务数上限，0表示CPU核数
+             * @param timeout 单个任务的运行时长上限，超时后杀掉加壳进程
+             */
+            explicit PackExecutor(size_t max_concurrency = 0,
+                                  std::chrono::milliseconds timeout = DEFAULT_TIMEOUT);
+            ~PackExecutor();
+            PackExecutor(const PackExecutor& other) = delete;
+            PackExecutor(PackExecutor&& other) noexcept = delete;
+            PackExecutor& operator=(const PackExecutor& other) = delete;
+            PackExecutor& operator=(PackExecutor&& other) noexcept = delete;
+
+            PackTicket Submit(Job job, PackPriority priority = PackPriority::NORMAL);
+
+            /**
+             * 取消任务，排队中的任务直接出队，运行中的任务杀掉加壳进程
+             * @param id
+             * @return 任务不存在或已结束则返回false
+             */
+            bool Cancel(uint64_t id);
+
+            PackExecutorMetrics Metrics() const;
+
+        private:
+            struct Task
+            {
+                uint64_t id;
+                Job job;
+                std::promise<PackResult> promise;
+                std::stop_source stop_source;
+                std::chrono::steady_clock::time_point submit_time;
+            };
+
+            // 优先级高的在前，同优先级先提交的在前
+            using QueueKey = std::pair<int, uint64_t>;
+
+            void WorkerLoop(std::stop_token stop_token);
+
+            std::chrono::milliseconds timeout_;
+            std::chrono::steady_clock::time_point start_time_;
+            mutable std::mutex mutex_;
+            std::condition_variable_any cv_;
+            std::map<QueueKey, std::shared_ptr<Task>> queue_;
+            std::unordered_map<uint64_t, std::shared_ptr<Task>> running_;
+            uint64_t next_id_{1};
+            PackExecutorMetrics metrics_{};
+            std::vector<std::jthread> workers_;
+        };
+    }
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <hv/HttpResponseWriter.h>
+
+#include "VMPX.h"
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        /**
+         * 将加壳进度以SSE推送给订阅者
+         * 每个app保留最近一次加壳的事件，订阅晚于开始时先补发已有事件
+         */
+        class PackProgressHub
+        {
+        public:
+            static constexpr size_t MAX_BACKLOG = 64;
+
+            PackProgressHub() = default;
+            PackProgressHub(const PackProgressHub& other) = delete;
+            PackProgressHub(PackProgressHub&& other) noexcept = delete;
+            PackProgressHub& operator=(const PackProgressHub& other) = delete;
+            PackProgressHub& operator=(PackProgressHub&& other) noexcept = delete;
+
+            /**
+             * 发布事件，done事件发出后关闭该app的所有订阅
+             * @param name 
+             * @param event 
+             */
+            void Publish(std::string_view name, const PackEvent& event);
+
+            /**
+             * 订阅某个app的加壳进度
+             * @param name 
+             * @param writer 
+             */
+            void Subscribe(std::string_view name, const hv::HttpResponseWriterPtr& writer);
+
+        private:
+            struct Channel
+            {
+                std::deque<std::string> backlog;
+                std::vector<hv::HttpResponseWriterPtr> subscribers;
+                bool done{true};
+            };
+
+            /**
+             * 去掉已断开的订阅，没有进行中的加壳也没有订阅者的app不再保留，调用时需持有锁
+             */
+            void PruneLocked();
+
+            std::mutex mutex_;
+            std::unordered_map<std::string, Channel> channels_;
+        };
+    }
+}
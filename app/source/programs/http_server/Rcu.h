@@ -0,0 +1,154 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        /**
+         * 基于epoch的读者登记，供Rcu回收旧快照
+         * 每个线程独占一个对齐到缓存行的槽位，读者只写自己的槽位
+         */
+        class RcuDomain
+        {
+        public:
+            static constexpr size_t CACHE_LINE_SIZE = 64;
+
+            static RcuDomain& Instance();
+
+            RcuDomain(const RcuDomain& other) = delete;
+            RcuDomain(RcuDomain&& other) noexcept = delete;
+            RcuDomain& operator=(const RcuDomain& other) = delete;
+            RcuDomain& operator=(RcuDomain&& other) noexcept = delete;
+
+            /**
+             * 读临界区，允许同一线程嵌套
+             */
+            class ReadGuard
+            {
+            public:
+                ReadGuard();
+                ~ReadGuard();
+                ReadGuard(const ReadGuard& other) = delete;
+                ReadGuard(ReadGuard&& other) noexcept = delete;
+                ReadGuard& operator=(const ReadGuard& other) = delete;
+                ReadGuard& operator=(ReadGuard&& other) noexcept = delete;
+            };
+
+            /**
+             * 推进全局epoch
+             * @return 推进后的epoch，在此之前摘下的快照以它为回收条件
+             */
+            uint64_t Advance();
+
+            /**
+             * 所有读者是否都已离开epoch之前开始的读临界区
+             * @param epoch 
+             * @return 
+             */
+            bool Quiescent(uint64_t epoch) const;
+
+        private:
+            struct alignas(CACHE_LINE_SIZE) ReaderSlot
+            {
+                // 进入读临界区时的全局epoch，0表示不在临界区
+                std::atomic_uint64_t epoch{0};
+                std::atomic_bool in_use{false};
+                // 只由所属线程访问
+                uint32_t depth{0};
+                ReaderSlot* next{nullptr};
+            };
+
+            struct LocalSlot;
+
+            RcuDomain() = default;
+            ~RcuDomain();
+
+            static ReaderSlot& CurrentSlot();
+            ReaderSlot* AcquireSlot();
+
+            alignas(CACHE_LINE_SIZE) std::atomic_uint64_t epoch_{1};
+            // 槽位只增不减，线程退出后归还复用
+            alignas(CACHE_LINE_SIZE) std::atomic<ReaderSlot*> slots_{nullptr};
+        };
+
+        /**
+         * 读多写少的数据，以不可变快照发布
+         * 读者不加锁也不写共享缓存行，写者复制当前快照、修改后原子替换，旧快照在所有读者离开后释放
+         */
+        template <typename T>
+        class Rcu
+        {
+        public:
+            explicit Rcu(T value = T{}): current_(new T(std::move(value)))
+            {
+            }
+
+            ~Rcu()
+            {
+                delete current_.load();
+                for (auto& retired : retired_)
+                {
+                    delete retired.second;
+                }
+            }
+
+            Rcu(const Rcu& other) = delete;
+            Rcu(Rcu&& other) noexcept = delete;
+            Rcu& operator=(const Rcu& other) = delete;
+            Rcu& operator=(Rcu&& other) noexcept = delete;
+
+            /**
+             * 在读临界区内访问当前快照，返回值不能引用快照内的数据
+             * @param reader 以const T&调用
+             * @return reader的返回值
+             */
+            template <typename F>
+            auto Read(F&& reader) const
+            {
+                RcuDomain::ReadGuard guard;
+                return std::forward<F>(reader)(*current_.load(std::memory_order_seq_cst));
+            }
+
+            /**
+             * 复制当前快照并修改，写者之间串行
+             * @param writer 以T&调用，返回false则放弃修改不发布
+             * @return 是否发布了新快照
+             */
+            template <typename F>
+            bool Update(F&& writer)
+            {
+                std::lock_guard lock(write_mutex_);
+                auto next = std::make_unique<T>(*current_.load(std::memory_order_relaxed));
+                if (!std::forward<F>(writer)(*next)) return false;
+                const T* prev = current_.exchange(next.release(), std::memory_order_seq_cst);
+                retired_.emplace_back(RcuDomain::Instance().Advance(), prev);
+                ReclaimLocked();
+                return true;
+            }
+
+        private:
+            void ReclaimLocked()
+            {
+                auto& domain = RcuDomain::Instance();
+                std::erase_if(retired_, [&domain](const auto& retired)
+                {
+                    if (!domain.Quiescent(retired.first)) return false;
+                    delete retired.second;
+                    return true;
+                });
+            }
+
+            std::atomic<const T*> current_;
+            std::mutex write_mutex_;
+            // 待回收的旧快照及其回收条件
+            std::vector<std::pair<uint64_t, const T*>> retired_;
+        };
+    }
+}
@@ -0,0 +1,196 @@
+﻿#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        /**
+         * 同一个app的另一套加壳配置，有自己的.vmp和加壳结果
+         */
+        struct AppProfile
+        {
+            std::string name;
+            std::string vmp_file_path;
+            std::string packed_app_path;
+        };
+
+        struct AppInfo
+        {
+            // std::filesystem::path vmp_file_path;
+            // std::filesystem::path packed_app_path;
+            // 默认配置
+            std::string vmp_file_path;
+            std::string packed_app_path;
+            // 其它加壳配置，共用同一个解压目录
+            std::vector<AppProfile> profiles;
+        };
+
+        /**
+         * 支持多套加壳配置之前的AppInfo，仅用于读取旧的注册表和日志
+         */
+        struct AppInfoV1
+        {
+            std::string vmp_file_path;
+            std::string packed_app_path;
+        };
+
+        struct RegistryEntry
+        {
+            std::string name;
+            AppInfo app_info;
+        };
+
+        /**
+         * 一页按名字排序的条目，发布后不再修改
+         */
+        struct RegistryPage
+        {
+            std::vector<RegistryEntry> entries;
+        };
+
+        struct AppListPage
+        {
+            std::vector<std::string> names;
+            // 还有后续条目时为最后一个名字，作为下次请求的cursor
+            std::string next_cursor;
+            uint64_t version;
+        };
+
+        /**
+         * 自某个版本以来名字的增删
+         */
+        struct AppListDelta
+        {
+            uint64_t version;
+            // 为true时版本太旧，added为完整列表，客户端应整体替换
+            bool full;
+            std::vector<std::string> added;
+            std::vector<std::string> removed;
+        };
+
+        struct RegistryChange
+        {
+            uint64_t version;
+            std::string name;
+            bool added;
+        };
+
+        /**
+         * 按名字排序、分页存储的注册表
+         * 页不可变，修改时只复制受影响的页，其余页在新旧版本间共享；每页的首个名字作为fence key用于二分查找
+         */
+        class RegistryIndex
+        {
+        public:
+            using PagePtr = std::shared_ptr<const RegistryPage>;
+
+            static constexpr size_t MAX_PAGE_ENTRIES = 128;
+            // 保留的增删记录数，更早的版本只能整体获取
+            static constexpr size_t MAX_CHANGES = 256;
+
+            RegistryIndex() = default;
+
+            /**
+             * 由已排序且互不重叠的页构造
+             * @param pages 
+             * @param version 保存时的版本
+             * @return 
+             */
+            static RegistryIndex FromPages(std::vector<PagePtr> pages, uint64_t version = 0);
+
+            const AppInfo* Find(std::string_view name) const;
+
+            bool Contains(std::string_view name) const
+            {
+                return Find(name) != nullptr;
+            }
+
+            /**
+             * 插入或覆盖，页满时对半拆分
+             * @param name 
+             * @param app_info 
+             */
+            void Put(std::string_view name, AppInfo app_info);
+
+            /**
+             * 删除，页空时移除该页
+             * @param name 
+             * @return 不存在则返回false
+             */
+            bool Erase(std::string_view name);
+
+            /**
+             * 列出名字在cursor之后（不含）且以prefix开头的条目，代价只与limit和页大小有关
+             * @param prefix 
+             * @param cursor 为空则从头开始
+             * @param limit 
+             * @return 
+             */
+            AppListPage List(std::string_view prefix, std::string_view cursor, size_t limit) const;
+
+            /**
+             * 自since版本以来名字的增删，since太旧时返回完整列表
+             * @param since 
+             * @return 
+             */
+            AppListDelta Delta(uint64_t since) const;
+
+            template <typename F>
+            void ForEach(F&& func) const
+            {
+                for (const auto& page : pages_)
+                {
+                    for (const auto& entry : page->entries)
+                    {
+                        func(entry);
+                    }
+                }
+            }
+
+            const std::vector<PagePtr>& Pages() const
+            {
+                return pages_;
+            }
+
+            size_t Size() const
+            {
+                return size_;
+            }
+
+            /**
+             * 每次Put、Erase都会递增，重启后由保存的版本加上日志回放恢复
+             * @return 
+             */
+            uint64_t Version() const
+            {
+                return version_;
+            }
+
+        private:
+            /**
+             * 可能包含name的页
+             * @param name 
+             * @return 
+             */
+            size_t PageIndex(std::string_view name) const;
+
+            void SetPage(size_t page_index, std::shared_ptr<RegistryPage> page);
+
+            void RecordChange(std::string_view name, bool added);
+
+            std::vector<PagePtr> pages_;
+            std::vector<std::string> fences_;
+            size_t size_{0};
+            uint64_t version_{0};
+            std::deque<RegistryChange> changes_;
+            // 此版本之后的增删都在changes_中
+            uint64_t changes_floor_{0};
+        };
+    }
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        /**
+         * 只追加的二进制日志，记录格式为[长度][crc32][数据]
+         * 追加只写内存，后台线程把一段时间内的记录合并写入并落盘（group commit）
+         */
+        class RegistryJournal
+        {
+        public:
+            static constexpr uint64_t DEFAULT_COMPACT_BYTES = 4ull << 20;
+            static constexpr auto GROUP_COMMIT_WINDOW = std::chrono::milliseconds(2);
+
+            /**
+             * @param journal_path 
+             * @param compact_bytes 日志超过该大小后建议压缩
+             */
+            explicit RegistryJournal(const std::filesystem::path& journal_path,
+                                     uint64_t compact_bytes = DEFAULT_COMPACT_BYTES);
+            ~RegistryJournal();
+            RegistryJournal(const RegistryJournal& other) = delete;
+            RegistryJournal(RegistryJournal&& other) noexcept = delete;
+            RegistryJournal& operator=(const RegistryJournal& other) = delete;
+            RegistryJournal& operator=(RegistryJournal&& other) noexcept = delete;
+
+            /**
+             * 按顺序回放日志中完整的记录，末尾写了一半或校验失败的部分会被截掉
+             * 需在第一次Append之前调用
+             * @param apply 
+             * @return 回放的记录数
+             */
+            size_t Replay(const std::function<void(std::span<const uint8_t> payload)>& apply);
+
+            /**
+             * 追加一条记录，只写入内存
+             * @param payload 
+             * @return 记录序号，用于WaitDurable
+             */
+            uint64_t Append(std::span<const uint8_t> payload);
+
+            /**
+             * 等待序号不大于seq的记录全部落盘
+             * @param seq 
+             * @return 写入或落盘失败则返回false
+             */
+            bool WaitDurable(uint64_t seq);
+
+            /**
+             * 日志是否已大到需要压缩，写入失败后也需要压缩来恢复
+             * @return 
+             */
+            bool NeedsCompaction() const;
+
+            /**
+             * 快照已包含所有记录并落盘后调用，清空日志
+             * 调用者需保证期间没有并发的Append
+             */
+            void Reset();
+
+        private:
+            void FlushLoop(std::stop_token stop_token);
+
+            std::filesystem::path journal_path_;
+            uint64_t compact_bytes_;
+            std::FILE* file_{nullptr};
+            // 串行化文件写入与Reset
+            std::mutex io_mutex_;
+            mutable std::mutex mutex_;
+            std::condition_variable_any flush_cv_;
+            std::condition_variable durable_cv_;
+            std::vector<uint8_t> pending_;
+            uint64_t next_seq_{1};
+            uint64_t durable_seq_{0};
+            uint64_t file_bytes_{0};
+            bool failed_{false};
+            std::jthread flusher_;
+        };
+    }
+}
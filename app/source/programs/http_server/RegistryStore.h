@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+#include "RegistryIndex.h"
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        /**
+         * 注册表的分页存储
+         * 页追加写入registry.<代>.pages，页表整体写入registry.index（临时文件加重命名）
+         * 保存时只写入上次保存后新产生的页，废弃的页过多时整体重写到下一代文件
+         * 不是线程安全的，调用者需串行化
+         */
+        class RegistryStore
+        {
+        public:
+            explicit RegistryStore(const std::filesystem::path& dir);
+            ~RegistryStore();
+            RegistryStore(const RegistryStore& other) = delete;
+            RegistryStore(RegistryStore&& other) noexcept = delete;
+            RegistryStore& operator=(const RegistryStore& other) = delete;
+            RegistryStore& operator=(RegistryStore&& other) noexcept = delete;
+
+            bool Exists() const;
+
+            /**
+             * 内存映射页文件并解码所有页
+             * @return 
+             */
+            std::expected<RegistryIndex, std::string> Load();
+
+            /**
+             * 保存索引，未变化的页复用已写入的位置
+             * @param index 
+             * @return 
+             */
+            bool Save(const RegistryIndex& index);
+
+            /**
+             * 载入的是旧格式，需要保存一次转换为当前格式
+             * @return 
+             */
+            bool UpgradePending() const
+            {
+                return upgrade_pending_;
+            }
+
+        private:
+            struct PageRef
+            {
+                uint64_t offset;
+                uint64_t size;
+                uint32_t crc;
+            };
+
+            struct PersistedPage
+            {
+                // 持有页，保证指针在下次保存前不会被复用
+                RegistryIndex::PagePtr page;
+                PageRef ref;
+            };
+
+            std::filesystem::path PagesPath(uint64_t generation) const;
+            bool OpenPagesFile(const char* mode);
+
+            std::filesystem::path dir_, index_path_;
+            uint64_t generation_{0};
+            std::FILE* pages_file_{nullptr};
+            uint64_t pages_bytes_{0};
+            std::unordered_map<const RegistryPage*, PersistedPage> persisted_;
+            bool upgrade_pending_{false};
+        };
+    }
+}
@@ -2,6 +2,8 @@
 #include <string_view>
 #include <log4cplus/logger.h>
 
+#include "AdmissionControl.h"
+
 namespace vmpx
 {
     constexpr std::string_view DEFAULT_BASE_URL = "/api/v1";
@@ -16,9 +18,15 @@ namespace vmpx
      * @param port 
      * @param base_url 
      * @param vmp_console_app_path 如果为empty则不启用App打包服务 
+     * @param max_concurrent_packs 同时运行的加壳进程数上限，0表示CPU核数
+     * @param pack_timeout_seconds 单次加壳的时长上限，0表示使用默认值
+     * @param admission_options 按客户端的准入控制，默认不限制
      */
     void StartServer(std::string_view ip, uint16_t port,
                      std::string_view vmp_console_app_path = "",
+                     size_t max_concurrent_packs = 0,
+                     uint32_t pack_timeout_seconds = 0,
+                     const admission::AdmissionOptions& admission_options = {},
                      std::string_view base_url = DEFAULT_BASE_URL) noexcept;
 
     void StopServer() noexcept;
@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+
+namespace vmpx
+{
+    namespace stream
+    {
+        /**
+         * 在IO线程之外运行耗时的流式响应，同时运行的任务数有上限
+         * 满了直接拒绝而不排队，由调用者返回503
+         */
+        class StreamTaskPool
+        {
+        public:
+            using Task = std::function<void(std::stop_token stop_token)>;
+
+            explicit StreamTaskPool(size_t max_tasks);
+            /**
+             * 等同于Stop
+             */
+            ~StreamTaskPool();
+            StreamTaskPool(const StreamTaskPool& other) = delete;
+            StreamTaskPool(StreamTaskPool&& other) noexcept = delete;
+            StreamTaskPool& operator=(const StreamTaskPool& other) = delete;
+            StreamTaskPool& operator=(StreamTaskPool&& other) noexcept = delete;
+
+            /**
+             * 在新线程上运行任务
+             * @param task 需定期检查stop_token，停止时尽快返回
+             * @return 已达上限或已停止时返回false，任务不会运行
+             */
+            bool TryRun(Task task);
+
+            /**
+             * 请求所有任务停止并等待它们返回，之后不再接受新任务
+             */
+            void Stop();
+
+            size_t Running() const;
+
+        private:
+            struct Slot
+            {
+                std::jthread thread;
+                std::atomic_bool done{false};
+            };
+
+            size_t max_tasks_;
+            mutable std::mutex mutex_;
+            bool stopped_{false};
+            std::list<Slot> slots_;
+        };
+    }
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vmpx
+{
+    namespace app_pack
+    {
+        /**
+         * 边生成边输出的zip，不需要临时文件
+         * 文件以存储方式写入不再压缩，超过4GB的文件或偏移使用zip64
+         */
+        class ZipStreamWriter
+        {
+        public:
+            /**
+             * 接收依次输出的数据，返回false表示无法继续输出
+             */
+            using Sink = std::function<bool(std::string_view data)>;
+
+            explicit ZipStreamWriter(Sink sink);
+            ZipStreamWriter(const ZipStreamWriter& other) = delete;
+            ZipStreamWriter(ZipStreamWriter&& other) noexcept = delete;
+            ZipStreamWriter& operator=(const ZipStreamWriter& other) = delete;
+            ZipStreamWriter& operator=(ZipStreamWriter&& other) noexcept = delete;
+
+            /**
+             * 先读一遍计算CRC，再分块输出文件内容，内存占用与文件大小无关
+             * @param name zip内的路径（UTF-8）
+             * @param path 
+             * @return 文件读取失败、两次读取的大小不一致或sink返回false时为false
+             */
+            bool AddFile(std::string_view name, const std::filesystem::path& path);
+
+            bool AddData(std::string_view name, std::string_view data);
+
+            /**
+             * 输出中央目录，之后不能再添加文件
+             * @return 
+             */
+            bool Finish();
+
+        private:
+            struct Entry
+            {
+                std::string name;
+                uint32_t crc32;
+                uint64_t size;
+                uint64_t offset;
+            };
+
+            bool WriteLocalHeader(const Entry& entry);
+            bool Emit(std::string_view data);
+
+            Sink sink_;
+            uint64_t offset_{0};
+            uint16_t dos_time_, dos_date_;
+            std::vector<Entry> entries_;
+        };
+    }
+}
@@ -68,6 +68,9 @@ namespace
         std::string ip;
         uint16_t port;
         std::string vmp_console_app_path;
+        size_t max_concurrent_packs;
+        uint32_t pack_timeout_seconds;
+        vmpx::admission::AdmissionOptions admission_options;
     };
 
     Arguments ParseArguments(int argc, char* argv[])
@@ -80,11 +83,33 @@ namespace
                        .help("port number,default 80").scan<'i', uint16_t>();
         argument_parser->add_argument("vmp_console_app_path").default_value("")
                        .help("vmp_console_app_path: VMProtect_Con.exe");
+        argument_parser->add_argument("--max-concurrent-packs").default_value(static_cast<size_t>(0))
+                       .help("max number of VMProtect_Con processes running at once,default 0(cpu cores)")
+                       .scan<'u', size_t>();
+        argument_parser->add_argument("--pack-timeout").default_value(static_cast<uint32_t>(0))
+                       .help("seconds before a running pack is killed,default 0(30 minutes)")
+                       .scan<'u', uint32_t>();
+        argument_parser->add_argument("--rate-limit").default_value(static_cast<uint32_t>(0))
+                       .help("tokens per second refilled for each client, a cheap request costs 1,default 0(unlimited)")
+                       .scan<'u', uint32_t>();
+        argument_parser->add_argument("--rate-burst").default_value(static_cast<uint32_t>(0))
+                       .help("token bucket size of each client,default 0(2x rate limit)")
+                       .scan<'u', uint32_t>();
+        argument_parser->add_argument("--rate-limit-header").default_value("")
+                       .help("identify clients by this header(e.g. X-Api-Key) instead of ip,"
+                           " only when a gateway in front validates it");
         argument_parser->parse_args(argc, argv);
         Arguments arguments{
             .ip = argument_parser->get<std::string>("ip"),
             .port = argument_parser->get<uint16_t>("port"),
-            .vmp_console_app_path = argument_parser->get<std::string>("vmp_console_app_path")
+            .vmp_console_app_path = argument_parser->get<std::string>("vmp_console_app_path"),
+            .max_concurrent_packs = argument_parser->get<size_t>("--max-concurrent-packs"),
+            .pack_timeout_seconds = argument_parser->get<uint32_t>("--pack-timeout"),
+            .admission_options = {
+                .rate = argument_parser->get<uint32_t>("--rate-limit"),
+                .burst = argument_parser->get<uint32_t>("--rate-burst"),
+                .client_header = argument_parser->get<std::string>("--rate-limit-header"),
+            }
         };
         return arguments;
     }
@@ -103,7 +128,9 @@ int main(int argc, char* argv[])
         auto arguments = ParseArguments(argc, argv);
         vmpx::InitNetwork();
         vmpx::StartServer(arguments.ip, arguments.port,
-                          arguments.vmp_console_app_path);
+                          arguments.vmp_console_app_path,
+                          arguments.max_concurrent_packs, arguments.pack_timeout_seconds,
+                          arguments.admission_options);
     }
     catch (std::runtime_error& e)
     {
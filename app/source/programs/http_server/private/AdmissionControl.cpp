@@ -0,0 +1,132 @@
+﻿#include "AdmissionControl.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+
+#include "VMPX.h"
+
+namespace
+{
+    // 生成2048位密钥的代价，其它长度按三次方换算
+    constexpr uint64_t KEYGEN_COST_2048 = 20;
+    constexpr uint64_t DEFAULT_KEY_SIZE = 2048;
+
+    constexpr std::array<std::pair<std::string_view, uint32_t>, 8> ROUTE_COSTS{
+        {
+            {"/app/add", 5},
+            {"/app/update", 5},
+            {"/app/pack", 10},
+            {"/app/pack_batch", 10},
+            {"/app/pack_profiles", 10},
+            {"/issue/submit", 10},
+            {"/gen_serial_number", 1},
+            // 一次请求可能生成大量序列号，但每个流只占一个线程
+            {"/gen_serial_numbers", 20},
+        }
+    };
+
+    int64_t NowNs() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t PeekKeySize(std::string_view body) noexcept
+    {
+        constexpr std::string_view field = R"("key_size")";
+        auto pos = body.find(field);
+        if (pos == std::string_view::npos) return DEFAULT_KEY_SIZE;
+        pos += field.size();
+        while (pos < body.size() && (std::isspace(static_cast<unsigned char>(body[pos])) || body[pos] == ':')) ++pos;
+        uint64_t key_size = 0;
+        auto [ptr, ec] = std::from_chars(body.data() + pos, body.data() + body.size(), key_size);
+        // 解析不了的按最大长度计，1e4、8.192e3这类浮点数也会被JSON库转换为整数
+        if (ec != std::errc{}) return vmpx::MAX_KEY_SIZE;
+        if (ptr != body.data() + body.size() && (*ptr == '.' || *ptr == 'e' || *ptr == 'E'))
+            return vmpx::MAX_KEY_SIZE;
+        return std::clamp<uint64_t>(key_size, 1, vmpx::MAX_KEY_SIZE);
+    }
+}
+
+vmpx::admission::AdmissionController::AdmissionController(const AdmissionOptions& options):
+    options_(options), emission_interval_ns_(0)
+{
+    if (!Enabled()) return;
+    if (options_.burst == 0) options_.burst = options_.rate * 2;
+    emission_interval_ns_ = 1'000'000'000 / options_.rate;
+    slots_ = std::make_unique<Slot[]>(TABLE_SIZE);
+}
+
+vmpx::admission::AdmissionDecision vmpx::admission::AdmissionController::TryAcquire(
+    std::string_view client, uint32_t cost) noexcept
+{
+    if (!Enabled()) return {true, {}};
+    auto now = NowNs();
+    auto key = std::hash<std::string_view>{}(client) | 1;
+    auto& slot = FindSlot(key, now);
+    auto increment = static_cast<int64_t>(cost) * emission_interval_ns_;
+    auto tolerance = static_cast<int64_t>(options_.burst) * emission_interval_ns_;
+    auto tat = slot.tat.load(std::memory_order_relaxed);
+    while (true)
+    {
+        auto new_tat = std::max(tat, now) + increment;
+        // 代价超过桶容量的请求只在桶满时通过，并按全部代价扣除，欠下的令牌由之后的请求等待补回
+        if (tat > now && new_tat - now > tolerance)
+        {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            auto wait = std::chrono::nanoseconds(std::min(new_tat - now - tolerance, tat - now));
+            return {false, std::chrono::ceil<std::chrono::milliseconds>(wait)};
+        }
+        if (slot.tat.compare_exchange_weak(tat, new_tat, std::memory_order_relaxed)) break;
+    }
+    admitted_.fetch_add(1, std::memory_order_relaxed);
+    return {true, {}};
+}
+
+vmpx::admission::AdmissionStats vmpx::admission::AdmissionController::Stats() const noexcept
+{
+    return AdmissionStats{
+        .admitted = admitted_.load(std::memory_order_relaxed),
+        .rejected = rejected_.load(std::memory_order_relaxed),
+        .shared = shared_.load(std::memory_order_relaxed),
+    };
+}
+
+vmpx::admission::AdmissionController::Slot& vmpx::admission::AdmissionController::FindSlot(
+    uint64_t key, int64_t now) noexcept
+{
+    auto first = static_cast<size_t>(key % TABLE_SIZE);
+    for (size_t probe = 0; probe < MAX_PROBES; ++probe)
+    {
+        auto& slot = slots_[(first + probe) % TABLE_SIZE];
+        auto slot_key = slot.key.load(std::memory_order_relaxed);
+        if (slot_key == key) return slot;
+        // 空闲或桶已满的槽位，被回收的客户端下次请求时桶本来就是满的，回收不改变结果
+        if (slot_key == 0 || slot.tat.load(std::memory_order_relaxed) <= now)
+        {
+            if (slot.key.compare_exchange_strong(slot_key, key, std::memory_order_relaxed)) return slot;
+            if (slot_key == key) return slot;
+        }
+    }
+    // 探测范围内都被占用，与第一个槽位的客户端共用桶，只会更严格
+    shared_.fetch_add(1, std::memory_order_relaxed);
+    return slots_[first];
+}
+
+uint32_t vmpx::admission::RequestCost(std::string_view path, std::string_view body) noexcept
+{
+    if (path.ends_with("/gen_random_product_info"))
+    {
+        auto key_size = PeekKeySize(body);
+        auto cost = KEYGEN_COST_2048 * key_size * key_size * key_size / (DEFAULT_KEY_SIZE * DEFAULT_KEY_SIZE *
+            DEFAULT_KEY_SIZE);
+        return static_cast<uint32_t>(std::clamp<uint64_t>(cost, 1, UINT32_MAX));
+    }
+    for (const auto& [route, cost] : ROUTE_COSTS)
+    {
+        if (path.ends_with(route)) return cost;
+    }
+    return 1;
+}
@@ -0,0 +1,141 @@
+﻿#include "AppManifest.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <format>
+
+#include <ylt/struct_pack.hpp>
+
+#include "Utils.h"
+
+namespace
+{
+    constexpr uint32_t MANIFEST_VERSION = 1;
+
+    struct ManifestFile
+    {
+        uint32_t version;
+        vmpx::app_pack::AppManifest manifest;
+    };
+
+    bool EndsWithNoCase(std::string_view str, std::string_view suffix)
+    {
+        if (str.size() < suffix.size()) return false;
+        return std::ranges::equal(str.substr(str.size() - suffix.size()), suffix, [](char a, char b)
+        {
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        });
+    }
+}
+
+vmpx::app_pack::FileKind vmpx::app_pack::ClassifyFile(std::string_view path)
+{
+    if (EndsWithNoCase(path, ".vmp")) return FileKind::VMP_PROJECT;
+    if (EndsWithNoCase(path, ".exe")) return FileKind::EXECUTABLE;
+    static constexpr std::array<std::string_view, 3> library_exts{".dll", ".so", ".dylib"};
+    if (std::ranges::any_of(library_exts, [path](std::string_view ext) { return EndsWithNoCase(path, ext); }))
+        return FileKind::LIBRARY;
+    return FileKind::OTHER;
+}
+
+std::string_view vmpx::app_pack::FileKindName(FileKind kind)
+{
+    switch (kind)
+    {
+    case FileKind::VMP_PROJECT:
+        return "vmp";
+    case FileKind::EXECUTABLE:
+        return "executable";
+    case FileKind::LIBRARY:
+        return "library";
+    default:
+        return "other";
+    }
+}
+
+const vmpx::app_pack::ManifestEntry* vmpx::app_pack::AppManifest::Find(std::string_view path) const
+{
+    auto it = std::ranges::lower_bound(files, path, {}, &ManifestEntry::path);
+    if (it == files.end() || it->path != path) return nullptr;
+    return &*it;
+}
+
+std::vector<const vmpx::app_pack::ManifestEntry*> vmpx::app_pack::AppManifest::FilesOfKind(FileKind kind) const
+{
+    std::vector<const ManifestEntry*> result;
+    for (const auto& entry : files)
+    {
+        if (entry.kind == kind) result.push_back(&entry);
+    }
+    return result;
+}
+
+uint64_t vmpx::app_pack::AppManifest::TotalSize() const
+{
+    uint64_t bytes = 0;
+    for (const auto& entry : files)
+    {
+        bytes += entry.size;
+    }
+    return bytes;
+}
+
+std::filesystem::path vmpx::app_pack::ManifestFilePath(const std::filesystem::path& root_dir, std::string_view path)
+{
+#if defined(_WIN32)
+    return root_dir / U8ToWString(path);
+#else
+    return root_dir / path;
+#endif
+}
+
+vmpx::app_pack::ManifestStore::ManifestStore(const std::filesystem::path& dir): dir_(dir)
+{
+    if (!std::filesystem::exists(dir_))std::filesystem::create_directories(dir_);
+}
+
+std::expected<vmpx::app_pack::ManifestStore::ManifestPtr, std::string> vmpx::app_pack::ManifestStore::Load(
+    std::string_view name)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (auto it = cache_.find(std::string{name}); it != cache_.end()) return it->second;
+    }
+    auto path = ManifestPath(name);
+    auto data = ReadFile(path);
+    if (!data) return std::unexpected{std::format("unable to read manifest:{}", path.string())};
+    auto file = struct_pack::deserialize<ManifestFile>(reinterpret_cast<const char*>(data->data()), data->size());
+    if (!file || file->version != MANIFEST_VERSION)
+        return std::unexpected{std::format("invalid manifest:{}", path.string())};
+    auto manifest = std::make_shared<const AppManifest>(std::move(file->manifest));
+    std::lock_guard lock(mutex_);
+    cache_.insert_or_assign(std::string{name}, manifest);
+    return manifest;
+}
+
+bool vmpx::app_pack::ManifestStore::Save(std::string_view name, AppManifest manifest)
+{
+    std::ranges::sort(manifest.files, {}, &ManifestEntry::path);
+    ManifestFile file{MANIFEST_VERSION, std::move(manifest)};
+    auto payload = struct_pack::serialize(file);
+    if (!WriteFileAtomic(std::span(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()),
+                         ManifestPath(name)))
+        return false;
+    std::lock_guard lock(mutex_);
+    cache_.insert_or_assign(std::string{name}, std::make_shared<const AppManifest>(std::move(file.manifest)));
+    return true;
+}
+
+void vmpx::app_pack::ManifestStore::Remove(std::string_view name)
+{
+    std::error_code ec;
+    std::filesystem::remove(ManifestPath(name), ec);
+    std::lock_guard lock(mutex_);
+    cache_.erase(std::string{name});
+}
+
+std::filesystem::path vmpx::app_pack::ManifestStore::ManifestPath(std::string_view name) const
+{
+    return ManifestFilePath(dir_, std::format("{}.manifest", name));
+}
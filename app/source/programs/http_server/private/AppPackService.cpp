@@ -1,23 +1,88 @@
 ﻿#include "AppPackService.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <pugixml.hpp>
 #include <ranges>
-#include <shared_mutex>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
 
 #include <zip.h>
+#include <ylt/struct_pack.hpp>
 #include <ylt/struct_yaml/yaml_reader.h>
-#include <ylt/struct_yaml/yaml_writer.h>
 #include <boost/asio.hpp>
 #include <tobiaslocker_base64/base64.hpp>
 
+#include "BlobStore.h"
+#include "PackCache.h"
+#include "PackExecutor.h"
+#include "Rcu.h"
+#include "RegistryIndex.h"
+#include "RegistryJournal.h"
+#include "RegistryStore.h"
+#include "Trace.h"
 #include "VMPX.h"
 #include "Utils.h"
 
-bool vmpx::app_pack::UnzipToDir(const std::filesystem::path& zip_path, const std::filesystem::path& output_dir)
+namespace
+{
+    /**
+     * 客户端提交的路径和zip中的文件名只能是解压目录内的相对路径
+     * @param path 
+     * @return 
+     */
+    bool IsSafeRelativePath(std::string_view path)
+    {
+        if (path.empty() || path.starts_with('/') || path.ends_with('/')) return false;
+        if (path.find_first_of("\\:") != std::string_view::npos) return false;
+        for (auto part : std::views::split(path, '/'))
+        {
+            std::string_view component(part.begin(), part.end());
+            if (component.empty() || component == "." || component == "..") return false;
+        }
+        return true;
+    }
+
+    /**
+     * 只读取zip的目录，列出所有文件名，不解压
+     * @param zip_path 
+     * @return 目录项除外
+     */
+    std::expected<std::vector<std::string>, std::string> ListZipFiles(const std::filesystem::path& zip_path)
+    {
+        int err = 0;
+        zip* za = zip_open(zip_path.string().c_str(), ZIP_RDONLY, &err);
+        if (!za) return std::unexpected{"unable to open zip file"};
+        std::vector<std::string> names;
+        zip_int64_t num_entries = zip_get_num_entries(za, 0);
+        for (zip_int64_t i = 0; i < num_entries; ++i)
+        {
+            const char* entry_name = zip_get_name(za, i, 0);
+            if (!entry_name)
+            {
+                zip_close(za);
+                return std::unexpected{"unable to read zip entry name"};
+            }
+            if (!std::string_view(entry_name).ends_with('/')) names.emplace_back(entry_name);
+        }
+        zip_close(za);
+        return names;
+    }
+}
+
+bool vmpx::app_pack::UnzipToDir(const std::filesystem::path& zip_path, const std::filesystem::path& output_dir,
+                                BlobStore* blob_store, AppManifest* manifest)
 {
     auto zip_path_str = zip_path.string();
     auto output_dir_str = output_dir.string();
@@ -31,33 +96,386 @@ bool vmpx::app_pack::UnzipToDir(const std::filesystem::path& zip_path, const std
         struct zip_stat st;
         zip_stat_init(&st);
         zip_stat_index(za, i, 0, &st);
+        // 目录项
+        if (std::string_view(st.name).ends_with('/')) continue;
+        // 文件名带..或绝对路径时会写到解压目录之外
+        if (!IsSafeRelativePath(st.name))
+        {
+            zip_close(za);
+            return false;
+        }
 
         zip_file* zf = zip_fopen_index(za, i, 0);
-        if (!zf) continue;
-
-        std::vector<char> buffer(st.size);
-        zip_fread(zf, buffer.data(), st.size);
-#if defined(_WIN32)
-        auto file_path = std::filesystem::path(output_dir_str) / U8ToWString(st.name);
-#else
-        auto file_path = std::filesystem::path(output_dir_str) / st.name;
-#endif
-        std::ofstream out(file_path, std::ios::binary);
-        out.write(buffer.data(), static_cast<std::streamsize>(st.size));
+        if (!zf)
+        {
+            zip_close(za);
+            return false;
+        }
+
+        std::vector<uint8_t> buffer(st.size);
+        auto num_read = zip_fread(zf, buffer.data(), st.size);
         zip_fclose(zf);
+        if (num_read < 0 || static_cast<zip_uint64_t>(num_read) != st.size)
+        {
+            zip_close(za);
+            return false;
+        }
+        auto file_path = ManifestFilePath(output_dir_str, st.name);
+        ManifestEntry entry{
+            .path = st.name,
+            .size = buffer.size(),
+            // zip里已经记录了CRC，libzip读取时会校验
+            .crc32 = (st.valid & ZIP_STAT_CRC) ? st.crc : Crc32(buffer),
+            .kind = ClassifyFile(st.name),
+        };
+        if (blob_store)
+        {
+            auto hash = blob_store->Emplace(buffer, file_path);
+            if (!hash)
+            {
+                zip_close(za);
+                return false;
+            }
+            entry.sha256 = std::move(hash.value());
+        }
+        else if (!WriteFile(buffer, file_path))
+        {
+            zip_close(za);
+            return false;
+        }
+        if (manifest) manifest->files.push_back(std::move(entry));
     }
 
     return zip_close(za) == 0;
 }
 
+namespace
+{
+    enum class RegistryOp : uint8_t
+    {
+        PUT,
+        ERASE
+    };
+
+    // 注册表日志中的一条修改
+    struct RegistryRecord
+    {
+        RegistryOp op;
+        std::string name;
+        vmpx::app_pack::AppInfo app_info;
+    };
+
+    // 支持多套加壳配置之前的日志记录
+    struct RegistryRecordV1
+    {
+        RegistryOp op;
+        std::string name;
+        vmpx::app_pack::AppInfoV1 app_info;
+    };
+
+    // 默认配置即AppInfo自身的vmp_file_path和packed_app_path
+    constexpr std::string_view DEFAULT_PROFILE = "default";
+
+    bool IsDefaultProfile(std::string_view profile)
+    {
+        return profile.empty() || profile == DEFAULT_PROFILE;
+    }
+
+    std::optional<vmpx::app_pack::AppProfile> FindProfile(const vmpx::app_pack::AppInfo& app_info,
+                                                          std::string_view profile)
+    {
+        if (IsDefaultProfile(profile))
+            return vmpx::app_pack::AppProfile{
+                std::string{DEFAULT_PROFILE}, app_info.vmp_file_path, app_info.packed_app_path
+            };
+        auto it = std::ranges::find(app_info.profiles, profile, &vmpx::app_pack::AppProfile::name);
+        if (it == app_info.profiles.end()) return std::nullopt;
+        return *it;
+    }
+
+    /**
+     * 默认配置在前，其余按添加时的顺序
+     * @param app_info 
+     * @return 
+     */
+    std::vector<vmpx::app_pack::AppProfile> AllProfiles(const vmpx::app_pack::AppInfo& app_info)
+    {
+        std::vector<vmpx::app_pack::AppProfile> profiles;
+        profiles.reserve(app_info.profiles.size() + 1);
+        profiles.push_back(FindProfile(app_info, DEFAULT_PROFILE).value());
+        profiles.insert(profiles.end(), app_info.profiles.begin(), app_info.profiles.end());
+        return profiles;
+    }
+
+    void SetPackedAppPath(vmpx::app_pack::AppInfo& app_info, std::string_view profile, std::string packed_app_path)
+    {
+        if (IsDefaultProfile(profile))
+        {
+            app_info.packed_app_path = std::move(packed_app_path);
+            return;
+        }
+        auto it = std::ranges::find(app_info.profiles, profile, &vmpx::app_pack::AppProfile::name);
+        if (it != app_info.profiles.end()) it->packed_app_path = std::move(packed_app_path);
+    }
+
+    constexpr size_t MAX_UPDATE_SESSIONS = 64;
+    // 大工程的DOM可能有几MB，只缓存最近编辑过的一部分
+    constexpr size_t MAX_CACHED_PROJECTS = 32;
+    constexpr auto UPDATE_SESSION_TTL = std::chrono::hours(1);
+
+    constexpr std::string_view LICENSE_MANAGER_TAG = "<LicenseManager";
+
+    /**
+     * 流式扫描.vmp文件，只截取LicenseManager的开始标签交给pugixml解析，不为整个工程建立DOM
+     * @param vmp_file_path 
+     * @return 
+     */
+    std::expected<std::string, std::string> ScanLicenseManagerTag(const std::filesystem::path& vmp_file_path)
+    {
+        std::ifstream ifs(vmp_file_path, std::ios::binary);
+        if (!ifs.is_open()) return std::unexpected{"unable to open vmp file"};
+        std::array<char, 64 * 1024> buffer{};
+        // 上一块末尾保留的部分，处理标签名跨块的情况
+        std::string window;
+        // 找到标签时所在的窗口内容，从这里开始截取
+        std::string pending;
+        std::string tag;
+        bool in_tag = false;
+        char quote = '\0';
+        while (ifs)
+        {
+            ifs.read(buffer.data(), buffer.size());
+            std::string_view chunk(buffer.data(), static_cast<size_t>(ifs.gcount()));
+            if (chunk.empty()) break;
+            size_t pos = 0;
+            if (!in_tag)
+            {
+                window.append(chunk);
+                // 标签名后必须是空白、'/'或'>'，排除同前缀的其它元素
+                size_t search_pos = 0;
+                while (true)
+                {
+                    auto found = window.find(LICENSE_MANAGER_TAG, search_pos);
+                    if (found == std::string::npos || found + LICENSE_MANAGER_TAG.size() >= window.size())
+                    {
+                        if (found == std::string::npos)
+                            window.erase(0, window.size() - std::min(window.size(), LICENSE_MANAGER_TAG.size()));
+                        else
+                            window.erase(0, found);
+                        break;
+                    }
+                    char next = window[found + LICENSE_MANAGER_TAG.size()];
+                    if (std::isspace(static_cast<unsigned char>(next)) || next == '/' || next == '>')
+                    {
+                        in_tag = true;
+                        window.erase(0, found);
+                        break;
+                    }
+                    search_pos = found + 1;
+                }
+                if (!in_tag) continue;
+                tag.reserve(4096);
+                window.swap(pending);
+                chunk = pending;
+            }
+            for (; pos < chunk.size(); ++pos)
+            {
+                char c = chunk[pos];
+                tag.push_back(c);
+                if (quote)
+                {
+                    if (c == quote) quote = '\0';
+                }
+                else if (c == '"' || c == '\'')
+                {
+                    quote = c;
+                }
+                else if (c == '>')
+                {
+                    // 只需要属性，统一改为自闭合标签
+                    if (!tag.ends_with("/>")) tag.insert(tag.size() - 1, "/");
+                    return tag;
+                }
+            }
+        }
+        return std::unexpected{"unable to find Document.LicenseManager node"};
+    }
+
+    std::expected<vmpx::ProductInfo, std::string> ReadProductInfo(const std::filesystem::path& vmp_file_path)
+    {
+        using namespace pugi;
+        auto tag = ScanLicenseManagerTag(vmp_file_path);
+        if (!tag)
+            return std::unexpected{std::format("unable to parse vmp file:{},{}", vmp_file_path.string(), tag.error())};
+        xml_document doc;
+        auto load_result = doc.load_buffer(tag->data(), tag->size());
+        if (!load_result)
+            return std::unexpected{
+                std::format("unable to parse vmp file:{},{}",
+                            vmp_file_path.string(), load_result.description())
+            };
+        auto license_manager_node = doc.child("LicenseManager");
+        auto product_code = license_manager_node.attribute("ProductCode").as_string();
+        auto algorithm = license_manager_node.attribute("Algorithm").as_string();
+        auto bits = license_manager_node.attribute("Bits").as_uint();
+        auto public_exponent = license_manager_node.attribute("PublicExp").as_string();
+        auto private_exponent = license_manager_node.attribute("PrivateExp").as_string();
+        auto modulus = license_manager_node.attribute("Modulus").as_string();
+        auto B642Vec = [](std::string_view data) -> std::pmr::vector<uint8_t>
+        {
+            auto bytes = base64::decode_into<std::vector<uint8_t>>(data.begin(), data.end());
+            return {bytes.begin(), bytes.end()};
+        };
+        return vmpx::ProductInfo{
+            .key_size = (bits),
+            .modulus = B642Vec(modulus),
+            .public_exponent = B642Vec(public_exponent),
+            .private_exponent = B642Vec(private_exponent),
+            .product_code = B642Vec(product_code),
+        };
+    }
+}
+
 struct vmpx::app_pack::AppPackService::Impl
 {
-    std::shared_mutex mutex;
+    // 单个app上的耗时操作（解压、加壳、删除）互斥，不同app之间互不影响
+    struct AppSlot
+    {
+        std::mutex mutex;
+        // 正在执行的加壳任务，用于取消；不同加壳配置可以同时加壳
+        std::mutex pack_jobs_mutex;
+        std::unordered_set<uint64_t> pack_job_ids;
+    };
+
+    Impl(const std::filesystem::path& data_dir, const std::filesystem::path& vmp_console_app_path,
+         size_t max_concurrent_packs, std::chrono::milliseconds pack_timeout):
+        journal(data_dir / "registry.journal"), registry_store(data_dir), manifest_store(data_dir / "manifests"),
+        blob_store(data_dir / "blobs"),
+        pack_cache(data_dir / "pack_cache", vmp_console_app_path),
+        pack_executor(max_concurrent_packs, pack_timeout)
+    {
+    }
+
+    // 解析后的ProductInfo，.vmp文件的修改时间或大小变化即失效
+    struct CachedProductInfo
+    {
+        std::string vmp_file_path;
+        std::filesystem::file_time_type last_write_time;
+        uintmax_t file_size;
+        ProductInfo product_info;
+    };
+
+    // 增量更新会话，BeginUpdate创建，ApplyUpdate消费
+    struct UpdateSession
+    {
+        std::string name;
+        // 开始时的清单，应用时已不是它说明期间app被修改过
+        ManifestStore::ManifestPtr base_manifest;
+        // 路径 -> 客户端的SHA256
+        std::unordered_map<std::string, std::string> changed;
+        std::vector<std::string> removed;
+        std::chrono::steady_clock::time_point created;
+    };
+
+    // 解析后的.vmp工程DOM，只读共享，修改时替换为新的DOM
+    struct CachedProject
+    {
+        std::string vmp_file_path;
+        std::filesystem::file_time_type last_write_time;
+        uintmax_t file_size;
+        std::shared_ptr<const pugi::xml_document> doc;
+    };
+
+    std::expected<std::shared_ptr<const pugi::xml_document>, std::string> LoadProject(
+        std::string_view name, const std::string& vmp_file_path)
+    {
+        std::error_code ec;
+        auto last_write_time = std::filesystem::last_write_time(vmp_file_path, ec);
+        auto file_size = ec ? 0 : std::filesystem::file_size(vmp_file_path, ec);
+        if (ec) return std::unexpected{std::format("unable to stat vmp file:{},{}", vmp_file_path, ec.message())};
+        {
+            std::lock_guard lock(projects_mutex);
+            if (auto app_it = projects.find(std::string{name}); app_it != projects.end())
+            {
+                auto it = app_it->second.find(vmp_file_path);
+                if (it != app_it->second.end() && it->second.last_write_time == last_write_time &&
+                    it->second.file_size == file_size)
+                    return it->second.doc;
+            }
+        }
+        auto doc = std::make_shared<pugi::xml_document>();
+        auto load_result = doc->load_file(std::filesystem::path{vmp_file_path}.c_str(),
+                                          pugi::parse_default | pugi::parse_declaration);
+        if (!load_result)
+            return std::unexpected{
+                std::format("unable to parse vmp file:{},{}", vmp_file_path, load_result.description())
+            };
+        CacheProject(name, CachedProject{vmp_file_path, last_write_time, file_size, doc});
+        return doc;
+    }
+
+    void CacheProject(std::string_view name, CachedProject project)
+    {
+        std::lock_guard lock(projects_mutex);
+        if (projects.size() >= MAX_CACHED_PROJECTS && !projects.contains(std::string{name}))
+            projects.erase(projects.begin());
+        auto vmp_file_path = project.vmp_file_path;
+        projects[std::string{name}].insert_or_assign(std::move(vmp_file_path), std::move(project));
+    }
+
+    void InvalidateProject(std::string_view name)
+    {
+        std::lock_guard lock(projects_mutex);
+        projects.erase(std::string{name});
+    }
+
+    void InvalidateProductInfo(std::string_view name)
+    {
+        std::lock_guard lock(product_infos_mutex);
+        product_infos.erase(std::string{name});
+    }
+
+    std::shared_ptr<AppSlot> Slot(std::string_view name)
+    {
+        std::lock_guard lock(slots_mutex);
+        auto& slot = slots[std::string{name}];
+        if (!slot) slot = std::make_shared<AppSlot>();
+        return slot;
+    }
+
+    // 注册表快照，读操作无锁
+    Rcu<RegistryIndex> registry;
+    // 快照之后的修改，在注册表的写锁内追加
+    RegistryJournal journal;
+    RegistryStore registry_store;
+    ManifestStore manifest_store;
+    std::mutex slots_mutex;
+    std::unordered_map<std::string, std::shared_ptr<AppSlot>> slots;
+    std::mutex product_infos_mutex;
+    std::unordered_map<std::string, CachedProductInfo> product_infos;
+    std::mutex projects_mutex;
+    // app名 -> .vmp路径 -> DOM，每套加壳配置一份
+    std::unordered_map<std::string, std::unordered_map<std::string, CachedProject>> projects;
+    BlobStore blob_store;
+    PackCache pack_cache;
+    PackEventListener pack_event_listener;
+    RegistryLoadStats load_stats{};
+    // 核对时发现文件缺失且无法修复的app，重新添加后清除
+    std::mutex broken_apps_mutex;
+    std::unordered_set<std::string> broken_apps;
+    std::mutex update_sessions_mutex;
+    std::unordered_map<std::string, UpdateSession> update_sessions;
+    std::mt19937_64 session_id_engine{std::random_device{}()};
+    std::jthread reconcile_thread;
+    // 最后声明，最先析构，停止时运行中的任务还能访问上面的成员
+    PackExecutor pack_executor;
 };
 
 vmpx::app_pack::AppPackService::AppPackService(const std::filesystem::path& vmp_console_app_path,
-                                               const std::filesystem::path& data_dir):
-    impl_(std::make_unique<Impl>()),
+                                               const std::filesystem::path& data_dir,
+                                               size_t max_concurrent_packs,
+                                               std::chrono::milliseconds pack_timeout):
+    impl_(std::make_unique<Impl>(data_dir, vmp_console_app_path, max_concurrent_packs, pack_timeout)),
     vmp_console_app_path_(vmp_console_app_path), data_dir_(data_dir),
     zip_dir_(data_dir / "zip"), unzip_dir_(data_dir / "unzip"), packed_dir_(data_dir / "packed"),
     config_path_(data_dir / "config.yml")
@@ -69,170 +487,1152 @@ vmpx::app_pack::AppPackService::AppPackService(const std::filesystem::path& vmp_
     // 处理配置文件
     //如果是个目录，则删掉
     if (std::filesystem::is_directory(config_path_))std::filesystem::remove_all(config_path_);
-    if (!std::filesystem::exists(config_path_)) //如果配置文件不存在，则保存一个空的配置文件
+    // 上次异常退出时未应用的增量更新
+    std::filesystem::remove_all(data_dir_ / "staging");
+    // 恢复到一半的目录，解压目录缺失的app在下面的核对中重新恢复
+    std::filesystem::remove_all(data_dir_ / "restoring");
+    auto ElapsedMs = [](std::chrono::steady_clock::time_point begin) -> uint64_t
     {
-        // SaveConfig();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).
+            count();
+    };
+    auto load_begin = std::chrono::steady_clock::now();
+    RegistryIndex index;
+    bool migrated = false;
+    if (impl_->registry_store.Exists())
+    {
+        auto load_result = impl_->registry_store.Load();
+        if (!load_result)
+            throw std::runtime_error(std::format("could not load app registry:{}", load_result.error()));
+        index = std::move(load_result.value());
     }
-    else
+    else if (std::filesystem::exists(config_path_)) //旧版本的YAML配置，迁移到分页存储
     {
         if (!std::filesystem::exists(config_path_) || std::filesystem::is_directory(config_path_))
             throw std::runtime_error(std::format("could not open config file:{}", config_path_.string()));
-        std::unique_lock lock(impl_->mutex);
-        LoadConfig();
+        auto config = LoadConfig();
+        for (auto& [name, app_info] : config.apps)
+        {
+            index.Put(name, std::move(app_info));
+        }
+        migrated = true;
     }
+    impl_->load_stats.load_ms = ElapsedMs(load_begin);
+    // 快照之后的修改记录在日志里，回放后合并成新的快照
+    auto replay_begin = std::chrono::steady_clock::now();
+    auto num_replayed = impl_->journal.Replay([&index](std::span<const uint8_t> payload)
+    {
+        auto record = struct_pack::deserialize<RegistryRecord>(reinterpret_cast<const char*>(payload.data()),
+                                                               payload.size());
+        if (!record)
+        {
+            auto record_v1 = struct_pack::deserialize<RegistryRecordV1>(
+                reinterpret_cast<const char*>(payload.data()), payload.size());
+            if (!record_v1) return;
+            record = RegistryRecord{
+                record_v1->op, std::move(record_v1->name),
+                AppInfo{std::move(record_v1->app_info.vmp_file_path), std::move(record_v1->app_info.packed_app_path), {}}
+            };
+        }
+        if (record->op == RegistryOp::PUT) index.Put(record->name, record->app_info);
+        else index.Erase(record->name);
+    });
+    impl_->load_stats.replay_ms = ElapsedMs(replay_begin);
+    impl_->load_stats.journal_records = num_replayed;
+    if (num_replayed || migrated || !impl_->registry_store.Exists() || impl_->registry_store.UpgradePending())
+    {
+        if (!impl_->registry_store.Save(index))
+            throw std::runtime_error(std::format("could not save app registry to:{}", data_dir_.string()));
+        impl_->journal.Reset();
+    }
+    if (migrated)
+    {
+        auto migrated_path = config_path_;
+        std::filesystem::rename(config_path_, migrated_path += ".migrated");
+    }
+    impl_->load_stats.apps = index.Size();
+    impl_->load_stats.pages = index.Pages().size();
+    impl_->registry.Update([&](RegistryIndex& next)
+    {
+        next = std::move(index);
+        return true;
+    });
+    impl_->load_stats.total_ms = ElapsedMs(load_begin);
 }
 
-vmpx::app_pack::AppPackService::~AppPackService() = default;
+vmpx::app_pack::AppPackService::~AppPackService()
+{
+    // 核对线程会访问本对象的目录成员，先于它们停止
+    if (impl_ && impl_->reconcile_thread.joinable())
+    {
+        impl_->reconcile_thread.request_stop();
+        impl_->reconcile_thread.join();
+    }
+}
 
 std::expected<vmpx::app_pack::AppInfo, std::string> vmpx::app_pack::AppPackService::Add(
     std::string_view name, std::span<uint8_t> zip_file_data, std::filesystem::path vmp_file_path)
 {
-    std::string name_str{name};
+    auto slot = impl_->Slot(name);
+    std::lock_guard slot_lock(slot->mutex);
     // 删掉已经存在的项目
-    Remove(name);
+    {
+        VMPX_TRACE_SCOPE("Add.remove_old");
+        RemoveUnlocked(name);
+    }
+    {
+        std::lock_guard lock(impl_->broken_apps_mutex);
+        impl_->broken_apps.erase(std::string{name});
+    }
     std::filesystem::path zip_file_path = zip_dir_ / name += ".zip";
     std::filesystem::path app_unzip_dir_path = unzip_dir_ / name;
-    if (!WriteFile(zip_file_data, zip_file_path))return std::unexpected{"unable to write zip data to file"};
-    if (!std::filesystem::exists(app_unzip_dir_path))std::filesystem::create_directories(app_unzip_dir_path);
-    if (!UnzipToDir(zip_file_path, app_unzip_dir_path)) return std::unexpected{"unable to unzip file"};
-    if (vmp_file_path.empty()) //如果没设置.vmp文件则搜索
     {
-        auto vmp_files = FindFiles(app_unzip_dir_path, [](const std::filesystem::path& filename)
-        {
-            return filename.extension() == ".vmp";
-        });
+        VMPX_TRACE_SCOPE("Add.write_zip");
+        if (!WriteFile(zip_file_data, zip_file_path))return std::unexpected{"unable to write zip data to file"};
+    }
+    {
+        VMPX_TRACE_SCOPE("Add.unzip");
+        if (!UnzipUnlocked(name)) return std::unexpected{"unable to unzip file"};
+    }
+    auto manifest = impl_->manifest_store.Load(name);
+    if (!manifest) return std::unexpected{manifest.error()};
+    if (vmp_file_path.empty()) //如果没设置.vmp文件则从清单中查找
+    {
+        auto vmp_files = manifest.value()->FilesOfKind(FileKind::VMP_PROJECT);
         if (vmp_files.empty()) return std::unexpected{"unable to find .vmp project file"};
-        vmp_file_path = vmp_files[0];
+        vmp_file_path = ManifestFilePath(app_unzip_dir_path, vmp_files[0]->path);
     }
     else
     {
-        //如果vmp文件已设置，则调整为绝对路径
-        vmp_file_path = app_unzip_dir_path / vmp_file_path;
+        //如果vmp文件已设置，则必须是解压出的文件，并调整为绝对路径
+        auto vmp_entry = manifest.value()->Find(vmp_file_path.generic_string());
+        if (!vmp_entry) return std::unexpected("vmp file is invalid");
+        vmp_file_path = ManifestFilePath(app_unzip_dir_path, vmp_entry->path);
+    }
+    AppInfo app_info{vmp_file_path.string(), "", {}};
+    // 其它.vmp各自作为一套加壳配置，以文件名命名，重名时加序号
+    for (const auto* entry : manifest.value()->FilesOfKind(FileKind::VMP_PROJECT))
+    {
+        auto profile_vmp_file_path = ManifestFilePath(app_unzip_dir_path, entry->path);
+        if (profile_vmp_file_path == vmp_file_path) continue;
+        auto file_name = std::string_view{entry->path}.substr(entry->path.rfind('/') + 1);
+        std::string base_name{file_name.substr(0, file_name.size() - std::string_view{".vmp"}.size())};
+        auto profile_name = base_name;
+        for (size_t i = 2; IsDefaultProfile(profile_name) || FindProfile(app_info, profile_name); ++i)
+        {
+            profile_name = std::format("{}-{}", base_name, i);
+        }
+        app_info.profiles.push_back(AppProfile{std::move(profile_name), profile_vmp_file_path.string(), ""});
+    }
+    VMPX_TRACE_SCOPE("Add.registry");
+    uint64_t seq = 0;
+    impl_->registry.Update([&](RegistryIndex& index)
+    {
+        index.Put(name, app_info);
+        seq = LogMutation(index, name, app_info);
+        return true;
+    });
+    if (!impl_->journal.WaitDurable(seq)) return std::unexpected{"unable to persist app registry"};
+    return app_info;
+}
+
+std::expected<vmpx::app_pack::UpdateDiff, std::string> vmpx::app_pack::AppPackService::BeginUpdate(
+    std::string_view name, std::span<const UpdateFile> files)
+{
+    auto app_info_opt = impl_->registry.Read([name](const RegistryIndex& index) -> std::optional<AppInfo>
+    {
+        auto app_info = index.Find(name);
+        if (!app_info) return std::nullopt;
+        return *app_info;
+    });
+    if (!app_info_opt) return std::unexpected{"unable to find app"};
+    auto manifest = impl_->manifest_store.Load(name);
+    if (!manifest) return std::unexpected{manifest.error()};
+    Impl::UpdateSession session{
+        .name = std::string{name},
+        .base_manifest = manifest.value(),
+        .created = std::chrono::steady_clock::now(),
+    };
+    UpdateDiff diff;
+    std::unordered_set<std::string_view> client_paths;
+    for (const auto& file : files)
+    {
+        if (!IsSafeRelativePath(file.path)) return std::unexpected{std::format("invalid file path:{}", file.path)};
+        if (!client_paths.insert(file.path).second)
+            return std::unexpected{std::format("duplicate file path:{}", file.path)};
+        std::string sha256 = file.sha256;
+        std::ranges::transform(sha256, sha256.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (auto entry = manifest.value()->Find(file.path); entry && entry->sha256 == sha256) continue;
+        diff.changed.push_back(file.path);
+        session.changed.emplace(file.path, std::move(sha256));
+    }
+    auto app_unzip_dir_path = unzip_dir_ / name;
+    auto profiles = AllProfiles(app_info_opt.value());
+    for (const auto& entry : manifest.value()->files)
+    {
+        if (client_paths.contains(entry.path)) continue;
+        auto file_path = ManifestFilePath(app_unzip_dir_path, entry.path);
+        if (std::ranges::any_of(profiles, [&file_path](const AppProfile& profile)
+        {
+            return std::filesystem::path{profile.vmp_file_path} == file_path;
+        }))
+            return std::unexpected{std::format("the .vmp project file can not be removed:{}", entry.path)};
+        diff.removed.push_back(entry.path);
+        session.removed.push_back(entry.path);
+    }
+    std::lock_guard lock(impl_->update_sessions_mutex);
+    std::erase_if(impl_->update_sessions, [&session](const auto& item)
+    {
+        return session.created - item.second.created >= UPDATE_SESSION_TTL;
+    });
+    if (impl_->update_sessions.size() >= MAX_UPDATE_SESSIONS)
+    {
+        impl_->update_sessions.erase(std::ranges::min_element(impl_->update_sessions, {}, [](const auto& item)
+        {
+            return item.second.created;
+        }));
+    }
+    diff.session_id = std::format("{:016x}{:016x}", impl_->session_id_engine(), impl_->session_id_engine());
+    impl_->update_sessions.insert_or_assign(diff.session_id, std::move(session));
+    return diff;
+}
+
+std::expected<vmpx::app_pack::UpdateResult, std::string> vmpx::app_pack::AppPackService::ApplyUpdate(
+    std::string_view session_id, std::span<uint8_t> zip_file_data)
+{
+    Impl::UpdateSession session;
+    {
+        std::lock_guard lock(impl_->update_sessions_mutex);
+        auto it = impl_->update_sessions.find(std::string{session_id});
+        if (it == impl_->update_sessions.end()) return std::unexpected{"update session not found"};
+        session = std::move(it->second);
+        impl_->update_sessions.erase(it);
+    }
+    if (std::chrono::steady_clock::now() - session.created >= UPDATE_SESSION_TTL)
+        return std::unexpected{"update session expired"};
+    const auto& name = session.name;
+    auto slot = impl_->Slot(name);
+    std::lock_guard slot_lock(slot->mutex);
+    auto app_info_opt = impl_->registry.Read([&name](const RegistryIndex& index) -> std::optional<AppInfo>
+    {
+        auto app_info = index.Find(name);
+        if (!app_info) return std::nullopt;
+        return *app_info;
+    });
+    if (!app_info_opt) return std::unexpected{"unable to find app"};
+    auto app_info = app_info_opt.value();
+    auto manifest = impl_->manifest_store.Load(name);
+    if (!manifest || manifest.value() != session.base_manifest)
+        return std::unexpected{"app was modified after the diff, request a new one"};
+    // 先解压到暂存目录并校验，全部通过后再逐个移入解压目录
+    auto app_unzip_dir_path = unzip_dir_ / name;
+    auto staging_dir = data_dir_ / "staging" / name;
+    auto staged_files_dir = staging_dir / "files";
+    std::error_code ec;
+    std::filesystem::remove_all(staging_dir, ec);
+    std::filesystem::create_directories(staged_files_dir, ec);
+    AppManifest staged;
+    auto stage_result = [&]() -> std::expected<void, std::string>
+    {
+        if (!zip_file_data.empty())
+        {
+            auto staged_zip_path = staging_dir / "update.zip";
+            if (!WriteFile(zip_file_data, staged_zip_path))
+                return std::unexpected{"unable to write zip data to file"};
+            // 解压前先核对文件名，不安全或不在本次变化列表中的文件一个都不写
+            auto entry_names = ListZipFiles(staged_zip_path);
+            if (!entry_names) return std::unexpected{entry_names.error()};
+            for (const auto& entry_name : entry_names.value())
+            {
+                if (!IsSafeRelativePath(entry_name))
+                    return std::unexpected{std::format("invalid file path:{}", entry_name)};
+                if (!session.changed.contains(entry_name))
+                    return std::unexpected{std::format("file was not requested:{}", entry_name)};
+            }
+            if (!UnzipToDir(staged_zip_path, staged_files_dir, &impl_->blob_store, &staged))
+                return std::unexpected{"unable to unzip file"};
+        }
+        std::unordered_set<std::string_view> staged_paths;
+        for (const auto& entry : staged.files)
+        {
+            auto it = session.changed.find(entry.path);
+            if (it == session.changed.end())
+                return std::unexpected{std::format("file was not requested:{}", entry.path)};
+            if (it->second != entry.sha256)
+                return std::unexpected{std::format("file hash mismatch:{}", entry.path)};
+            if (!staged_paths.insert(entry.path).second)
+                return std::unexpected{std::format("duplicate file:{}", entry.path)};
+        }
+        if (staged_paths.size() != session.changed.size())
+            return std::unexpected{std::format("{} requested files are missing",
+                                               session.changed.size() - staged_paths.size())};
+        return {};
+    }();
+    // 失败时，暂存时新存入仓库的blob没有被任何app引用
+    auto CollectStaged = [&]
+    {
+        std::filesystem::remove_all(staging_dir, ec);
+        std::vector<std::string> staged_hashes;
+        for (const auto& entry : staged.files)
+        {
+            staged_hashes.push_back(entry.sha256);
+        }
+        impl_->blob_store.Collect(staged_hashes);
+    };
+    if (!stage_result)
+    {
+        CollectStaged();
+        return std::unexpected{stage_result.error()};
+    }
+    // 加壳的输入只有.vmp和它指定的程序，其它文件变化不影响加壳结果，每套配置分别判断
+    std::vector<AppProfile> invalidated_profiles;
+    for (const auto& profile : AllProfiles(app_info))
+    {
+        std::vector<std::filesystem::path> pack_inputs{std::filesystem::path{profile.vmp_file_path}.lexically_normal()};
+        if (auto pack_target = ResolvePackTarget(profile.vmp_file_path, {}))
+            pack_inputs.push_back(pack_target->input_file_path.lexically_normal());
+        auto IsPackInput = [&](std::string_view path)
+        {
+            return std::ranges::find(pack_inputs, ManifestFilePath(app_unzip_dir_path, path).lexically_normal()) !=
+                pack_inputs.end();
+        };
+        if (std::ranges::any_of(staged.files, [&](const ManifestEntry& entry) { return IsPackInput(entry.path); }) ||
+            std::ranges::any_of(session.removed, IsPackInput))
+            invalidated_profiles.push_back(profile);
+    }
+    bool moved = true;
+    for (const auto& entry : staged.files)
+    {
+        auto dst_path = ManifestFilePath(app_unzip_dir_path, entry.path);
+        std::filesystem::create_directories(dst_path.parent_path(), ec);
+        std::filesystem::rename(ManifestFilePath(staged_files_dir, entry.path), dst_path, ec);
+        if (ec)
+        {
+            moved = false;
+            break;
+        }
+    }
+    std::filesystem::remove_all(staging_dir, ec);
+    if (!moved)
+    {
+        // 清单和引用都还是旧的，按旧清单恢复
+        if (std::filesystem::exists(zip_dir_ / name += ".zip", ec)) UnzipUnlocked(name);
+        else RestoreFromBlobsUnlocked(name);
+        CollectStaged();
+        return std::unexpected{"unable to apply update"};
+    }
+    for (const auto& path : session.removed)
+    {
+        std::filesystem::remove(ManifestFilePath(app_unzip_dir_path, path), ec);
+    }
+    AppManifest next_manifest;
+    std::unordered_set<std::string_view> replaced_paths(session.removed.begin(), session.removed.end());
+    for (const auto& entry : staged.files)
+    {
+        replaced_paths.insert(entry.path);
+    }
+    for (const auto& entry : manifest.value()->files)
+    {
+        if (!replaced_paths.contains(entry.path)) next_manifest.files.push_back(entry);
+    }
+    next_manifest.files.insert(next_manifest.files.end(), staged.files.begin(), staged.files.end());
+    // 被替换的文件已不再链接旧的blob，释放后按新清单重新记录引用
+    std::vector<std::string> blob_hashes;
+    blob_hashes.reserve(next_manifest.files.size());
+    for (const auto& entry : next_manifest.files)
+    {
+        if (!entry.sha256.empty()) blob_hashes.push_back(entry.sha256);
+    }
+    impl_->blob_store.Release(name);
+    impl_->blob_store.AddRefs(name, blob_hashes);
+    if (!impl_->manifest_store.Save(name, std::move(next_manifest)))
+        return std::unexpected{"unable to save file manifest"};
+    // zip已和解压目录不一致，之后按清单从BlobStore恢复
+    std::filesystem::remove(zip_dir_ / name += ".zip", ec);
+    {
+        std::lock_guard lock(impl_->broken_apps_mutex);
+        impl_->broken_apps.erase(name);
+    }
+    UpdateResult update_result{
+        .updated = staged.files.size(),
+        .removed = session.removed.size(),
+        .pack_invalidated = !invalidated_profiles.empty(),
+    };
+    if (!invalidated_profiles.empty())
+    {
+        impl_->InvalidateProductInfo(name);
+        for (const auto& profile : invalidated_profiles)
+        {
+            RemovePackedOutput(name, profile);
+            SetPackedAppPath(app_info, profile.name, "");
+            update_result.invalidated_profiles.push_back(profile.name);
+        }
+        uint64_t seq = 0;
+        impl_->registry.Update([&](RegistryIndex& index)
+        {
+            index.Put(name, app_info);
+            seq = LogMutation(index, name, app_info);
+            return true;
+        });
+        if (!impl_->journal.WaitDurable(seq)) return std::unexpected{"unable to persist app registry"};
+    }
+    update_result.app_info = std::move(app_info);
+    return update_result;
+}
+
+std::expected<vmpx::app_pack::ProjectNode, std::string> vmpx::app_pack::AppPackService::GetProjectNode(
+    std::string_view name, std::string_view path, std::string_view profile)
+{
+    auto app_info_opt = impl_->registry.Read([name](const RegistryIndex& index) -> std::optional<AppInfo>
+    {
+        auto app_info = index.Find(name);
+        if (!app_info) return std::nullopt;
+        return *app_info;
+    });
+    if (!app_info_opt) return std::unexpected{"unable to find app"};
+    auto app_profile = FindProfile(app_info_opt.value(), profile);
+    if (!app_profile) return std::unexpected{std::format("unable to find profile:{}", profile)};
+    auto doc = impl_->LoadProject(name, app_profile->vmp_file_path);
+    if (!doc) return std::unexpected{doc.error()};
+    auto node = doc.value()->first_element_by_path(std::string{path}.c_str(), '/');
+    if (!node) return std::unexpected{std::format("unable to find node:{}", path)};
+    ProjectNode project_node{.path = std::string{path}};
+    for (auto attribute : node.attributes())
+    {
+        project_node.attributes.emplace(attribute.name(), attribute.value());
+    }
+    for (auto child : node.children(pugi::node_element))
+    {
+        project_node.children.emplace_back(child.name());
+    }
+    return project_node;
+}
+
+std::expected<vmpx::app_pack::AppInfo, std::string> vmpx::app_pack::AppPackService::PatchProject(
+    std::string_view name, std::span<const ProjectPatch> patches, std::string_view profile)
+{
+    auto slot = impl_->Slot(name);
+    std::lock_guard slot_lock(slot->mutex);
+    auto app_info_opt = impl_->registry.Read([name](const RegistryIndex& index) -> std::optional<AppInfo>
+    {
+        auto app_info = index.Find(name);
+        if (!app_info) return std::nullopt;
+        return *app_info;
+    });
+    if (!app_info_opt) return std::unexpected{"unable to find app"};
+    auto app_info = app_info_opt.value();
+    auto app_profile = FindProfile(app_info, profile);
+    if (!app_profile) return std::unexpected{std::format("unable to find profile:{}", profile)};
+    std::filesystem::path vmp_file_path{app_profile->vmp_file_path};
+    // 写回后清单要随之更新，否则核对时会按旧清单恢复出修改前的文件
+    auto manifest = impl_->manifest_store.Load(name);
+    if (!manifest) return std::unexpected{manifest.error()};
+    auto app_unzip_dir_path = unzip_dir_ / name;
+    auto vmp_entry = std::ranges::find_if(manifest.value()->files, [&](const ManifestEntry& entry)
+    {
+        return ManifestFilePath(app_unzip_dir_path, entry.path) == vmp_file_path;
+    });
+    if (vmp_entry == manifest.value()->files.end()) return std::unexpected{"vmp file is not in the manifest"};
+    auto doc = impl_->LoadProject(name, app_profile->vmp_file_path);
+    if (!doc) return std::unexpected{doc.error()};
+    // 在副本上修改，读者仍持有旧的DOM
+    auto next_doc = std::make_shared<pugi::xml_document>();
+    next_doc->reset(*doc.value());
+    bool changed = false;
+    for (const auto& patch : patches)
+    {
+        if (patch.attribute.empty()) return std::unexpected{"attribute name is required"};
+        auto node = next_doc->first_element_by_path(patch.path.c_str(), '/');
+        if (!node) return std::unexpected{std::format("unable to find node:{}", patch.path)};
+        auto attribute = node.attribute(patch.attribute.c_str());
+        if (!patch.value)
+        {
+            changed |= node.remove_attribute(attribute);
+            continue;
+        }
+        if (attribute && patch.value.value() == attribute.value()) continue;
+        if (!attribute) attribute = node.append_attribute(patch.attribute.c_str());
+        attribute.set_value(patch.value->c_str());
+        changed = true;
+    }
+    if (!changed) return app_info;
+    std::ostringstream oss;
+    next_doc->save(oss, "\t", pugi::format_default, pugi::encoding_utf8);
+    auto content = std::move(oss).str();
+    std::span data(reinterpret_cast<const uint8_t*>(content.data()), content.size());
+    // 先存入仓库并链接到临时文件，再改名覆盖：读者只会看到修改前或修改后的文件，原来链接的blob不受影响
+    auto tmp_path = vmp_file_path;
+    tmp_path += ".tmp";
+    auto hash = impl_->blob_store.Emplace(data, tmp_path);
+    if (!hash) return std::unexpected{hash.error()};
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, vmp_file_path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmp_path, ec);
+        impl_->blob_store.Collect(std::span(&hash.value(), 1));
+        return std::unexpected{std::format("unable to write vmp file:{}", ec.message())};
+    }
+    AppManifest next_manifest = *manifest.value();
+    auto& next_entry = next_manifest.files[vmp_entry - manifest.value()->files.begin()];
+    next_entry.size = content.size();
+    next_entry.crc32 = Crc32(data);
+    next_entry.sha256 = hash.value();
+    std::vector<std::string> blob_hashes;
+    blob_hashes.reserve(next_manifest.files.size());
+    for (const auto& entry : next_manifest.files)
+    {
+        if (!entry.sha256.empty()) blob_hashes.push_back(entry.sha256);
+    }
+    impl_->blob_store.Release(name);
+    impl_->blob_store.AddRefs(name, blob_hashes);
+    if (!impl_->manifest_store.Save(name, std::move(next_manifest)))
+        return std::unexpected{"unable to save file manifest"};
+    // zip已和解压目录不一致，之后按清单从BlobStore恢复
+    std::filesystem::remove(zip_dir_ / name += ".zip", ec);
+    auto last_write_time = std::filesystem::last_write_time(vmp_file_path, ec);
+    if (!ec)
+        impl_->CacheProject(name, Impl::CachedProject{
+                                app_profile->vmp_file_path, last_write_time, content.size(), std::move(next_doc)
+                            });
+    else impl_->InvalidateProject(name);
+    impl_->InvalidateProductInfo(name);
+    // 只有这套配置的加壳结果依赖该.vmp，解压出的其它文件和其它配置不受影响
+    RemovePackedOutput(name, app_profile.value());
+    if (!app_profile->packed_app_path.empty())
+    {
+        SetPackedAppPath(app_info, app_profile->name, "");
+        uint64_t seq = 0;
+        impl_->registry.Update([&](RegistryIndex& index)
+        {
+            index.Put(name, app_info);
+            seq = LogMutation(index, name, app_info);
+            return true;
+        });
+        if (!impl_->journal.WaitDurable(seq)) return std::unexpected{"unable to persist app registry"};
     }
-    if (!std::filesystem::exists(vmp_file_path) || std::filesystem::is_directory(vmp_file_path))
-        return std::unexpected("vmp file is invalid");
-    AppInfo app_info{vmp_file_path.string(), ""};
-    std::unique_lock lock(impl_->mutex);
-    config_.apps.emplace(name, AppInfo{app_info});
-    SaveConfig();
     return app_info;
 }
 
+void vmpx::app_pack::AppPackService::RemovePackedOutput(std::string_view name, const AppProfile& profile)
+{
+    std::error_code ec;
+    std::filesystem::remove_all(packed_dir_ / name / profile.name, ec);
+    // 旧版本直接输出到app的目录下
+    if (!profile.packed_app_path.empty())std::filesystem::remove(profile.packed_app_path, ec);
+}
+
 bool vmpx::app_pack::AppPackService::Remove(std::string_view name)
 {
-    std::unique_lock lock(impl_->mutex);
-    auto it = config_.apps.find(std::string{name});
-    if (it == config_.apps.end()) return false;
-    auto& app_info = it->second;
-    // 删除各种目录和文件
+    auto slot = impl_->Slot(name);
+    std::lock_guard slot_lock(slot->mutex);
+    return RemoveUnlocked(name);
+}
+
+bool vmpx::app_pack::AppPackService::RemoveUnlocked(std::string_view name)
+{
+    AppInfo app_info;
+    uint64_t seq = 0;
+    bool removed = impl_->registry.Update([&](RegistryIndex& index)
+    {
+        auto found = index.Find(name);
+        if (!found) return false;
+        app_info = *found;
+        index.Erase(name);
+        seq = LogMutation(index, name, std::nullopt);
+        return true;
+    });
+    if (!removed) return false;
+    impl_->journal.WaitDurable(seq);
+    // 删除各种目录和文件，已从注册表摘除，读者只会看到摘除前或摘除后的快照
+    std::error_code ec;
     std::filesystem::path zip_file_path = zip_dir_ / name += ".zip";
     std::filesystem::path app_unzip_dir_path = unzip_dir_ / name;
-    std::filesystem::remove(zip_file_path);
-    std::filesystem::remove_all(app_unzip_dir_path);
-    std::filesystem::remove(app_info.packed_app_path);
-    config_.apps.erase(it);
-    SaveConfig();
+    std::filesystem::remove(zip_file_path, ec);
+    std::filesystem::remove_all(app_unzip_dir_path, ec);
+    std::filesystem::remove_all(packed_dir_ / name, ec);
+    if (!app_info.packed_app_path.empty())std::filesystem::remove(app_info.packed_app_path, ec);
+    impl_->blob_store.Release(name);
+    impl_->manifest_store.Remove(name);
+    impl_->InvalidateProductInfo(name);
+    impl_->InvalidateProject(name);
+    std::lock_guard lock(impl_->broken_apps_mutex);
+    impl_->broken_apps.erase(std::string{name});
+    return true;
+}
+
+bool vmpx::app_pack::AppPackService::UnzipUnlocked(std::string_view name)
+{
+    std::filesystem::path zip_file_path = zip_dir_ / name += ".zip";
+    std::filesystem::path app_unzip_dir_path = unzip_dir_ / name;
+    // 清理上次解压残留的文件和引用
+    std::error_code ec;
+    std::filesystem::remove_all(app_unzip_dir_path, ec);
+    impl_->blob_store.Release(name);
+    impl_->InvalidateProductInfo(name);
+    impl_->InvalidateProject(name);
+    std::filesystem::create_directories(app_unzip_dir_path, ec);
+    AppManifest manifest;
+    bool unzipped = UnzipToDir(zip_file_path, app_unzip_dir_path, &impl_->blob_store, &manifest);
+    // 即使解压失败也要记录引用，已链接的blob才能在Remove时回收
+    std::vector<std::string> blob_hashes;
+    blob_hashes.reserve(manifest.files.size());
+    for (const auto& entry : manifest.files)
+    {
+        if (!entry.sha256.empty()) blob_hashes.push_back(entry.sha256);
+    }
+    impl_->blob_store.AddRefs(name, blob_hashes);
+    if (!unzipped)
+    {
+        impl_->manifest_store.Remove(name);
+        return false;
+    }
+    return impl_->manifest_store.Save(name, std::move(manifest));
+}
+
+bool vmpx::app_pack::AppPackService::RestoreFromBlobsUnlocked(std::string_view name)
+{
+    auto manifest = impl_->manifest_store.Load(name);
+    if (!manifest) return false;
+    auto app_unzip_dir_path = unzip_dir_ / name;
+    // 先在暂存目录中链接出完整的文件，全部成功后再换下旧目录，失败时旧目录保持原样
+    auto restoring_dir = data_dir_ / "restoring" / name;
+    auto replaced_dir = data_dir_ / "restoring" / std::format("{}.old", name);
+    std::error_code ec;
+    std::filesystem::remove_all(restoring_dir, ec);
+    std::filesystem::remove_all(replaced_dir, ec);
+    std::filesystem::create_directories(restoring_dir, ec);
+    bool linked = std::ranges::all_of(manifest.value()->files, [&](const ManifestEntry& entry)
+    {
+        return !entry.sha256.empty() &&
+            impl_->blob_store.Link(entry.sha256, ManifestFilePath(restoring_dir, entry.path));
+    });
+    if (!linked)
+    {
+        std::filesystem::remove_all(restoring_dir, ec);
+        return false;
+    }
+    impl_->InvalidateProductInfo(name);
+    impl_->InvalidateProject(name);
+    // 目录不能直接覆盖，先把旧目录移开
+    if (std::filesystem::exists(app_unzip_dir_path, ec))
+    {
+        std::filesystem::rename(app_unzip_dir_path, replaced_dir, ec);
+        if (ec)
+        {
+            std::filesystem::remove_all(restoring_dir, ec);
+            return false;
+        }
+    }
+    std::filesystem::create_directories(unzip_dir_, ec);
+    std::filesystem::rename(restoring_dir, app_unzip_dir_path, ec);
+    if (ec)
+    {
+        std::filesystem::rename(replaced_dir, app_unzip_dir_path, ec);
+        std::filesystem::remove_all(restoring_dir, ec);
+        return false;
+    }
+    std::filesystem::remove_all(replaced_dir, ec);
     return true;
 }
 
 std::vector<std::string> vmpx::app_pack::AppPackService::List() const
 {
-    std::vector<std::string> app_names;
-    std::shared_lock lock(impl_->mutex);
-    app_names.reserve(config_.apps.size());
-    for (const auto& key : config_.apps | std::views::keys)
+    return impl_->registry.Read([](const RegistryIndex& index)
+    {
+        std::vector<std::string> app_names;
+        app_names.reserve(index.Size());
+        index.ForEach([&app_names](const RegistryEntry& entry) { app_names.push_back(entry.name); });
+        return app_names;
+    });
+}
+
+vmpx::app_pack::AppListDelta vmpx::app_pack::AppPackService::ListDelta(uint64_t since) const
+{
+    return impl_->registry.Read([since](const RegistryIndex& index)
     {
-        app_names.push_back(key);
+        return index.Delta(since);
+    });
+}
+
+uint64_t vmpx::app_pack::AppPackService::RegistryVersion() const
+{
+    return impl_->registry.Read([](const RegistryIndex& index)
+    {
+        return index.Version();
+    });
+}
+
+vmpx::app_pack::AppListPage vmpx::app_pack::AppPackService::ListPage(std::string_view prefix,
+                                                                     std::string_view cursor, size_t limit) const
+{
+    return impl_->registry.Read([&](const RegistryIndex& index)
+    {
+        return index.List(prefix, cursor, limit);
+    });
+}
+
+std::filesystem::path vmpx::app_pack::AppPackService::GetPacked(std::string_view name, std::string_view profile)
+{
+    return impl_->registry.Read([name, profile](const RegistryIndex& index)
+    {
+        auto app_info = index.Find(name);
+        if (!app_info) return std::filesystem::path{};
+        auto app_profile = FindProfile(*app_info, profile);
+        if (!app_profile) return std::filesystem::path{};
+        return std::filesystem::path{app_profile->packed_app_path};
+    });
+}
+
+std::expected<std::filesystem::path, std::string> vmpx::app_pack::AppPackService::Pack(std::string_view name,
+    PackPriority priority)
+{
+    return PackProfile(name, {}, priority);
+}
+
+std::expected<std::filesystem::path, std::string> vmpx::app_pack::AppPackService::PackProfile(
+    std::string_view name, std::string_view profile, PackPriority priority)
+{
+    auto slot = impl_->Slot(name);
+    std::lock_guard slot_lock(slot->mutex);
+    std::string profile_name{IsDefaultProfile(profile) ? DEFAULT_PROFILE : profile};
+    NotifyPackEvent(name, PackEvent{.phase = "queued", .profile = profile_name});
+    auto result = PackUnlocked(name, profile, priority);
+    if (result)
+        NotifyPackEvent(name, PackEvent{.phase = "completed", .percent = 100, .done = true, .profile = profile_name});
+    else
+        NotifyPackEvent(name, PackEvent{
+                            .phase = "failed", .message = result.error(), .done = true, .profile = profile_name
+                        });
+    return result;
+}
+
+std::expected<std::vector<vmpx::app_pack::ProfilePackResult>, std::string>
+vmpx::app_pack::AppPackService::PackAllProfiles(std::string_view name, PackPriority priority)
+{
+    auto slot = impl_->Slot(name);
+    std::lock_guard slot_lock(slot->mutex);
+    auto app_info = impl_->registry.Read([name](const RegistryIndex& index) -> std::optional<AppInfo>
+    {
+        auto app_info = index.Find(name);
+        if (!app_info) return std::nullopt;
+        return *app_info;
+    });
+    if (!app_info) return std::unexpected{"unable to find app"};
+    auto profiles = AllProfiles(app_info.value());
+    NotifyPackEvent(name, PackEvent{.phase = "queued"});
+    // 持有app的锁，各配置在各自的线程上排队加壳，并发数仍由执行器限制
+    std::vector<ProfilePackResult> results(profiles.size());
+    auto trace_context = trace::CurrentContext();
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(profiles.size());
+        for (size_t i = 0; i < profiles.size(); ++i)
+        {
+            threads.emplace_back([&, i]
+            {
+                trace::ContextScope trace_scope(trace_context);
+                results[i] = ProfilePackResult{profiles[i].name, PackUnlocked(name, profiles[i].name, priority)};
+            });
+        }
     }
-    return app_names;
+    auto num_failed = std::ranges::count_if(results, [](const ProfilePackResult& result) { return !result.result; });
+    if (num_failed == 0)
+        NotifyPackEvent(name, PackEvent{.phase = "completed", .percent = 100, .done = true});
+    else
+        NotifyPackEvent(name, PackEvent{
+                            .phase = "failed",
+                            .message = std::format("{} of {} profiles failed", num_failed, results.size()),
+                            .done = true
+                        });
+    return results;
 }
 
-std::filesystem::path vmpx::app_pack::AppPackService::GetPacked(std::string_view name)
+std::expected<std::filesystem::path, std::string> vmpx::app_pack::AppPackService::PackUnlocked(
+    std::string_view name, std::string_view profile, PackPriority priority)
 {
-    std::shared_lock lock(impl_->mutex);
-    auto it = config_.apps.find(std::string{name});
-    if (it == config_.apps.end()) return std::filesystem::path{};
-    return it->second.packed_app_path;
+    auto slot = impl_->Slot(name);
+    {
+        std::lock_guard lock(impl_->broken_apps_mutex);
+        if (impl_->broken_apps.contains(std::string{name}))
+            return std::unexpected{"app files are missing, add it again"};
+    }
+    auto app_info_opt = impl_->registry.Read([name](const RegistryIndex& index) -> std::optional<AppInfo>
+    {
+        auto app_info = index.Find(name);
+        if (!app_info) return std::nullopt;
+        return *app_info;
+    });
+    if (!app_info_opt) return std::unexpected{"unable to find app"};
+    auto app_profile = FindProfile(app_info_opt.value(), profile);
+    if (!app_profile) return std::unexpected{std::format("unable to find profile:{}", profile)};
+    const auto& vmp_file_path = app_profile->vmp_file_path;
+    // 每套配置单独的输出目录，并发加壳时同名的输出文件不会互相覆盖，解压目录只读共享
+    auto profile_packed_dir = packed_dir_ / name / app_profile->name;
+    std::error_code ec;
+    std::filesystem::create_directories(profile_packed_dir, ec);
+    auto pack_target = ResolvePackTarget(vmp_file_path, profile_packed_dir);
+    if (!pack_target) return std::unexpected{std::format("unable to pack app:{}", pack_target.error())};
+    auto NotifyProfileEvent = [&](PackEvent event)
+    {
+        event.profile = app_profile->name;
+        NotifyPackEvent(name, event);
+    };
+    // 输入没有变化时直接使用缓存的加壳结果
+    auto cache_key = [&]
+    {
+        VMPX_TRACE_SCOPE("Pack.cache_key");
+        return impl_->pack_cache.Key(vmp_file_path, pack_target->input_file_path, pack_target->output_file_name);
+    }();
+    std::filesystem::path packed_app_path{pack_target->output_file_name};
+    bool cache_hit = [&]
+    {
+        VMPX_TRACE_SCOPE("Pack.cache_fetch");
+        return cache_key && impl_->pack_cache.Fetch(cache_key.value(), packed_app_path);
+    }();
+    if (!cache_hit)
+    {
+        // 旧的输出可能是指向缓存的硬链接，先删掉，避免加壳程序原地覆盖缓存内容
+        std::filesystem::remove(packed_app_path, ec);
+        // 加壳进程由执行器统一调度，限制并发数，排队时间为Pack.executor与PackApp之差
+        VMPX_TRACE_SCOPE("Pack.executor");
+        auto trace_context = trace::CurrentContext();
+        auto ticket = impl_->pack_executor.Submit([&](const PackOptions& options)
+        {
+            trace::ContextScope trace_scope(trace_context);
+            auto pack_options = options;
+            pack_options.on_event = NotifyProfileEvent;
+            return PackApp(vmp_console_app_path_, vmp_file_path, profile_packed_dir, pack_options);
+        }, priority);
+        {
+            std::lock_guard lock(slot->pack_jobs_mutex);
+            slot->pack_job_ids.insert(ticket.id);
+        }
+        auto pack_result = ticket.result.get();
+        {
+            std::lock_guard lock(slot->pack_jobs_mutex);
+            slot->pack_job_ids.erase(ticket.id);
+        }
+        if (!pack_result) return std::unexpected{std::format("unable to pack app:{}", pack_result.error())};
+        packed_app_path = pack_result.value();
+        VMPX_TRACE_SCOPE("Pack.cache_store");
+        if (cache_key) impl_->pack_cache.Store(cache_key.value(), packed_app_path);
+    }
+    else
+    {
+        NotifyProfileEvent(PackEvent{.phase = "cached", .percent = 100});
+    }
+    // 持有该app的锁，期间不会被Remove，条目和配置一定还在；同一app的其它配置可能同时更新，在写锁内读改写
+    VMPX_TRACE_SCOPE("Pack.registry");
+    uint64_t seq = 0;
+    impl_->registry.Update([&](RegistryIndex& index)
+    {
+        auto app_info = *index.Find(name);
+        SetPackedAppPath(app_info, app_profile->name, packed_app_path.string());
+        index.Put(name, app_info);
+        seq = LogMutation(index, name, app_info);
+        return true;
+    });
+    // 记录丢失只会导致重启后重新加壳，不影响本次结果
+    impl_->journal.WaitDurable(seq);
+    return packed_app_path;
 }
 
-std::expected<std::filesystem::path, std::string> vmpx::app_pack::AppPackService::Pack(std::string_view name)
+std::vector<vmpx::app_pack::BatchPackResult> vmpx::app_pack::AppPackService::PackBatch(
+    std::span<const std::string> names, PackPriority priority, std::span<const std::string> profiles,
+    std::stop_token stop_token)
 {
-    std::unique_lock lock(impl_->mutex);
-    auto it = config_.apps.find(std::string{name});
-    if (it == config_.apps.end()) return std::unexpected{"unable to find app"};
-    auto packed_app_path = PackApp(vmp_console_app_path_, it->second.vmp_file_path, packed_dir_);
-    if (!packed_app_path) return std::unexpected{std::format("unable to pack app:{}", packed_app_path.error())};
-    it->second.packed_app_path = packed_app_path.value().string();
-    SaveConfig();
-    return it->second.packed_app_path;
+    static const std::string default_profile{DEFAULT_PROFILE};
+    if (profiles.empty()) profiles = std::span(&default_profile, 1);
+    std::vector<BatchPackResult> results(names.size() * profiles.size());
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        results[i].name = names[i / profiles.size()];
+        results[i].profile = profiles[i % profiles.size()];
+    }
+    // 停止时取消本批次中进行中的加壳，工作线程随即返回
+    std::stop_callback on_stop(stop_token, [this, names]
+    {
+        for (const auto& name : names)
+        {
+            CancelPack(name);
+        }
+    });
+    std::atomic_size_t next_index{0};
+    auto worker = [&]
+    {
+        for (size_t i = next_index++; i < results.size(); i = next_index++)
+        {
+            auto& [name, profile, result] = results[i];
+            if (stop_token.stop_requested())
+            {
+                result = std::unexpected{"pack cancelled"};
+                continue;
+            }
+            if (!Has(name))
+            {
+                result = std::unexpected{"unable to find app"};
+                continue;
+            }
+            if (auto packed_app_path = GetPacked(name, profile); !packed_app_path.empty())
+            {
+                result = std::move(packed_app_path);
+                continue;
+            }
+            result = PackProfile(name, profile, priority);
+        }
+    };
+    // 每个线程同一时刻只等待一个加壳任务，多了也只是在执行器里排队
+    auto num_threads = std::min<size_t>(results.size(), impl_->pack_executor.Metrics().max_concurrency);
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+    }
+    return results;
+}
+
+void vmpx::app_pack::AppPackService::SetPackEventListener(PackEventListener listener)
+{
+    impl_->pack_event_listener = std::move(listener);
+}
+
+void vmpx::app_pack::AppPackService::NotifyPackEvent(std::string_view name, const PackEvent& event) const
+{
+    if (impl_->pack_event_listener) impl_->pack_event_listener(name, event);
+}
+
+bool vmpx::app_pack::AppPackService::CancelPack(std::string_view name)
+{
+    auto slot = impl_->Slot(name);
+    std::vector<uint64_t> job_ids;
+    {
+        std::lock_guard lock(slot->pack_jobs_mutex);
+        job_ids.assign(slot->pack_job_ids.begin(), slot->pack_job_ids.end());
+    }
+    bool cancelled = false;
+    for (auto job_id : job_ids)
+    {
+        cancelled |= impl_->pack_executor.Cancel(job_id);
+    }
+    return cancelled;
+}
+
+vmpx::app_pack::PackExecutorMetrics vmpx::app_pack::AppPackService::GetPackMetrics() const
+{
+    return impl_->pack_executor.Metrics();
 }
 
 bool vmpx::app_pack::AppPackService::Has(std::string_view name) const
 {
-    std::shared_lock lock(impl_->mutex);
-    return this->config_.apps.contains(std::string{name});
+    return impl_->registry.Read([name](const RegistryIndex& index)
+    {
+        return index.Contains(name);
+    });
 }
 
 std::expected<vmpx::ProductInfo, std::string> vmpx::app_pack::AppPackService::GetProductInfo(std::string_view name)
 {
-    using namespace pugi;
-    auto it = config_.apps.find(std::string{name});
-    if (it == config_.apps.end()) return std::unexpected{"unable to find app"};
-    auto& app_info = it->second;
-    xml_document doc;
-    auto load_result = doc.load_file(app_info.vmp_file_path.c_str());
-    if (!load_result)
-        return std::unexpected{
-            std::format("unable to parse vmp file:{},{}",
-                        app_info.vmp_file_path, load_result.description())
-        };
-    auto license_manager_node = doc.child("Document").child("LicenseManager");
-    if (license_manager_node.empty())
-        return std::unexpected{"unable to find Document.LicenseManager node"};
-    auto product_code = license_manager_node.attribute("ProductCode").as_string();
-    auto algorithm = license_manager_node.attribute("Algorithm").as_string();
-    auto bits = license_manager_node.attribute("Bits").as_uint();
-    auto public_exponent = license_manager_node.attribute("PublicExp").as_string();
-    auto private_exponent = license_manager_node.attribute("PrivateExp").as_string();
-    auto modulus = license_manager_node.attribute("Modulus").as_string();
-    auto B642Vec = [](std::string_view data) -> std::vector<uint8_t>
+    auto vmp_file_path_opt = impl_->registry.Read([name](const RegistryIndex& index) -> std::optional<std::string>
     {
-        return base64::decode_into<std::vector<uint8_t>>(data.begin(), data.end());
-    };
-    return ProductInfo{
-        .key_size = (bits),
-        .modulus = B642Vec(modulus),
-        .public_exponent = B642Vec(public_exponent),
-        .private_exponent = B642Vec(private_exponent),
-        .product_code = B642Vec(product_code),
-    };
+        auto app_info = index.Find(name);
+        if (!app_info) return std::nullopt;
+        return app_info->vmp_file_path;
+    });
+    if (!vmp_file_path_opt) return std::unexpected{"unable to find app"};
+    const auto& vmp_file_path = vmp_file_path_opt.value();
+    std::error_code ec;
+    auto last_write_time = std::filesystem::last_write_time(vmp_file_path, ec);
+    auto file_size = ec ? 0 : std::filesystem::file_size(vmp_file_path, ec);
+    if (ec) return std::unexpected{std::format("unable to stat vmp file:{},{}", vmp_file_path, ec.message())};
+    {
+        std::lock_guard lock(impl_->product_infos_mutex);
+        auto it = impl_->product_infos.find(std::string{name});
+        if (it != impl_->product_infos.end() && it->second.vmp_file_path == vmp_file_path &&
+            it->second.last_write_time == last_write_time && it->second.file_size == file_size)
+            return it->second.product_info;
+    }
+    // 解析时不持锁，并发的未命中最多重复解析一次
+    auto product_info = ReadProductInfo(vmp_file_path);
+    if (!product_info) return product_info;
+    std::lock_guard lock(impl_->product_infos_mutex);
+    impl_->product_infos.insert_or_assign(std::string{name}, Impl::CachedProductInfo{
+                                              vmp_file_path, last_write_time, file_size, product_info.value()
+                                          });
+    return product_info;
+}
+
+vmpx::app_pack::PackCacheStats vmpx::app_pack::AppPackService::GetPackCacheStats() const
+{
+    return impl_->pack_cache.Stats();
+}
+
+std::expected<vmpx::app_pack::ManifestStore::ManifestPtr, std::string> vmpx::app_pack::AppPackService::GetManifest(
+    std::string_view name)
+{
+    return impl_->manifest_store.Load(name);
+}
+
+vmpx::app_pack::RegistryLoadStats vmpx::app_pack::AppPackService::GetLoadStats() const
+{
+    return impl_->load_stats;
 }
 
-void vmpx::app_pack::AppPackService::SaveConfig()
+void vmpx::app_pack::AppPackService::StartReconcile(std::function<void(const ReconcileReport& report)> on_finished)
 {
-    try
+    if (impl_->reconcile_thread.joinable()) return;
+    impl_->reconcile_thread = std::jthread([this, on_finished = std::move(on_finished)](std::stop_token stop_token)
     {
-        std::string str;
-        struct_yaml::to_yaml(config_, str);
-        std::ofstream out(config_path_, std::ios::binary);
-        out.write(str.data(), static_cast<std::streamsize>(str.size()));
+        auto report = Reconcile(stop_token);
+        if (on_finished && !stop_token.stop_requested()) on_finished(report);
+    });
+}
+
+vmpx::app_pack::ReconcileReport vmpx::app_pack::AppPackService::Reconcile(std::stop_token stop_token)
+{
+    auto begin = std::chrono::steady_clock::now();
+    ReconcileReport report{};
+    auto entries = impl_->registry.Read([](const RegistryIndex& index)
+    {
+        std::vector<RegistryEntry> entries;
+        entries.reserve(index.Size());
+        index.ForEach([&entries](const RegistryEntry& entry) { entries.push_back(entry); });
+        return entries;
+    });
+    report.checked = entries.size();
+    // 按清单逐个检查解压出的文件，缺失或大小不符即视为损坏，不遍历目录
+    auto UnzipIntact = [this](const std::string& name, const AppInfo& app_info)
+    {
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(app_info.vmp_file_path, ec)) return false;
+        auto manifest = impl_->manifest_store.Load(name);
+        if (!manifest) return false;
+        auto app_unzip_dir_path = unzip_dir_ / name;
+        return std::ranges::all_of(manifest.value()->files, [&](const ManifestEntry& entry)
+        {
+            return std::filesystem::file_size(ManifestFilePath(app_unzip_dir_path, entry.path), ec) == entry.size
+                && !ec;
+        });
+    };
+    // 先不加锁并行检查，只有可疑的app再加锁复查
+    auto PackedMissing = [](const AppInfo& app_info, std::error_code& ec)
+    {
+        return std::ranges::any_of(AllProfiles(app_info), [&ec](const AppProfile& profile)
+        {
+            return !profile.packed_app_path.empty() && !std::filesystem::exists(profile.packed_app_path, ec);
+        });
+    };
+    std::vector<uint8_t> suspects(entries.size(), 0);
+    std::atomic_size_t next_index{0};
+    auto worker = [&]
+    {
+        std::error_code ec;
+        for (size_t i = next_index++; i < entries.size() && !stop_token.stop_requested(); i = next_index++)
+        {
+            const auto& app_info = entries[i].app_info;
+            if (!UnzipIntact(entries[i].name, app_info) || PackedMissing(app_info, ec))
+                suspects[i] = 1;
+        }
+    };
+    {
+        auto num_threads = std::min<size_t>(entries.size(), std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::jthread> threads;
+        threads.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i)
+        {
+            threads.emplace_back(worker);
+        }
     }
-    catch (std::exception& e)
+    for (size_t i = 0; i < entries.size() && !stop_token.stop_requested(); ++i)
+    {
+        if (!suspects[i]) continue;
+        const auto& name = entries[i].name;
+        auto slot = impl_->Slot(name);
+        std::lock_guard slot_lock(slot->mutex);
+        // 检查期间可能被重新添加或删除，以当前快照为准
+        auto app_info_opt = impl_->registry.Read([&name](const RegistryIndex& index) -> std::optional<AppInfo>
+        {
+            auto app_info = index.Find(name);
+            if (!app_info) return std::nullopt;
+            return *app_info;
+        });
+        if (!app_info_opt) continue;
+        auto app_info = app_info_opt.value();
+        std::error_code ec;
+        bool repaired = false;
+        if (!UnzipIntact(name, app_info))
+        {
+            // 增量更新过的app没有zip，按清单从BlobStore恢复
+            bool restored = std::filesystem::exists(zip_dir_ / name += ".zip", ec)
+                                ? UnzipUnlocked(name)
+                                : RestoreFromBlobsUnlocked(name);
+            if (!restored || !std::filesystem::is_regular_file(app_info.vmp_file_path, ec))
+            {
+                std::lock_guard lock(impl_->broken_apps_mutex);
+                impl_->broken_apps.emplace(name);
+                report.broken_apps.push_back(name);
+                continue;
+            }
+            repaired = true;
+        }
+        if (PackedMissing(app_info, ec))
+        {
+            for (const auto& profile : AllProfiles(app_info))
+            {
+                if (!profile.packed_app_path.empty() && !std::filesystem::exists(profile.packed_app_path, ec))
+                    SetPackedAppPath(app_info, profile.name, "");
+            }
+            uint64_t seq = 0;
+            impl_->registry.Update([&](RegistryIndex& index)
+            {
+                index.Put(name, app_info);
+                seq = LogMutation(index, name, app_info);
+                return true;
+            });
+            impl_->journal.WaitDurable(seq);
+            repaired = true;
+        }
+        if (repaired) ++report.repaired;
+    }
+    report.broken = report.broken_apps.size();
+    report.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    return report;
+}
+
+uint64_t vmpx::app_pack::AppPackService::LogMutation(const RegistryIndex& index, std::string_view name,
+                                                     const std::optional<AppInfo>& app_info)
+{
+    RegistryRecord record{
+        .op = app_info ? RegistryOp::PUT : RegistryOp::ERASE,
+        .name = std::string{name},
+        .app_info = app_info.value_or(AppInfo{}),
+    };
+    auto payload = struct_pack::serialize(record);
+    auto seq = impl_->journal.Append(std::span(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()));
+    if (impl_->journal.NeedsCompaction())
     {
-        throw std::runtime_error(std::format("could not create config file:{}, error msg:{}",
-                                             config_path_.string(), e.what()));
+        // 快照包含了刚追加的记录，日志可以清空；快照写失败则保留日志，下次再试
+        // 只有上次保存后变化过的页需要写入
+        if (impl_->registry_store.Save(index)) impl_->journal.Reset();
     }
+    return seq;
 }
 
-void vmpx::app_pack::AppPackService::LoadConfig()
+vmpx::app_pack::Config vmpx::app_pack::AppPackService::LoadConfig()
 {
+    Config config;
     auto data_opt = ReadFile(config_path_);
     if (!data_opt)throw std::runtime_error(std::format("read config file failed"));
     auto& data = data_opt.value();
     std::string str{data.begin(), data.end()};
     std::error_code ec;
-    struct_yaml::from_yaml(config_, str, ec);
+    struct_yaml::from_yaml(config, str, ec);
     if (ec)
         throw std::runtime_error(std::format("could not parse config file:{}, error msg:{}",
                                              config_path_.string(), ec.message()));
+    return config;
 }
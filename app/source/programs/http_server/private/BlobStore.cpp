@@ -0,0 +1,173 @@
+﻿#include "BlobStore.h"
+
+#include <atomic>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <set>
+
+#include <cryptopp/sha.h>
+#include <cryptopp/hex.h>
+#include <cryptopp/filters.h>
+
+#include "Utils.h"
+
+namespace
+{
+    std::atomic_uint64_t tmp_file_counter{0};
+
+    std::error_code LinkBlob(const std::filesystem::path& blob_path, const std::filesystem::path& dst_path)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(dst_path.parent_path(), ec);
+        std::filesystem::remove(dst_path, ec);
+        std::filesystem::create_hard_link(blob_path, dst_path, ec);
+        return ec;
+    }
+
+    std::vector<std::string> LoadRefs(const std::filesystem::path& refs_path)
+    {
+        std::set<std::string> hashes;
+        std::ifstream ifs(refs_path);
+        for (std::string line; std::getline(ifs, line);)
+        {
+            if (!line.empty())hashes.insert(line);
+        }
+        return {hashes.begin(), hashes.end()};
+    }
+}
+
+vmpx::app_pack::BlobStore::BlobStore(const std::filesystem::path& root_dir):
+    objects_dir_(root_dir / "objects"), refs_dir_(root_dir / "refs"), tmp_dir_(root_dir / "tmp")
+{
+    if (!std::filesystem::exists(objects_dir_))std::filesystem::create_directories(objects_dir_);
+    if (!std::filesystem::exists(refs_dir_))std::filesystem::create_directories(refs_dir_);
+    // 上次异常退出残留的临时文件没有用处
+    if (std::filesystem::exists(tmp_dir_))std::filesystem::remove_all(tmp_dir_);
+    std::filesystem::create_directories(tmp_dir_);
+    std::error_code ec;
+    for (const auto& dir_entry : std::filesystem::directory_iterator(refs_dir_, ec))
+    {
+        if (dir_entry.path().extension() != ".refs") continue;
+        auto hashes = LoadRefs(dir_entry.path());
+        for (const auto& hash : hashes)
+        {
+            ++ref_counts_[hash];
+        }
+        owner_refs_.emplace(dir_entry.path().stem().string(), std::move(hashes));
+    }
+}
+
+std::string vmpx::app_pack::BlobStore::Hash(std::span<const uint8_t> data)
+{
+    using namespace CryptoPP;
+    SHA256 sha;
+    std::string digest(SHA256::DIGESTSIZE, '\0');
+    sha.CalculateDigest(reinterpret_cast<byte*>(digest.data()), data.data(), data.size());
+    std::string hex;
+    StringSource ss(digest, true, new HexEncoder(new StringSink(hex), false));
+    return hex;
+}
+
+std::expected<std::string, std::string> vmpx::app_pack::BlobStore::Emplace(
+    std::span<const uint8_t> data, const std::filesystem::path& dst_path)
+{
+    auto hash = Hash(data);
+    auto blob_path = BlobPath(hash);
+    std::shared_lock lock(mutex_);
+    std::error_code ec;
+    if (!std::filesystem::exists(blob_path, ec) || std::filesystem::file_size(blob_path, ec) != data.size())
+    {
+        // 先写临时文件再改名，其他线程不会看到写了一半的blob
+        auto tmp_path = tmp_dir_ / std::format("{}.{}", hash, tmp_file_counter.fetch_add(1));
+        if (!WriteFile(data, tmp_path))
+            return std::unexpected{std::format("unable to write blob:{}", hash)};
+        std::filesystem::create_directories(blob_path.parent_path(), ec);
+        std::filesystem::rename(tmp_path, blob_path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp_path, ec);
+            if (!std::filesystem::exists(blob_path))
+                return std::unexpected{std::format("unable to store blob:{}", hash)};
+        }
+    }
+    if (ec = LinkBlob(blob_path, dst_path); ec)
+        return std::unexpected{std::format("unable to link blob {} to {}:{}", hash, dst_path.string(), ec.message())};
+    return hash;
+}
+
+bool vmpx::app_pack::BlobStore::Link(std::string_view hash, const std::filesystem::path& dst_path)
+{
+    auto blob_path = BlobPath(hash);
+    std::shared_lock lock(mutex_);
+    std::error_code ec;
+    if (!std::filesystem::exists(blob_path, ec)) return false;
+    return !LinkBlob(blob_path, dst_path);
+}
+
+void vmpx::app_pack::BlobStore::AddRefs(std::string_view owner, const std::vector<std::string>& hashes)
+{
+    std::set<std::string> unique_hashes(hashes.begin(), hashes.end());
+    std::string str;
+    for (const auto& hash : unique_hashes)
+    {
+        str.append(hash);
+        str.push_back('\n');
+    }
+    std::unique_lock lock(mutex_);
+    WriteFile(std::span(reinterpret_cast<const uint8_t*>(str.data()), str.size()), RefsPath(owner));
+    // 先加新引用再减旧引用，两边都有的blob计数不会短暂归零
+    for (const auto& hash : unique_hashes)
+    {
+        ++ref_counts_[hash];
+    }
+    auto& refs = owner_refs_[std::string{owner}];
+    for (const auto& hash : refs)
+    {
+        if (auto it = ref_counts_.find(hash); it != ref_counts_.end() && --it->second == 0) ref_counts_.erase(it);
+    }
+    refs.assign(unique_hashes.begin(), unique_hashes.end());
+}
+
+void vmpx::app_pack::BlobStore::Release(std::string_view owner)
+{
+    std::unique_lock lock(mutex_);
+    std::error_code ec;
+    std::filesystem::remove(RefsPath(owner), ec);
+    auto node = owner_refs_.extract(std::string{owner});
+    if (node.empty()) return;
+    for (const auto& hash : node.mapped())
+    {
+        if (auto it = ref_counts_.find(hash); it != ref_counts_.end() && --it->second == 0) ref_counts_.erase(it);
+    }
+    CollectLocked(node.mapped());
+}
+
+void vmpx::app_pack::BlobStore::Collect(std::span<const std::string> hashes)
+{
+    std::unique_lock lock(mutex_);
+    CollectLocked(hashes);
+}
+
+void vmpx::app_pack::BlobStore::CollectLocked(std::span<const std::string> hashes)
+{
+    std::error_code ec;
+    for (const auto& hash : hashes)
+    {
+        // 引用记录决定blob是否在用；硬链接数大于1说明有文件已链接但还未记录引用（正在解压、暂存）
+        if (ref_counts_.contains(hash)) continue;
+        auto blob_path = BlobPath(hash);
+        if (std::filesystem::hard_link_count(blob_path, ec) == 1)
+            std::filesystem::remove(blob_path, ec);
+    }
+}
+
+std::filesystem::path vmpx::app_pack::BlobStore::BlobPath(std::string_view hash) const
+{
+    return objects_dir_ / hash.substr(0, 2) / hash;
+}
+
+std::filesystem::path vmpx::app_pack::BlobStore::RefsPath(std::string_view owner) const
+{
+    return refs_dir_ / owner += ".refs";
+}
@@ -0,0 +1,62 @@
+﻿#include "ChunkedStream.h"
+
+#include <string>
+
+vmpx::stream::ChunkedStream::ChunkedStream(hv::HttpResponseWriterPtr writer, std::string_view content_type,
+                                           std::initializer_list<std::pair<std::string_view, std::string_view>>
+                                           headers, size_t max_pending_bytes):
+    writer_(std::move(writer)), max_pending_bytes_(max_pending_bytes), state_(std::make_shared<State>())
+{
+    // 回调在IO线程上调用，只捕获共享的状态，本对象先销毁也无妨；保留原有的回调
+    auto notify = [state = state_]
+    {
+        std::lock_guard lock(state->mutex);
+        state->cv.notify_all();
+    };
+    writer_->onwrite = [notify, onwrite = writer_->onwrite](hv::Buffer* buf)
+    {
+        if (onwrite) onwrite(buf);
+        notify();
+    };
+    writer_->onclose = [notify, onclose = writer_->onclose]
+    {
+        if (onclose) onclose();
+        notify();
+    };
+    writer_->Begin();
+    writer_->WriteHeader("Content-Type", std::string{content_type}.c_str());
+    writer_->WriteHeader("Transfer-Encoding", "chunked");
+    for (const auto& [key, value] : headers)
+    {
+        writer_->WriteHeader(std::string{key}.c_str(), std::string{value}.c_str());
+    }
+    writer_->EndHeaders();
+}
+
+bool vmpx::stream::ChunkedStream::Write(std::string_view data, std::stop_token stop_token)
+{
+    {
+        std::unique_lock lock(state_->mutex);
+        state_->cv.wait(lock, stop_token, [this]
+        {
+            return !writer_->isConnected() || writer_->writeBufsize() <= max_pending_bytes_;
+        });
+    }
+    if (stop_token.stop_requested() || !writer_->isConnected()) return false;
+    return writer_->WriteChunked(data.data(), static_cast<int>(data.size())) >= 0;
+}
+
+void vmpx::stream::ChunkedStream::End()
+{
+    writer_->End();
+}
+
+void vmpx::stream::ChunkedStream::Abort()
+{
+    writer_->close(true);
+}
+
+bool vmpx::stream::ChunkedStream::Connected() const
+{
+    return writer_->isConnected();
+}
@@ -0,0 +1,664 @@
+﻿#include "IssueJobService.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <random>
+#include <ranges>
+
+#include <ylt/struct_json/json_reader.h>
+#include <ylt/struct_json/json_writer.h>
+
+#include "Utils.h"
+
+namespace
+{
+    constexpr std::string_view JOB_FILE_NAME = "job.json";
+    constexpr std::string_view CHECKPOINT_FILE_NAME = "checkpoint.json";
+    constexpr std::string_view CSV_HEADER = "index,user_name,email,ok,serial_number,message\n";
+    constexpr std::string_view UTF8_BOM = "\xEF\xBB\xBF";
+
+    constexpr std::string_view STATE_QUEUED = "queued";
+    constexpr std::string_view STATE_RUNNING = "running";
+    constexpr std::string_view STATE_DONE = "done";
+    constexpr std::string_view STATE_FAILED = "failed";
+    constexpr std::string_view STATE_CANCELLED = "cancelled";
+
+    bool IsFinished(std::string_view state)
+    {
+        return state == STATE_DONE || state == STATE_FAILED || state == STATE_CANCELLED;
+    }
+
+    // 提交后不再变化
+    struct JobMeta
+    {
+        std::string id;
+        uint64_t seq;
+        std::string name;
+        std::string format;
+        vmpx::ProductInfoEntity product_info;
+        bool ignore_network_adapters;
+        uint64_t total_rows;
+    };
+
+    // 每写完一块更新一次
+    struct JobCheckpoint
+    {
+        std::string state;
+        // 下一行在输入文件中的位置
+        uint64_t input_offset;
+        // 已落盘的输出大小，恢复时截掉之后写了一半的部分
+        uint64_t output_bytes;
+        uint64_t rows_done;
+        uint64_t rows_failed;
+        // 累计运行时间
+        uint64_t elapsed_ms;
+        uint64_t resumed;
+        std::string message;
+    };
+
+    // 输出文件中的一行
+    struct IssueRowEntity
+    {
+        uint64_t index;
+        bool ok;
+        std::string user_name;
+        std::string email;
+        std::string serial_number;
+        std::string message;
+    };
+
+    std::string_view FormatName(vmpx::issue::IssueFormat format)
+    {
+        return format == vmpx::issue::IssueFormat::CSV ? "csv" : "ndjson";
+    }
+
+    std::string_view Trim(std::string_view str)
+    {
+        while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front()))) str.remove_prefix(1);
+        while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back()))) str.remove_suffix(1);
+        return str;
+    }
+
+    /**
+     * 解析一行CSV，支持双引号包围和""转义，不支持引号内换行
+     * @param line
+     * @return
+     */
+    std::vector<std::string> SplitCsv(std::string_view line)
+    {
+        std::vector<std::string> fields(1);
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); ++i)
+        {
+            char c = line[i];
+            if (quoted)
+            {
+                if (c != '"') fields.back().push_back(c);
+                else if (i + 1 < line.size() && line[i + 1] == '"') fields.back().push_back(line[++i]);
+                else quoted = false;
+            }
+            else if (c == '"') quoted = true;
+            else if (c == ',') fields.emplace_back();
+            else fields.back().push_back(c);
+        }
+        return fields;
+    }
+
+    void AppendCsvField(std::string& out, std::string_view field)
+    {
+        if (field.find_first_of(",\"\r\n") == std::string_view::npos)
+        {
+            out += field;
+            return;
+        }
+        out.push_back('"');
+        for (char c : field)
+        {
+            if (c == '"') out.push_back('"');
+            out.push_back(c);
+        }
+        out.push_back('"');
+    }
+
+    bool IsCsvHeader(std::string_view line)
+    {
+        auto fields = SplitCsv(line);
+        auto first = Trim(fields.front());
+        return first.size() == 9 && std::ranges::equal(first, std::string_view{"user_name"}, [](char a, char b)
+        {
+            return std::tolower(static_cast<unsigned char>(a)) == b;
+        });
+    }
+
+    /**
+     * YYYY-MM-DD或YYYY/MM/DD
+     */
+    bool ParseDate(std::string_view str, int& year, int& month, int& day)
+    {
+        str = Trim(str);
+        auto parse = [&str](int& value, bool last)
+        {
+            auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+            if (ec != std::errc{}) return false;
+            str.remove_prefix(ptr - str.data());
+            if (last) return str.empty();
+            if (str.empty() || (str.front() != '-' && str.front() != '/')) return false;
+            str.remove_prefix(1);
+            return true;
+        };
+        return parse(year, false) && parse(month, false) && parse(day, true) &&
+            month >= 1 && month <= 12 && day >= 1 && day <= 31;
+    }
+
+    /**
+     * 解析一行输入，失败时serial_info中已解析出的字段仍然有效，用于输出中定位出错的行
+     */
+    std::expected<void, std::string> ParseRow(std::string_view line, vmpx::issue::IssueFormat format,
+                                              vmpx::SerialInfo& serial_info)
+    {
+        if (format == vmpx::issue::IssueFormat::NDJSON)
+        {
+            std::error_code ec;
+            struct_json::from_json(serial_info, line, ec);
+            if (ec) return std::unexpected{std::format("unable to parse json with error: {}", ec.message())};
+            return {};
+        }
+        auto fields = SplitCsv(line);
+        if (fields.size() != 4)
+            return std::unexpected{std::format("expected 4 fields (user_name,email,hwid,exp_date) but got {}",
+                                               fields.size())};
+        serial_info.user_name = Trim(fields[0]);
+        serial_info.email = Trim(fields[1]);
+        serial_info.hwid = Trim(fields[2]);
+        if (!ParseDate(fields[3], serial_info.exp_year, serial_info.exp_month, serial_info.exp_day))
+            return std::unexpected{std::format("invalid exp_date:{}", fields[3])};
+        return {};
+    }
+
+    IssueRowEntity IssueRow(std::string_view line, uint64_t index, vmpx::issue::IssueFormat format,
+                            const vmpx::ProductInfo& product_info, bool ignore_network_adapters)
+    {
+        IssueRowEntity row{.index = index, .ok = false};
+        try
+        {
+            vmpx::SerialInfo serial_info{};
+            auto parsed = ParseRow(line, format, serial_info);
+            row.user_name = serial_info.user_name;
+            row.email = serial_info.email;
+            if (!parsed)
+            {
+                row.message = parsed.error();
+                return row;
+            }
+            if (ignore_network_adapters)
+            {
+                auto hwid = vmpx::HWID::FromBase64(serial_info.hwid);
+                if (!hwid)
+                {
+                    row.message = std::format("unable to parse HWID:{}", hwid.error());
+                    return row;
+                }
+                hwid->network_adapters.clear();
+                serial_info.hwid = hwid->ToBase64();
+            }
+            auto serial_number_info = vmpx::GenSerialNumber(product_info, serial_info);
+            if (!serial_number_info)
+            {
+                row.message = std::format("unable to generate serial number with error:{}",
+                                          serial_number_info.error());
+                return row;
+            }
+            row.ok = true;
+            row.serial_number = std::move(serial_number_info->serial_number);
+        }
+        catch (std::exception& e)
+        {
+            row.message = std::format("unknown error:{}", e.what());
+        }
+        return row;
+    }
+
+    void AppendRow(std::string& out, const IssueRowEntity& row, vmpx::issue::IssueFormat format)
+    {
+        if (format == vmpx::issue::IssueFormat::NDJSON)
+        {
+            struct_json::to_json(row, out);
+            out.push_back('\n');
+            return;
+        }
+        out += std::format("{},", row.index);
+        AppendCsvField(out, row.user_name);
+        out.push_back(',');
+        AppendCsvField(out, row.email);
+        out += row.ok ? ",true," : ",false,";
+        AppendCsvField(out, row.serial_number);
+        out.push_back(',');
+        AppendCsvField(out, row.message);
+        out.push_back('\n');
+    }
+
+    /**
+     * 从输入流读取一行，返回消耗的字节数，包括换行符
+     */
+    uint64_t ReadLine(std::istream& is, std::string& line)
+    {
+        if (!std::getline(is, line)) return 0;
+        uint64_t consumed = line.size() + (is.eof() ? 0 : 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return consumed;
+    }
+
+    template <typename T>
+    bool SaveJson(const T& value, const std::filesystem::path& path)
+    {
+        std::string json;
+        struct_json::to_json(value, json);
+        return vmpx::WriteFileAtomic(std::span(reinterpret_cast<const uint8_t*>(json.data()), json.size()), path);
+    }
+
+    template <typename T>
+    std::optional<T> LoadJson(const std::filesystem::path& path)
+    {
+        auto data = vmpx::ReadFile(path);
+        if (!data) return std::nullopt;
+        T value{};
+        std::error_code ec;
+        struct_json::from_json(value, std::string_view(reinterpret_cast<const char*>(data->data()), data->size()),
+                               ec);
+        if (ec) return std::nullopt;
+        return value;
+    }
+}
+
+struct vmpx::issue::IssueJobService::Job
+{
+    JobMeta meta;
+    // 以下由mutex_保护
+    JobCheckpoint checkpoint;
+    std::chrono::steady_clock::time_point run_begin;
+    uint64_t run_begin_rows;
+
+    IssueFormat format;
+    std::filesystem::path dir;
+    std::atomic_bool cancel{false};
+
+    std::filesystem::path InputPath() const
+    {
+        return dir / std::format("input.{}", meta.format);
+    }
+
+    std::filesystem::path OutputPath() const
+    {
+        return dir / std::format("output.{}", meta.format);
+    }
+
+    bool SaveCheckpoint() const
+    {
+        return SaveJson(checkpoint, dir / CHECKPOINT_FILE_NAME);
+    }
+};
+
+vmpx::issue::IssueJobService::IssueJobService(const std::filesystem::path& root_dir, size_t num_threads,
+                                              uint64_t checkpoint_rows, size_t max_finished_jobs):
+    root_dir_(root_dir),
+    num_threads_(num_threads ? num_threads : std::max(1u, std::thread::hardware_concurrency())),
+    checkpoint_rows_(std::max<uint64_t>(1, checkpoint_rows)),
+    max_finished_jobs_(std::max<size_t>(1, max_finished_jobs))
+{
+    std::filesystem::create_directories(root_dir_);
+    std::error_code ec;
+    std::vector<std::shared_ptr<Job>> pending;
+    for (const auto& dir_entry : std::filesystem::directory_iterator(root_dir_, ec))
+    {
+        if (!dir_entry.is_directory(ec)) continue;
+        auto meta = LoadJson<JobMeta>(dir_entry.path() / JOB_FILE_NAME);
+        auto checkpoint = LoadJson<JobCheckpoint>(dir_entry.path() / CHECKPOINT_FILE_NAME);
+        // 提交时写了一半的目录
+        if (!meta || !checkpoint) continue;
+        auto format = ParseFormat(meta->format);
+        if (!format) continue;
+        auto job = std::make_shared<Job>();
+        job->meta = std::move(*meta);
+        job->checkpoint = std::move(*checkpoint);
+        job->format = *format;
+        job->dir = dir_entry.path();
+        next_seq_ = std::max(next_seq_, job->meta.seq + 1);
+        if (job->checkpoint.state == STATE_RUNNING)
+        {
+            ++job->checkpoint.resumed;
+            job->checkpoint.state = STATE_QUEUED;
+            job->SaveCheckpoint();
+        }
+        if (job->checkpoint.state == STATE_QUEUED) pending.push_back(job);
+        jobs_.emplace(job->meta.id, std::move(job));
+    }
+    std::ranges::sort(pending, {}, [](const auto& job) { return job->meta.seq; });
+    queue_.assign(pending.begin(), pending.end());
+    {
+        std::lock_guard lock(mutex_);
+        PruneFinishedLocked();
+    }
+    runner_ = std::jthread([this](std::stop_token stop_token) { RunLoop(stop_token); });
+}
+
+vmpx::issue::IssueJobService::~IssueJobService()
+{
+    runner_.request_stop();
+    cv_.notify_all();
+    if (runner_.joinable()) runner_.join();
+}
+
+std::expected<vmpx::issue::IssueJobInfo, std::string> vmpx::issue::IssueJobService::Submit(
+    std::string_view name, const ProductInfoEntity& product_info, IssueFormat format,
+    std::span<const uint8_t> input, bool ignore_network_adapters)
+{
+    std::string_view text(reinterpret_cast<const char*>(input.data()), input.size());
+    // 数据从第一行非表头开始，Excel导出的CSV带BOM
+    uint64_t data_offset = text.starts_with(UTF8_BOM) ? UTF8_BOM.size() : 0;
+    uint64_t total_rows = 0;
+    for (size_t pos = data_offset; pos < text.size();)
+    {
+        auto end = std::min(text.find('\n', pos), text.size());
+        auto line = Trim(text.substr(pos, end - pos));
+        if (!line.empty())
+        {
+            if (total_rows == 0 && format == IssueFormat::CSV && IsCsvHeader(line)) data_offset = end + 1;
+            else ++total_rows;
+        }
+        pos = end + 1;
+    }
+    if (total_rows == 0) return std::unexpected{"input has no rows"};
+
+    auto job = std::make_shared<Job>();
+    job->format = format;
+    job->meta = JobMeta{
+        .name = std::string{name}, .format = std::string{FormatName(format)}, .product_info = product_info,
+        .ignore_network_adapters = ignore_network_adapters, .total_rows = total_rows
+    };
+    job->checkpoint = JobCheckpoint{.state = std::string{STATE_QUEUED}, .input_offset = data_offset};
+    {
+        std::lock_guard lock(mutex_);
+        job->meta.seq = next_seq_++;
+    }
+    std::mt19937_64 rng{std::random_device{}()};
+    job->meta.id = std::format("{:06}-{:08x}", job->meta.seq, static_cast<uint32_t>(rng()));
+    job->dir = root_dir_ / job->meta.id;
+    std::error_code ec;
+    std::filesystem::create_directories(job->dir, ec);
+    if (ec) return std::unexpected{std::format("unable to create job directory:{}", ec.message())};
+    // 检查点最后写，载入时没有检查点的目录会被忽略
+    if (!WriteFile(input, job->InputPath()) || !SaveJson(job->meta, job->dir / JOB_FILE_NAME) ||
+        !job->SaveCheckpoint())
+    {
+        std::filesystem::remove_all(job->dir, ec);
+        return std::unexpected{"unable to save job files"};
+    }
+    IssueJobInfo info;
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.emplace(job->meta.id, job);
+        queue_.push_back(job);
+        info = MakeInfo(*job);
+    }
+    cv_.notify_one();
+    return info;
+}
+
+std::expected<vmpx::issue::IssueJobInfo, std::string> vmpx::issue::IssueJobService::Get(std::string_view id) const
+{
+    std::lock_guard lock(mutex_);
+    auto it = jobs_.find(std::string{id});
+    if (it == jobs_.end()) return std::unexpected{std::format("job not found:{}", id)};
+    return MakeInfo(*it->second);
+}
+
+std::vector<vmpx::issue::IssueJobInfo> vmpx::issue::IssueJobService::List() const
+{
+    std::lock_guard lock(mutex_);
+    std::vector<const Job*> jobs;
+    jobs.reserve(jobs_.size());
+    for (const auto& job : jobs_ | std::views::values)
+    {
+        jobs.push_back(job.get());
+    }
+    std::ranges::sort(jobs, {}, [](const Job* job) { return job->meta.seq; });
+    std::vector<IssueJobInfo> infos;
+    infos.reserve(jobs.size());
+    for (const auto* job : jobs)
+    {
+        infos.push_back(MakeInfo(*job));
+    }
+    return infos;
+}
+
+bool vmpx::issue::IssueJobService::Cancel(std::string_view id)
+{
+    std::lock_guard lock(mutex_);
+    auto it = jobs_.find(std::string{id});
+    if (it == jobs_.end()) return false;
+    auto& job = it->second;
+    if (job->checkpoint.state == STATE_RUNNING)
+    {
+        // 由运行线程写检查点
+        job->cancel = true;
+        return true;
+    }
+    if (job->checkpoint.state != STATE_QUEUED) return false;
+    std::erase(queue_, job);
+    job->checkpoint.state = STATE_CANCELLED;
+    job->SaveCheckpoint();
+    PruneFinishedLocked();
+    return true;
+}
+
+std::expected<void, std::string> vmpx::issue::IssueJobService::Remove(std::string_view id)
+{
+    std::lock_guard lock(mutex_);
+    auto it = jobs_.find(std::string{id});
+    if (it == jobs_.end()) return std::unexpected{std::format("job not found:{}", id)};
+    if (!IsFinished(it->second->checkpoint.state))
+        return std::unexpected{std::format("job is {}, cancel it first", it->second->checkpoint.state)};
+    std::error_code ec;
+    std::filesystem::remove_all(it->second->dir, ec);
+    if (ec) return std::unexpected{std::format("unable to remove job files:{}", ec.message())};
+    jobs_.erase(it);
+    return {};
+}
+
+std::expected<std::filesystem::path, std::string> vmpx::issue::IssueJobService::OutputPath(
+    std::string_view id) const
+{
+    std::lock_guard lock(mutex_);
+    auto it = jobs_.find(std::string{id});
+    if (it == jobs_.end()) return std::unexpected{std::format("job not found:{}", id)};
+    if (it->second->checkpoint.state != STATE_DONE)
+        return std::unexpected{std::format("job is {}", it->second->checkpoint.state)};
+    return it->second->OutputPath();
+}
+
+std::expected<vmpx::issue::IssueFormat, std::string> vmpx::issue::IssueJobService::ParseFormat(
+    std::string_view format)
+{
+    if (format == "csv") return IssueFormat::CSV;
+    if (format == "ndjson") return IssueFormat::NDJSON;
+    return std::unexpected{std::format("unsupported format:{}", format)};
+}
+
+void vmpx::issue::IssueJobService::RunLoop(std::stop_token stop_token)
+{
+    while (true)
+    {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock lock(mutex_);
+            if (!cv_.wait(lock, stop_token, [this] { return !queue_.empty(); })) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+            job->checkpoint.state = STATE_RUNNING;
+            job->run_begin = std::chrono::steady_clock::now();
+            job->run_begin_rows = job->checkpoint.rows_done;
+            job->SaveCheckpoint();
+        }
+        RunJob(*job, stop_token);
+        if (stop_token.stop_requested()) return;
+    }
+}
+
+void vmpx::issue::IssueJobService::RunJob(Job& job, std::stop_token stop_token)
+{
+    auto finish = [this, &job](std::string_view state, std::string message = {})
+    {
+        std::lock_guard lock(mutex_);
+        job.checkpoint.state = state;
+        job.checkpoint.message = std::move(message);
+        job.SaveCheckpoint();
+        PruneFinishedLocked();
+    };
+    auto product_info = job.meta.product_info.ToProductInfo();
+    if (!product_info) return finish(STATE_FAILED, std::format("invalid product info:{}", product_info.error()));
+    std::ifstream input(job.InputPath(), std::ios::binary);
+    if (!input.is_open()) return finish(STATE_FAILED, "unable to open input file");
+    input.seekg(static_cast<std::streamoff>(job.checkpoint.input_offset));
+    // 上次崩溃时最后一块可能只写了一部分
+    auto output_path = job.OutputPath();
+    std::error_code ec;
+    if (std::filesystem::exists(output_path, ec))
+        std::filesystem::resize_file(output_path, job.checkpoint.output_bytes, ec);
+    if (ec) return finish(STATE_FAILED, std::format("unable to truncate output file:{}", ec.message()));
+    std::FILE* output = OpenFile(output_path, "ab");
+    if (!output) return finish(STATE_FAILED, "unable to open output file");
+    std::string block;
+    if (job.checkpoint.output_bytes == 0 && job.format == IssueFormat::CSV) block = CSV_HEADER;
+
+    std::vector<std::string> lines;
+    std::vector<IssueRowEntity> rows;
+    std::string line;
+    while (!stop_token.stop_requested())
+    {
+        if (job.cancel)
+        {
+            std::fclose(output);
+            return finish(STATE_CANCELLED);
+        }
+        auto block_begin = std::chrono::steady_clock::now();
+        lines.clear();
+        uint64_t consumed = 0;
+        while (lines.size() < checkpoint_rows_)
+        {
+            auto line_bytes = ReadLine(input, line);
+            if (line_bytes == 0) break;
+            consumed += line_bytes;
+            if (!Trim(line).empty()) lines.push_back(line);
+        }
+        if (lines.empty()) break;
+
+        // 每个线程隔行处理，结果按下标存放，写出时保持输入顺序
+        rows.assign(lines.size(), IssueRowEntity{});
+        std::atomic_bool aborted{false};
+        {
+            auto num_threads = std::min<size_t>(num_threads_, lines.size());
+            std::vector<std::jthread> workers;
+            workers.reserve(num_threads);
+            for (size_t t = 0; t < num_threads; ++t)
+            {
+                workers.emplace_back([&, t]
+                {
+                    for (size_t i = t; i < lines.size(); i += num_threads)
+                    {
+                        if (stop_token.stop_requested() || job.cancel)
+                        {
+                            aborted = true;
+                            return;
+                        }
+                        rows[i] = IssueRow(lines[i], job.checkpoint.rows_done + i, job.format, *product_info,
+                                           job.meta.ignore_network_adapters);
+                    }
+                });
+            }
+        }
+        // 不完整的块不写出，检查点之后的行下次重新生成
+        if (aborted) continue;
+
+        uint64_t failed = 0;
+        for (const auto& row : rows)
+        {
+            AppendRow(block, row, job.format);
+            if (!row.ok) ++failed;
+        }
+        if (std::fwrite(block.data(), 1, block.size(), output) != block.size() || !SyncFile(output))
+        {
+            std::fclose(output);
+            return finish(STATE_FAILED, "unable to write output file");
+        }
+        {
+            std::lock_guard lock(mutex_);
+            job.checkpoint.input_offset += consumed;
+            job.checkpoint.output_bytes += block.size();
+            job.checkpoint.rows_done += lines.size();
+            job.checkpoint.rows_failed += failed;
+            job.checkpoint.elapsed_ms += std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - block_begin).count();
+            job.SaveCheckpoint();
+        }
+        block.clear();
+    }
+    std::fclose(output);
+    // 停止服务时保持running，下次启动时恢复
+    if (stop_token.stop_requested()) return;
+    // 最后一块写完后才取消的也按取消处理，Cancel在锁内检查状态，两者不会错过
+    std::lock_guard lock(mutex_);
+    job.checkpoint.state = job.cancel ? STATE_CANCELLED : STATE_DONE;
+    job.SaveCheckpoint();
+    PruneFinishedLocked();
+}
+
+vmpx::issue::IssueJobInfo vmpx::issue::IssueJobService::MakeInfo(const Job& job) const
+{
+    const auto& checkpoint = job.checkpoint;
+    IssueJobInfo info{
+        .id = job.meta.id, .name = job.meta.name, .format = job.meta.format, .state = checkpoint.state,
+        .total_rows = job.meta.total_rows, .rows_done = checkpoint.rows_done,
+        .rows_failed = checkpoint.rows_failed, .rows_per_second = 0, .elapsed_ms = checkpoint.elapsed_ms,
+        .eta_ms = 0, .resumed = checkpoint.resumed, .message = checkpoint.message
+    };
+    if (checkpoint.state == STATE_RUNNING)
+    {
+        auto run_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - job.run_begin).count();
+        if (run_ms > 0)
+            info.rows_per_second = static_cast<double>(checkpoint.rows_done - job.run_begin_rows) * 1000.0 /
+                static_cast<double>(run_ms);
+    }
+    else if (checkpoint.elapsed_ms > 0)
+    {
+        info.rows_per_second = static_cast<double>(checkpoint.rows_done) * 1000.0 /
+            static_cast<double>(checkpoint.elapsed_ms);
+    }
+    if (info.rows_per_second > 0 && info.total_rows > info.rows_done)
+        info.eta_ms = static_cast<uint64_t>(static_cast<double>(info.total_rows - info.rows_done) * 1000.0 /
+            info.rows_per_second);
+    return info;
+}
+
+void vmpx::issue::IssueJobService::PruneFinishedLocked()
+{
+    std::vector<std::shared_ptr<Job>> finished;
+    for (const auto& job : jobs_ | std::views::values)
+    {
+        if (IsFinished(job->checkpoint.state)) finished.push_back(job);
+    }
+    if (finished.size() <= max_finished_jobs_) return;
+    std::ranges::sort(finished, {}, [](const auto& job) { return job->meta.seq; });
+    finished.resize(finished.size() - max_finished_jobs_);
+    for (const auto& job : finished)
+    {
+        // 删不掉的目录（如文件正在下载）下次启动时再删
+        std::error_code ec;
+        std::filesystem::remove_all(job->dir, ec);
+        jobs_.erase(job->meta.id);
+    }
+}
@@ -0,0 +1,202 @@
+﻿#include "PackCache.h"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <fstream>
+#include <ranges>
+#include <vector>
+
+#include <cryptopp/sha.h>
+#include <cryptopp/hex.h>
+#include <cryptopp/filters.h>
+
+namespace
+{
+    constexpr std::string_view CACHE_KEY_VERSION = "vmpx-pack-cache-v1";
+
+    bool HashFile(CryptoPP::SHA256& sha, const std::filesystem::path& path)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open()) return false;
+        std::array<char, 64 * 1024> buffer{};
+        while (ifs)
+        {
+            ifs.read(buffer.data(), buffer.size());
+            sha.Update(reinterpret_cast<const CryptoPP::byte*>(buffer.data()), static_cast<size_t>(ifs.gcount()));
+        }
+        return ifs.eof();
+    }
+
+    void HashString(CryptoPP::SHA256& sha, std::string_view str)
+    {
+        // 带上长度，避免相邻字段拼接产生歧义
+        uint64_t size = str.size();
+        sha.Update(reinterpret_cast<const CryptoPP::byte*>(&size), sizeof(size));
+        sha.Update(reinterpret_cast<const CryptoPP::byte*>(str.data()), str.size());
+    }
+
+    std::string HexDigest(CryptoPP::SHA256& sha)
+    {
+        using namespace CryptoPP;
+        std::string digest(SHA256::DIGESTSIZE, '\0');
+        sha.Final(reinterpret_cast<byte*>(digest.data()));
+        std::string hex;
+        StringSource ss(digest, true, new HexEncoder(new StringSink(hex), false));
+        return hex;
+    }
+
+    uint64_t DirectorySize(const std::filesystem::path& dir)
+    {
+        uint64_t bytes = 0;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(dir, ec))
+        {
+            if (entry.is_regular_file(ec)) bytes += entry.file_size(ec);
+        }
+        return bytes;
+    }
+
+    bool LinkOrCopy(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(to.parent_path(), ec);
+        std::filesystem::remove(to, ec);
+        std::filesystem::create_hard_link(from, to, ec);
+        if (!ec) return true;
+        ec.clear();
+        std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, ec);
+        return !ec;
+    }
+}
+
+vmpx::app_pack::PackCache::PackCache(const std::filesystem::path& root_dir,
+                                     const std::filesystem::path& vmp_console_app_path,
+                                     uint64_t max_bytes, uint64_t max_entries):
+    root_dir_(root_dir), max_bytes_(max_bytes), max_entries_(max_entries)
+{
+    if (!std::filesystem::exists(root_dir_))std::filesystem::create_directories(root_dir_);
+    // 加壳程序升级后，旧的缓存全部失效
+    {
+        CryptoPP::SHA256 sha;
+        HashString(sha, CACHE_KEY_VERSION);
+        if (!HashFile(sha, vmp_console_app_path))
+            HashString(sha, vmp_console_app_path.string());
+        packer_identity_ = HexDigest(sha);
+    }
+    // 载入已有条目，写了一半的临时目录直接删除
+    std::error_code ec;
+    for (const auto& dir_entry : std::filesystem::directory_iterator(root_dir_, ec))
+    {
+        if (!dir_entry.is_directory(ec)) continue;
+        auto key = dir_entry.path().filename().string();
+        if (key.ends_with(".tmp"))
+        {
+            std::filesystem::remove_all(dir_entry.path(), ec);
+            continue;
+        }
+        entries_.emplace(key, Entry{DirectorySize(dir_entry.path()), dir_entry.last_write_time(ec)});
+        stats_.bytes += entries_[key].bytes;
+    }
+    stats_.entries = entries_.size();
+    std::lock_guard lock(mutex_);
+    EvictLocked();
+}
+
+std::expected<std::string, std::string> vmpx::app_pack::PackCache::Key(
+    const std::filesystem::path& vmp_file_path, const std::filesystem::path& input_file_path,
+    std::string_view output_file_name) const
+{
+    CryptoPP::SHA256 sha;
+    HashString(sha, packer_identity_);
+    HashString(sha, std::filesystem::path(output_file_name).filename().string());
+    if (!HashFile(sha, vmp_file_path))
+        return std::unexpected{std::format("unable to read vmp file:{}", vmp_file_path.string())};
+    if (!HashFile(sha, input_file_path))
+        return std::unexpected{std::format("unable to read input file:{}", input_file_path.string())};
+    return HexDigest(sha);
+}
+
+bool vmpx::app_pack::PackCache::Fetch(std::string_view key, const std::filesystem::path& dst_path)
+{
+    std::lock_guard lock(mutex_);
+    auto it = entries_.find(std::string{key});
+    if (it == entries_.end())
+    {
+        ++stats_.misses;
+        return false;
+    }
+    auto artifact_path = EntryPath(key) / dst_path.filename();
+    if (!LinkOrCopy(artifact_path, dst_path))
+    {
+        ++stats_.misses;
+        return false;
+    }
+    std::error_code ec;
+    it->second.last_used = std::filesystem::file_time_type::clock::now();
+    std::filesystem::last_write_time(EntryPath(key), it->second.last_used, ec);
+    ++stats_.hits;
+    return true;
+}
+
+void vmpx::app_pack::PackCache::Store(std::string_view key, const std::filesystem::path& artifact_path)
+{
+    auto entry_path = EntryPath(key);
+    auto tmp_path = entry_path;
+    tmp_path += ".tmp";
+    std::error_code ec;
+    std::filesystem::remove_all(tmp_path, ec);
+    if (!LinkOrCopy(artifact_path, tmp_path / artifact_path.filename())) return;
+    auto bytes = std::filesystem::file_size(tmp_path / artifact_path.filename(), ec);
+    std::lock_guard lock(mutex_);
+    if (entries_.contains(std::string{key}))
+    {
+        std::filesystem::remove_all(tmp_path, ec);
+        return;
+    }
+    std::filesystem::rename(tmp_path, entry_path, ec);
+    if (ec)
+    {
+        std::filesystem::remove_all(tmp_path, ec);
+        return;
+    }
+    entries_.emplace(std::string{key}, Entry{bytes, std::filesystem::file_time_type::clock::now()});
+    ++stats_.stores;
+    ++stats_.entries;
+    stats_.bytes += bytes;
+    EvictLocked();
+}
+
+vmpx::app_pack::PackCacheStats vmpx::app_pack::PackCache::Stats() const
+{
+    std::lock_guard lock(mutex_);
+    return stats_;
+}
+
+std::filesystem::path vmpx::app_pack::PackCache::EntryPath(std::string_view key) const
+{
+    return root_dir_ / key;
+}
+
+void vmpx::app_pack::PackCache::EvictLocked()
+{
+    if (stats_.bytes <= max_bytes_ && entries_.size() <= max_entries_) return;
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>> lru;
+    lru.reserve(entries_.size());
+    for (const auto& [key, entry] : entries_)
+    {
+        lru.emplace_back(entry.last_used, key);
+    }
+    std::ranges::sort(lru);
+    std::error_code ec;
+    for (const auto& key : lru | std::views::values)
+    {
+        if (stats_.bytes <= max_bytes_ && entries_.size() <= max_entries_) break;
+        auto it = entries_.find(key);
+        std::filesystem::remove_all(EntryPath(key), ec);
+        stats_.bytes -= it->second.bytes;
+        entries_.erase(it);
+        ++stats_.evictions;
+    }
+    stats_.entries = entries_.size();
+}
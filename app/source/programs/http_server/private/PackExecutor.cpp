@@ -0,0 +1,126 @@
+﻿#include "PackExecutor.h"
+
+#include <algorithm>
+#include <format>
+#include <ranges>
+
+vmpx::app_pack::PackExecutor::PackExecutor(size_t max_concurrency, std::chrono::milliseconds timeout):
+    timeout_(timeout), start_time_(std::chrono::steady_clock::now())
+{
+    if (max_concurrency == 0) max_concurrency = std::max(1u, std::thread::hardware_concurrency());
+    metrics_.max_concurrency = max_concurrency;
+    workers_.reserve(max_concurrency);
+    for (size_t i = 0; i < max_concurrency; ++i)
+    {
+        workers_.emplace_back([this](std::stop_token stop_token) { WorkerLoop(stop_token); });
+    }
+}
+
+vmpx::app_pack::PackExecutor::~PackExecutor()
+{
+    {
+        std::lock_guard lock(mutex_);
+        for (auto& task : queue_ | std::views::values)
+        {
+            task->promise.set_value(std::unexpected{"pack executor stopped"});
+        }
+        queue_.clear();
+        for (auto& task : running_ | std::views::values)
+        {
+            task->stop_source.request_stop();
+        }
+    }
+    for (auto& worker : workers_)
+    {
+        worker.request_stop();
+    }
+    cv_.notify_all();
+    workers_.clear();
+}
+
+vmpx::app_pack::PackTicket vmpx::app_pack::PackExecutor::Submit(Job job, PackPriority priority)
+{
+    auto task = std::make_shared<Task>();
+    task->job = std::move(job);
+    task->submit_time = std::chrono::steady_clock::now();
+    PackTicket ticket;
+    ticket.result = task->promise.get_future().share();
+    {
+        std::lock_guard lock(mutex_);
+        task->id = next_id_++;
+        ticket.id = task->id;
+        queue_.emplace(QueueKey{-static_cast<int>(priority), task->id}, task);
+        ++metrics_.submitted;
+    }
+    cv_.notify_one();
+    return ticket;
+}
+
+bool vmpx::app_pack::PackExecutor::Cancel(uint64_t id)
+{
+    std::lock_guard lock(mutex_);
+    if (auto it = running_.find(id); it != running_.end())
+    {
+        // 由PackApp负责杀掉进程，结果由工作线程设置
+        return it->second->stop_source.request_stop();
+    }
+    auto it = std::ranges::find_if(queue_, [id](const auto& item) { return item.first.second == id; });
+    if (it == queue_.end()) return false;
+    it->second->promise.set_value(std::unexpected{"pack cancelled"});
+    queue_.erase(it);
+    ++metrics_.cancelled;
+    return true;
+}
+
+vmpx::app_pack::PackExecutorMetrics vmpx::app_pack::PackExecutor::Metrics() const
+{
+    std::lock_guard lock(mutex_);
+    auto metrics = metrics_;
+    metrics.queued = queue_.size();
+    metrics.running = running_.size();
+    auto uptime_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_time_).count();
+    if (uptime_ms > 0)
+        metrics.utilisation = static_cast<double>(metrics.busy_ms) /
+            static_cast<double>(uptime_ms * metrics.max_concurrency);
+    return metrics;
+}
+
+void vmpx::app_pack::PackExecutor::WorkerLoop(std::stop_token stop_token)
+{
+    while (true)
+    {
+        std::shared_ptr<Task> task;
+        {
+            std::unique_lock lock(mutex_);
+            if (!cv_.wait(lock, stop_token, [this] { return !queue_.empty(); })) return;
+            auto it = queue_.begin();
+            task = std::move(it->second);
+            queue_.erase(it);
+            running_.emplace(task->id, task);
+            metrics_.queue_wait_ms += std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - task->submit_time).count();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        PackResult result;
+        try
+        {
+            result = task->job(PackOptions{.timeout = timeout_, .stop_token = task->stop_source.get_token()});
+        }
+        catch (std::exception& e)
+        {
+            result = std::unexpected{std::format("pack job threw an exception:{}", e.what())};
+        }
+        auto elapsed = std::chrono::steady_clock::now() - begin;
+        {
+            std::lock_guard lock(mutex_);
+            running_.erase(task->id);
+            metrics_.busy_ms += std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+            if (result) ++metrics_.completed;
+            else if (task->stop_source.stop_requested()) ++metrics_.cancelled;
+            else if (elapsed >= timeout_) ++metrics_.timed_out;
+            else ++metrics_.failed;
+        }
+        task->promise.set_value(std::move(result));
+    }
+}
@@ -0,0 +1,69 @@
+﻿#include "PackProgressHub.h"
+
+#include <algorithm>
+
+#include <ylt/struct_json/json_writer.h>
+
+namespace
+{
+    constexpr std::string_view SSE_EVENT_NAME = "progress";
+}
+
+void vmpx::app_pack::PackProgressHub::Publish(std::string_view name, const PackEvent& event)
+{
+    std::string data;
+    struct_json::to_json(event, data);
+    std::lock_guard lock(mutex_);
+    auto& channel = channels_[std::string{name}];
+    // 新一轮加壳，丢弃上一轮的事件
+    if (event.phase == "queued")
+    {
+        channel.backlog.clear();
+        channel.done = false;
+    }
+    channel.backlog.push_back(data);
+    // 保留第一个事件，其余按时间淘汰
+    if (channel.backlog.size() > MAX_BACKLOG) channel.backlog.erase(channel.backlog.begin() + 1);
+    std::erase_if(channel.subscribers, [](const auto& writer) { return !writer->isConnected(); });
+    for (const auto& writer : channel.subscribers)
+    {
+        writer->SSEvent(data, SSE_EVENT_NAME.data());
+        if (event.done) writer->End();
+    }
+    // 本轮的事件已全部发出，订阅者也都已关闭，下一轮从queued重新开始
+    if (event.done) channels_.erase(std::string{name});
+}
+
+void vmpx::app_pack::PackProgressHub::Subscribe(std::string_view name, const hv::HttpResponseWriterPtr& writer)
+{
+    writer->Begin();
+    writer->WriteHeader("Content-Type", "text/event-stream");
+    writer->WriteHeader("Cache-Control", "no-cache");
+    writer->EndHeaders();
+    std::lock_guard lock(mutex_);
+    // 没有加壳时不会再有Publish，断开的订阅只能在这里清理
+    PruneLocked();
+    auto& channel = channels_[std::string{name}];
+    if (channel.done)
+    {
+        // 没有进行中的加壳，等待下一轮开始
+        channel.backlog.clear();
+        channel.subscribers.push_back(writer);
+        return;
+    }
+    for (const auto& data : channel.backlog)
+    {
+        writer->SSEvent(data, SSE_EVENT_NAME.data());
+    }
+    channel.subscribers.push_back(writer);
+}
+
+void vmpx::app_pack::PackProgressHub::PruneLocked()
+{
+    std::erase_if(channels_, [](auto& item)
+    {
+        auto& channel = item.second;
+        std::erase_if(channel.subscribers, [](const auto& writer) { return !writer->isConnected(); });
+        return channel.done && channel.subscribers.empty();
+    });
+}
@@ -0,0 +1,80 @@
+﻿#include "Rcu.h"
+
+struct vmpx::app_pack::RcuDomain::LocalSlot
+{
+    ReaderSlot* slot = Instance().AcquireSlot();
+
+    ~LocalSlot()
+    {
+        slot->in_use.store(false, std::memory_order_release);
+    }
+};
+
+vmpx::app_pack::RcuDomain& vmpx::app_pack::RcuDomain::Instance()
+{
+    static RcuDomain domain;
+    return domain;
+}
+
+vmpx::app_pack::RcuDomain::~RcuDomain()
+{
+    auto* slot = slots_.load();
+    while (slot)
+    {
+        delete std::exchange(slot, slot->next);
+    }
+}
+
+vmpx::app_pack::RcuDomain::ReadGuard::ReadGuard()
+{
+    auto& slot = CurrentSlot();
+    if (slot.depth++ != 0) return;
+    // 与写者的指针替换、epoch推进之间需要全序，否则写者可能看不到刚进入的读者
+    slot.epoch.store(Instance().epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+vmpx::app_pack::RcuDomain::ReadGuard::~ReadGuard()
+{
+    auto& slot = CurrentSlot();
+    if (--slot.depth != 0) return;
+    slot.epoch.store(0, std::memory_order_release);
+}
+
+uint64_t vmpx::app_pack::RcuDomain::Advance()
+{
+    return epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+}
+
+bool vmpx::app_pack::RcuDomain::Quiescent(uint64_t epoch) const
+{
+    for (auto* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next)
+    {
+        auto reader_epoch = slot->epoch.load(std::memory_order_seq_cst);
+        if (reader_epoch != 0 && reader_epoch < epoch) return false;
+    }
+    return true;
+}
+
+vmpx::app_pack::RcuDomain::ReaderSlot& vmpx::app_pack::RcuDomain::CurrentSlot()
+{
+    thread_local LocalSlot local_slot;
+    return *local_slot.slot;
+}
+
+vmpx::app_pack::RcuDomain::ReaderSlot* vmpx::app_pack::RcuDomain::AcquireSlot()
+{
+    for (auto* slot = slots_.load(std::memory_order_acquire); slot; slot = slot->next)
+    {
+        bool expected = false;
+        if (!slot->in_use.load(std::memory_order_relaxed) &&
+            slot->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return slot;
+    }
+    auto* slot = new ReaderSlot;
+    slot->in_use.store(true, std::memory_order_relaxed);
+    slot->next = slots_.load(std::memory_order_relaxed);
+    while (!slots_.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return slot;
+}
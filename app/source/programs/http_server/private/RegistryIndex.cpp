@@ -0,0 +1,182 @@
+﻿#include "RegistryIndex.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+    auto EntryLess = [](const vmpx::app_pack::RegistryEntry& entry, std::string_view name)
+    {
+        return entry.name < name;
+    };
+}
+
+vmpx::app_pack::RegistryIndex vmpx::app_pack::RegistryIndex::FromPages(std::vector<PagePtr> pages,
+                                                                       uint64_t version)
+{
+    RegistryIndex index;
+    index.version_ = version;
+    index.changes_floor_ = version;
+    std::erase_if(pages, [](const PagePtr& page) { return !page || page->entries.empty(); });
+    index.fences_.reserve(pages.size());
+    for (const auto& page : pages)
+    {
+        index.fences_.push_back(page->entries.front().name);
+        index.size_ += page->entries.size();
+    }
+    index.pages_ = std::move(pages);
+    return index;
+}
+
+const vmpx::app_pack::AppInfo* vmpx::app_pack::RegistryIndex::Find(std::string_view name) const
+{
+    if (pages_.empty()) return nullptr;
+    const auto& entries = pages_[PageIndex(name)]->entries;
+    auto it = std::lower_bound(entries.begin(), entries.end(), name, EntryLess);
+    if (it == entries.end() || it->name != name) return nullptr;
+    return &it->app_info;
+}
+
+void vmpx::app_pack::RegistryIndex::Put(std::string_view name, AppInfo app_info)
+{
+    if (pages_.empty())
+    {
+        auto page = std::make_shared<RegistryPage>();
+        page->entries.push_back({std::string{name}, std::move(app_info)});
+        pages_.push_back(std::move(page));
+        fences_.emplace_back(name);
+        size_ = 1;
+        RecordChange(name, true);
+        return;
+    }
+    auto page_index = PageIndex(name);
+    auto page = std::make_shared<RegistryPage>(*pages_[page_index]);
+    auto it = std::lower_bound(page->entries.begin(), page->entries.end(), name, EntryLess);
+    if (it != page->entries.end() && it->name == name)
+    {
+        it->app_info = std::move(app_info);
+        SetPage(page_index, std::move(page));
+        ++version_;
+        return;
+    }
+    page->entries.insert(it, {std::string{name}, std::move(app_info)});
+    ++size_;
+    RecordChange(name, true);
+    if (page->entries.size() <= MAX_PAGE_ENTRIES)
+    {
+        SetPage(page_index, std::move(page));
+        return;
+    }
+    auto right = std::make_shared<RegistryPage>();
+    auto middle = page->entries.begin() + static_cast<ptrdiff_t>(page->entries.size() / 2);
+    right->entries.assign(std::make_move_iterator(middle), std::make_move_iterator(page->entries.end()));
+    page->entries.erase(middle, page->entries.end());
+    SetPage(page_index, std::move(page));
+    fences_.insert(fences_.begin() + static_cast<ptrdiff_t>(page_index) + 1, right->entries.front().name);
+    pages_.insert(pages_.begin() + static_cast<ptrdiff_t>(page_index) + 1, std::move(right));
+}
+
+bool vmpx::app_pack::RegistryIndex::Erase(std::string_view name)
+{
+    if (pages_.empty()) return false;
+    auto page_index = PageIndex(name);
+    const auto& entries = pages_[page_index]->entries;
+    auto it = std::lower_bound(entries.begin(), entries.end(), name, EntryLess);
+    if (it == entries.end() || it->name != name) return false;
+    --size_;
+    RecordChange(name, false);
+    if (entries.size() == 1)
+    {
+        pages_.erase(pages_.begin() + static_cast<ptrdiff_t>(page_index));
+        fences_.erase(fences_.begin() + static_cast<ptrdiff_t>(page_index));
+        return true;
+    }
+    auto page = std::make_shared<RegistryPage>();
+    page->entries.reserve(entries.size() - 1);
+    page->entries.insert(page->entries.end(), entries.begin(), it);
+    page->entries.insert(page->entries.end(), it + 1, entries.end());
+    SetPage(page_index, std::move(page));
+    return true;
+}
+
+vmpx::app_pack::AppListPage vmpx::app_pack::RegistryIndex::List(std::string_view prefix, std::string_view cursor,
+                                                                size_t limit) const
+{
+    AppListPage result{{}, {}, version_};
+    if (pages_.empty() || limit == 0) return result;
+    // 从prefix与cursor中较大者开始，cursor本身不含
+    bool after_cursor = !cursor.empty() && cursor >= prefix;
+    auto start = after_cursor ? cursor : prefix;
+    for (auto page_index = PageIndex(start); page_index < pages_.size(); ++page_index)
+    {
+        const auto& entries = pages_[page_index]->entries;
+        auto it = std::lower_bound(entries.begin(), entries.end(), start, EntryLess);
+        if (after_cursor && it != entries.end() && it->name == start) ++it;
+        for (; it != entries.end(); ++it)
+        {
+            // 排序后以prefix开头的名字是连续的
+            if (!it->name.starts_with(prefix)) return result;
+            if (result.names.size() == limit)
+            {
+                result.next_cursor = result.names.back();
+                return result;
+            }
+            result.names.push_back(it->name);
+        }
+    }
+    return result;
+}
+
+vmpx::app_pack::AppListDelta vmpx::app_pack::RegistryIndex::Delta(uint64_t since) const
+{
+    AppListDelta delta{version_, false, {}, {}};
+    if (since >= version_) return delta;
+    // 记录不足以覆盖since之后的所有变化
+    if (since < changes_floor_)
+    {
+        delta.full = true;
+        delta.added.reserve(size_);
+        ForEach([&delta](const RegistryEntry& entry) { delta.added.push_back(entry.name); });
+        return delta;
+    }
+    // 同一名字多次增删时，只看since之前是否存在与现在是否存在
+    std::unordered_map<std::string_view, std::pair<bool, bool>> membership;
+    auto begin = std::upper_bound(changes_.begin(), changes_.end(), since,
+                                  [](uint64_t value, const RegistryChange& change) { return value < change.version; });
+    for (auto it = begin; it != changes_.end(); ++it)
+    {
+        auto [membership_it, inserted] = membership.try_emplace(it->name, !it->added, it->added);
+        if (!inserted) membership_it->second.second = it->added;
+    }
+    for (const auto& [name, state] : membership)
+    {
+        auto [existed, exists] = state;
+        if (!existed && exists) delta.added.emplace_back(name);
+        else if (existed && !exists) delta.removed.emplace_back(name);
+    }
+    std::ranges::sort(delta.added);
+    std::ranges::sort(delta.removed);
+    return delta;
+}
+
+size_t vmpx::app_pack::RegistryIndex::PageIndex(std::string_view name) const
+{
+    auto it = std::upper_bound(fences_.begin(), fences_.end(), name,
+                               [](std::string_view value, const std::string& fence) { return value < fence; });
+    if (it == fences_.begin()) return 0;
+    return static_cast<size_t>(it - fences_.begin()) - 1;
+}
+
+void vmpx::app_pack::RegistryIndex::RecordChange(std::string_view name, bool added)
+{
+    changes_.push_back({++version_, std::string{name}, added});
+    if (changes_.size() <= MAX_CHANGES) return;
+    changes_floor_ = changes_.front().version;
+    changes_.pop_front();
+}
+
+void vmpx::app_pack::RegistryIndex::SetPage(size_t page_index, std::shared_ptr<RegistryPage> page)
+{
+    fences_[page_index] = page->entries.front().name;
+    pages_[page_index] = std::move(page);
+}
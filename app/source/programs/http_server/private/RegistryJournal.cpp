@@ -0,0 +1,156 @@
+﻿#include "RegistryJournal.h"
+
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include "Utils.h"
+
+namespace
+{
+    constexpr size_t FRAME_HEADER_SIZE = sizeof(uint32_t) * 2;
+}
+
+vmpx::app_pack::RegistryJournal::RegistryJournal(const std::filesystem::path& journal_path,
+                                                 uint64_t compact_bytes):
+    journal_path_(journal_path), compact_bytes_(compact_bytes)
+{
+}
+
+vmpx::app_pack::RegistryJournal::~RegistryJournal()
+{
+    // 先停掉后台线程，剩余的记录在这里写完
+    if (flusher_.joinable())
+    {
+        flusher_.request_stop();
+        flusher_.join();
+    }
+    if (file_)
+    {
+        if (!pending_.empty() && !failed_)
+        {
+            std::fwrite(pending_.data(), 1, pending_.size(), file_);
+            SyncFile(file_);
+        }
+        std::fclose(file_);
+    }
+}
+
+size_t vmpx::app_pack::RegistryJournal::Replay(const std::function<void(std::span<const uint8_t> payload)>& apply)
+{
+    size_t num_records = 0;
+    uint64_t valid_bytes = 0;
+    if (auto data_opt = ReadFile(journal_path_))
+    {
+        std::span<const uint8_t> data = data_opt.value();
+        while (data.size() >= FRAME_HEADER_SIZE)
+        {
+            uint32_t size = 0, crc = 0;
+            std::memcpy(&size, data.data(), sizeof(size));
+            std::memcpy(&crc, data.data() + sizeof(size), sizeof(crc));
+            if (data.size() - FRAME_HEADER_SIZE < size) break;
+            auto payload = data.subspan(FRAME_HEADER_SIZE, size);
+            if (Crc32(payload) != crc) break;
+            apply(payload);
+            ++num_records;
+            valid_bytes += FRAME_HEADER_SIZE + size;
+            data = data.subspan(FRAME_HEADER_SIZE + size);
+        }
+        // 崩溃时写了一半的记录，截掉后再继续追加
+        std::error_code ec;
+        if (std::filesystem::file_size(journal_path_, ec) != valid_bytes)
+            std::filesystem::resize_file(journal_path_, valid_bytes, ec);
+    }
+    file_ = OpenFile(journal_path_, "ab");
+    if (!file_) throw std::runtime_error(std::format("could not open journal file:{}", journal_path_.string()));
+    file_bytes_ = valid_bytes;
+    flusher_ = std::jthread([this](std::stop_token stop_token) { FlushLoop(stop_token); });
+    return num_records;
+}
+
+uint64_t vmpx::app_pack::RegistryJournal::Append(std::span<const uint8_t> payload)
+{
+    auto size = static_cast<uint32_t>(payload.size());
+    auto crc = Crc32(payload);
+    uint64_t seq;
+    {
+        std::lock_guard lock(mutex_);
+        auto offset = pending_.size();
+        pending_.resize(offset + FRAME_HEADER_SIZE + size);
+        std::memcpy(pending_.data() + offset, &size, sizeof(size));
+        std::memcpy(pending_.data() + offset + sizeof(size), &crc, sizeof(crc));
+        std::memcpy(pending_.data() + offset + FRAME_HEADER_SIZE, payload.data(), size);
+        seq = next_seq_++;
+    }
+    flush_cv_.notify_one();
+    return seq;
+}
+
+bool vmpx::app_pack::RegistryJournal::WaitDurable(uint64_t seq)
+{
+    std::unique_lock lock(mutex_);
+    durable_cv_.wait(lock, [&] { return durable_seq_ >= seq || failed_; });
+    return durable_seq_ >= seq;
+}
+
+bool vmpx::app_pack::RegistryJournal::NeedsCompaction() const
+{
+    std::lock_guard lock(mutex_);
+    return failed_ || file_bytes_ + pending_.size() >= compact_bytes_;
+}
+
+void vmpx::app_pack::RegistryJournal::Reset()
+{
+    std::lock_guard io_lock(io_mutex_);
+    std::lock_guard lock(mutex_);
+    // 快照已包含所有记录，未写入的也不用再写
+    pending_.clear();
+    if (file_) std::fclose(file_);
+    file_ = OpenFile(journal_path_, "wb");
+    if (file_) SyncFile(file_);
+    failed_ = !file_;
+    file_bytes_ = 0;
+    durable_seq_ = next_seq_ - 1;
+    durable_cv_.notify_all();
+}
+
+void vmpx::app_pack::RegistryJournal::FlushLoop(std::stop_token stop_token)
+{
+    std::vector<uint8_t> buffer;
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            if (!flush_cv_.wait(lock, stop_token, [this] { return !pending_.empty(); })) return;
+        }
+        // 稍等片刻，让并发的写者把记录攒到同一次落盘里
+        std::this_thread::sleep_for(GROUP_COMMIT_WINDOW);
+        std::lock_guard io_lock(io_mutex_);
+        uint64_t last_seq;
+        bool failed;
+        {
+            std::lock_guard lock(mutex_);
+            buffer.swap(pending_);
+            last_seq = next_seq_ - 1;
+            failed = failed_;
+        }
+        if (buffer.empty()) continue;
+        // 失败后日志中间已有缺口，不再追加，等待压缩写快照后Reset
+        bool ok = !failed && file_ &&
+            std::fwrite(buffer.data(), 1, buffer.size(), file_) == buffer.size() && SyncFile(file_);
+        {
+            std::lock_guard lock(mutex_);
+            if (ok)
+            {
+                durable_seq_ = last_seq;
+                file_bytes_ += buffer.size();
+            }
+            else
+            {
+                failed_ = true;
+            }
+        }
+        durable_cv_.notify_all();
+        buffer.clear();
+    }
+}
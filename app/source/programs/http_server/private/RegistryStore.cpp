@@ -0,0 +1,261 @@
+﻿#include "RegistryStore.h"
+
+#include <algorithm>
+#include <format>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <ylt/struct_pack.hpp>
+
+#include "Utils.h"
+
+namespace
+{
+    // 2: AppInfo增加了profiles
+    constexpr uint32_t PAGE_TABLE_VERSION = 2;
+    constexpr uint32_t PAGE_TABLE_VERSION_V1 = 1;
+    // 废弃的字节数超过该值且超过有效字节数时整体重写
+    constexpr uint64_t REWRITE_MIN_GARBAGE_BYTES = 1ull << 20;
+    // 页数太少时不值得开线程
+    constexpr size_t MIN_PAGES_PER_THREAD = 64;
+
+    struct PageTableEntry
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t crc;
+    };
+
+    struct PageTable
+    {
+        uint32_t version;
+        uint64_t generation;
+        // 注册表版本，重启后继续递增
+        uint64_t registry_version;
+        std::vector<PageTableEntry> pages;
+    };
+
+    struct RegistryEntryV1
+    {
+        std::string name;
+        vmpx::app_pack::AppInfoV1 app_info;
+    };
+
+    struct RegistryPageV1
+    {
+        std::vector<RegistryEntryV1> entries;
+    };
+
+    std::optional<vmpx::app_pack::RegistryPage> DecodePage(std::span<const uint8_t> data, uint32_t version)
+    {
+        using namespace vmpx::app_pack;
+        if (version == PAGE_TABLE_VERSION_V1)
+        {
+            auto page_v1 = struct_pack::deserialize<RegistryPageV1>(reinterpret_cast<const char*>(data.data()),
+                                                                    data.size());
+            if (!page_v1) return std::nullopt;
+            RegistryPage page;
+            page.entries.reserve(page_v1->entries.size());
+            for (auto& entry : page_v1->entries)
+            {
+                page.entries.push_back(RegistryEntry{
+                    std::move(entry.name),
+                    AppInfo{std::move(entry.app_info.vmp_file_path), std::move(entry.app_info.packed_app_path), {}}
+                });
+            }
+            return page;
+        }
+        auto page = struct_pack::deserialize<RegistryPage>(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!page) return std::nullopt;
+        return std::move(page.value());
+    }
+}
+
+vmpx::app_pack::RegistryStore::RegistryStore(const std::filesystem::path& dir):
+    dir_(dir), index_path_(dir / "registry.index")
+{
+}
+
+vmpx::app_pack::RegistryStore::~RegistryStore()
+{
+    if (pages_file_) std::fclose(pages_file_);
+}
+
+bool vmpx::app_pack::RegistryStore::Exists() const
+{
+    return std::filesystem::exists(index_path_);
+}
+
+std::expected<vmpx::app_pack::RegistryIndex, std::string> vmpx::app_pack::RegistryStore::Load()
+{
+    namespace bip = boost::interprocess;
+    auto table_data = ReadFile(index_path_);
+    if (!table_data) return std::unexpected{std::format("unable to read {}", index_path_.string())};
+    auto table = struct_pack::deserialize<PageTable>(reinterpret_cast<const char*>(table_data->data()),
+                                                     table_data->size());
+    if (!table || (table->version != PAGE_TABLE_VERSION && table->version != PAGE_TABLE_VERSION_V1))
+        return std::unexpected{std::format("invalid registry index:{}", index_path_.string())};
+    // 旧格式的页转换后不记为已写入，下次保存时按新格式全部重写
+    upgrade_pending_ = table->version != PAGE_TABLE_VERSION;
+    generation_ = table->generation;
+    auto pages_path = PagesPath(generation_);
+    std::vector<RegistryIndex::PagePtr> pages;
+    pages.reserve(table->pages.size());
+    persisted_.clear();
+    if (!table->pages.empty())
+    {
+        try
+        {
+            bip::file_mapping mapping(pages_path.string().c_str(), bip::read_only);
+            bip::mapped_region region(mapping, bip::read_only);
+            std::span mapped(static_cast<const uint8_t*>(region.get_address()), region.get_size());
+            // 页之间互不依赖，分给多个线程校验并解码
+            pages.resize(table->pages.size());
+            std::vector<std::string> errors(table->pages.size());
+            auto decode = [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const auto& entry = table->pages[i];
+                    if (entry.offset > mapped.size() || mapped.size() - entry.offset < entry.size)
+                    {
+                        errors[i] = std::format("registry page out of range:{}", pages_path.string());
+                        continue;
+                    }
+                    auto data = mapped.subspan(entry.offset, entry.size);
+                    if (Crc32(data) != entry.crc)
+                    {
+                        errors[i] = std::format("registry page checksum mismatch:{}", pages_path.string());
+                        continue;
+                    }
+                    auto page = DecodePage(data, table->version);
+                    if (!page)
+                    {
+                        errors[i] = std::format("invalid registry page:{}", pages_path.string());
+                        continue;
+                    }
+                    pages[i] = std::make_shared<const RegistryPage>(std::move(page.value()));
+                }
+            };
+            auto num_threads = std::clamp<size_t>(pages.size() / MIN_PAGES_PER_THREAD, 1,
+                                                  std::max(1u, std::thread::hardware_concurrency()));
+            auto pages_per_thread = (pages.size() + num_threads - 1) / num_threads;
+            {
+                std::vector<std::jthread> threads;
+                for (size_t begin = pages_per_thread; begin < pages.size(); begin += pages_per_thread)
+                {
+                    threads.emplace_back(decode, begin, std::min(pages.size(), begin + pages_per_thread));
+                }
+                decode(0, std::min(pages.size(), pages_per_thread));
+            }
+            for (size_t i = 0; i < pages.size(); ++i)
+            {
+                if (!errors[i].empty()) return std::unexpected{std::move(errors[i])};
+                if (upgrade_pending_) continue;
+                const auto& entry = table->pages[i];
+                persisted_.emplace(pages[i].get(), PersistedPage{pages[i], {entry.offset, entry.size, entry.crc}});
+            }
+        }
+        catch (std::exception& e)
+        {
+            return std::unexpected{std::format("unable to map {}:{}", pages_path.string(), e.what())};
+        }
+    }
+    // 清理重写后残留的旧代文件
+    std::error_code ec;
+    for (const auto& dir_entry : std::filesystem::directory_iterator(dir_, ec))
+    {
+        auto filename = dir_entry.path().filename().string();
+        if (filename.starts_with("registry.") && filename.ends_with(".pages") &&
+            dir_entry.path() != pages_path)
+            std::filesystem::remove(dir_entry.path(), ec);
+    }
+    if (!OpenPagesFile("ab")) return std::unexpected{std::format("unable to open {}", pages_path.string())};
+    return RegistryIndex::FromPages(std::move(pages), table->registry_version);
+}
+
+bool vmpx::app_pack::RegistryStore::Save(const RegistryIndex& index)
+{
+    uint64_t live_bytes = 0;
+    for (const auto& page : index.Pages())
+    {
+        if (auto it = persisted_.find(page.get()); it != persisted_.end()) live_bytes += it->second.ref.size;
+    }
+    auto garbage_bytes = pages_bytes_ - std::min(pages_bytes_, live_bytes);
+    bool rewrite = !pages_file_ || (garbage_bytes > REWRITE_MIN_GARBAGE_BYTES && garbage_bytes > live_bytes);
+    auto old_generation = generation_;
+    // 失败时回到上次成功保存的状态，追加了一半的数据留在文件末尾，不会被页表引用
+    auto fail = [&]
+    {
+        if (pages_file_) std::fclose(pages_file_);
+        if (generation_ != old_generation)
+        {
+            std::error_code ec;
+            std::filesystem::remove(PagesPath(generation_), ec);
+            generation_ = old_generation;
+        }
+        if (std::filesystem::exists(PagesPath(generation_))) OpenPagesFile("ab");
+        else pages_file_ = nullptr;
+        return false;
+    };
+    if (rewrite)
+    {
+        // 写到下一代文件，页表切换之前旧文件保持不变
+        if (pages_file_) std::fclose(pages_file_);
+        pages_file_ = nullptr;
+        ++generation_;
+        if (!OpenPagesFile("wb")) return fail();
+    }
+    PageTable table{PAGE_TABLE_VERSION, generation_, index.Version(), {}};
+    table.pages.reserve(index.Pages().size());
+    std::unordered_map<const RegistryPage*, PersistedPage> persisted;
+    persisted.reserve(index.Pages().size());
+    for (const auto& page : index.Pages())
+    {
+        auto it = persisted_.find(page.get());
+        if (!rewrite && it != persisted_.end())
+        {
+            persisted.emplace(page.get(), it->second);
+            table.pages.push_back({it->second.ref.offset, it->second.ref.size, it->second.ref.crc});
+            continue;
+        }
+        auto data = struct_pack::serialize(*page);
+        std::span bytes(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        if (std::fwrite(bytes.data(), 1, bytes.size(), pages_file_) != bytes.size()) return fail();
+        PageRef ref{pages_bytes_, bytes.size(), Crc32(bytes)};
+        pages_bytes_ += bytes.size();
+        persisted.emplace(page.get(), PersistedPage{page, ref});
+        table.pages.push_back({ref.offset, ref.size, ref.crc});
+    }
+    if (!SyncFile(pages_file_)) return fail();
+    auto table_data = struct_pack::serialize(table);
+    if (!WriteFileAtomic(std::span(reinterpret_cast<const uint8_t*>(table_data.data()), table_data.size()),
+                         index_path_))
+        return fail();
+    persisted_ = std::move(persisted);
+    upgrade_pending_ = false;
+    if (rewrite && old_generation != generation_)
+    {
+        std::error_code ec;
+        std::filesystem::remove(PagesPath(old_generation), ec);
+    }
+    return true;
+}
+
+std::filesystem::path vmpx::app_pack::RegistryStore::PagesPath(uint64_t generation) const
+{
+    return dir_ / std::format("registry.{}.pages", generation);
+}
+
+bool vmpx::app_pack::RegistryStore::OpenPagesFile(const char* mode)
+{
+    auto pages_path = PagesPath(generation_);
+    pages_file_ = OpenFile(pages_path, mode);
+    if (!pages_file_) return false;
+    std::error_code ec;
+    pages_bytes_ = std::filesystem::file_size(pages_path, ec);
+    return true;
+}
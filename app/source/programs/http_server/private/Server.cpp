@@ -1,8 +1,14 @@
 ﻿#include "../Server.h"
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <expected>
+#include <memory_resource>
 #include <span>
 #include <string>
+#include <thread>
 
 #include <hv/HttpServer.h>
 #include <hv/HttpService.h>
@@ -14,8 +20,16 @@
 #include <boost/locale.hpp>
 #include "config.h"
 #include "AppPackService.h"
+#include "Arena.h"
+#include "ChunkedStream.h"
+#include "IssueJobService.h"
+#include "PackProgressHub.h"
+#include "Profiler.h"
+#include "StreamTaskPool.h"
+#include "Trace.h"
 #include "Utils.h"
 #include "VMPX.h"
+#include "ZipStream.h"
 
 
 struct ErrorEntity
@@ -30,11 +44,102 @@ struct GenSerialNumberRequest
     bool ignore_network_adapters = false;
 };
 
+struct GenSerialNumbersRequest
+{
+    vmpx::ProductInfoEntity product_info;
+    // 逐个生成
+    std::vector<vmpx::SerialInfo> serial_infos;
+    // 以serial_info为模板生成count个，与serial_infos二选一
+    vmpx::SerialInfo serial_info;
+    uint64_t count = 0;
+    bool ignore_network_adapters = false;
+};
+
+// NDJSON流中的一行
+struct SerialNumberLineEntity
+{
+    uint64_t index;
+    bool ok;
+    std::string serial_number;
+    int expired_year;
+    int expired_month;
+    int expired_day;
+    // 失败原因
+    std::string message;
+};
+
+struct PackBatchRequest
+{
+    std::vector<std::string> names;
+    bool all = false;
+    // 每个app都按这些加壳配置加壳，为空时只用默认配置
+    std::vector<std::string> profiles;
+    // 为true时以zip返回所有加壳成功的程序
+    bool archive = false;
+    std::string priority = "normal";
+};
+
+struct PackBatchResultEntity
+{
+    std::string name;
+    std::string profile;
+    bool ok;
+    // 成功时为加壳后的文件名，失败时为错误原因
+    std::string message;
+};
+
+struct AppUpdateDiffRequest
+{
+    // 更新后的完整文件列表
+    std::vector<vmpx::app_pack::UpdateFile> files;
+};
+
+struct ProjectPatchRequest
+{
+    std::vector<vmpx::app_pack::ProjectPatch> patches;
+};
+
+struct ProfilePackResultEntity
+{
+    std::string profile;
+    bool ok;
+    // 成功时为加壳后的文件名，失败时为错误原因
+    std::string message;
+};
+
+struct AppFileEntity
+{
+    std::string path;
+    uint64_t size;
+    uint32_t crc32;
+    std::string kind;
+};
+
 namespace
 {
+    constexpr size_t DEFAULT_LIST_LIMIT = 100;
+    constexpr size_t MAX_LIST_LIMIT = 1000;
+    constexpr std::string_view DEFAULT_PROJECT_NODE = "Document/Protection";
+    constexpr uint32_t DEFAULT_PROFILE_SECONDS = 10;
+    constexpr uint64_t MAX_STREAM_SERIALS = 10'000'000;
+    // 攒够一块或距上次发送超过一定时间就发出
+    constexpr size_t STREAM_CHUNK_BYTES = 16 * 1024;
+    constexpr auto STREAM_FLUSH_INTERVAL = std::chrono::milliseconds(100);
+    // 同时进行的批量加壳请求，每个请求占用一个线程直到加壳完成、压缩包发送完毕
+    constexpr size_t MAX_PACK_BATCH_TASKS = 8;
+
     std::unique_ptr<vmpx::app_pack::AppPackService> pack_service{nullptr};
+    std::unique_ptr<vmpx::issue::IssueJobService> issue_service{nullptr};
+    vmpx::app_pack::PackProgressHub pack_progress_hub;
+    vmpx::stream::StreamTaskPool pack_batch_tasks{MAX_PACK_BATCH_TASKS};
+    // 生成序列号是纯计算，同时进行的流不超过CPU核数
+    vmpx::stream::StreamTaskPool serial_stream_tasks{std::max(1u, std::thread::hardware_concurrency())};
+    // 采样本身同一时间只能有一个
+    vmpx::stream::StreamTaskPool profile_tasks{1};
     std::unique_ptr<hv::HttpServer> server = nullptr;
+    std::unique_ptr<vmpx::admission::AdmissionController> admission_controller{nullptr};
     thread_local std::string log_buf_string;
+    thread_local std::string response_log_string;
 
     std::string URLEncode(const std::string& value)
     {
@@ -57,25 +162,43 @@ namespace
         return escaped.str();
     }
 
+    /**
+     * 
+     * @param ctx 
+     * @param value 
+     * @param status 
+     * @param resource JSON字符串的分配器，处理请求时传入请求的arena
+     * @return 
+     */
     template <typename T>
-    auto CtxSendJson(const HttpContextPtr& ctx, T&& value, http_status status = HTTP_STATUS_OK) noexcept
+    auto CtxSendJson(const HttpContextPtr& ctx, T&& value, http_status status = HTTP_STATUS_OK,
+                     std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept
     {
-        std::string str;
-        struct_json::to_json(std::forward<T>(value), str);
+        std::pmr::string str{resource};
+        {
+            VMPX_TRACE_SCOPE("Response::ToJson");
+            struct_json::to_json(std::forward<T>(value), str);
+        }
+        VMPX_TRACE_SCOPE("Response::Log");
         log4cplus::Logger logger = vmpx::GetLogger();
         ctx->setStatus(status);
         auto request = ctx->request;
         auto response = ctx->response;
-        std::string log_str = std::format(R"("{} {}" {}({}) {}Bytes "{}" "{}")",
-                                          http_method_str(request->method),
-                                          request->url,
-                                          static_cast<uint16_t>(response->status_code),
-                                          http_status_str(response->status_code),
-                                          request->content_length,
-                                          request->headers["User-Agent"],
-                                          str);
-        LOG4CPLUS_INFO(logger, LOG4CPLUS_STRING_TO_TSTRING(log_str));
-        return ctx->send(str, http_content_type::APPLICATION_JSON);
+        // 日志缓冲按线程复用，不必每个请求重新分配
+        response_log_string.clear();
+        std::format_to(std::back_inserter(response_log_string), R"("{} {}" {}({}) {}Bytes "{}" "{}")",
+                       http_method_str(request->method),
+                       request->url,
+                       static_cast<uint16_t>(response->status_code),
+                       http_status_str(response->status_code),
+                       request->content_length,
+                       request->headers["User-Agent"],
+                       std::string_view{str});
+        LOG4CPLUS_INFO(logger, LOG4CPLUS_STRING_TO_TSTRING(response_log_string));
+        // 直接写入响应体，避免再构造一个临时std::string
+        response->content_type = http_content_type::APPLICATION_JSON;
+        response->body.assign(str.data(), str.size());
+        return ctx->send();
     }
 
     auto CtxSendJsonString(const HttpContextPtr& ctx, std::string_view json_string,
@@ -97,6 +220,47 @@ namespace
         return ctx->send(std::string(json_string), http_content_type::APPLICATION_JSON);
     }
 
+    /**
+     * 注册表中的路径是本地编码，回复前转为UTF-8
+     * @param app_info 
+     */
+    void AppInfoToUtf8(vmpx::app_pack::AppInfo& app_info)
+    {
+        app_info.vmp_file_path = boost::locale::conv::to_utf<char>(app_info.vmp_file_path, "GBK");
+        app_info.packed_app_path = boost::locale::conv::to_utf<char>(app_info.packed_app_path, "GBK");
+        for (auto& profile : app_info.profiles)
+        {
+            profile.vmp_file_path = boost::locale::conv::to_utf<char>(profile.vmp_file_path, "GBK");
+            profile.packed_app_path = boost::locale::conv::to_utf<char>(profile.packed_app_path, "GBK");
+        }
+    }
+
+    /**
+     * 在解析请求体之前按客户端扣除令牌，超出则直接回复429
+     */
+    int Preprocessor(HttpRequest* req, HttpResponse* resp)
+    {
+        // 请求头X-Vmpx-Trace: 1可以强制采样单个请求
+        vmpx::trace::BeginRequest(req->Path(), req->GetHeader("X-Vmpx-Trace") == "1");
+        if (!admission_controller || !admission_controller->Enabled()) return HTTP_STATUS_NEXT;
+        const auto& client_header = admission_controller->Options().client_header;
+        std::string client = client_header.empty() ? std::string{} : req->GetHeader(client_header.c_str());
+        if (client.empty()) client = req->client_addr.ip;
+        auto decision = admission_controller->TryAcquire(client, vmpx::admission::RequestCost(req->Path(), req->body));
+        if (decision.admitted) return HTTP_STATUS_NEXT;
+        auto retry_after = std::chrono::ceil<std::chrono::seconds>(decision.retry_after).count();
+        resp->SetHeader("Retry-After", std::to_string(std::max<int64_t>(retry_after, 1)));
+        resp->content_type = http_content_type::APPLICATION_JSON;
+        struct_json::to_json(ErrorEntity{"too many requests"}, resp->body);
+        return HTTP_STATUS_TOO_MANY_REQUESTS;
+    }
+
+    int Postprocessor(HttpRequest*, HttpResponse*)
+    {
+        vmpx::trace::EndRequest();
+        return HTTP_STATUS_NEXT;
+    }
+
     void OnHVLog(int loglevel, const char* buf, int len) noexcept
     {
         log4cplus::Logger logger = vmpx::GetLogger();
@@ -108,24 +272,41 @@ namespace
 
     int OnGenSerialNumber(const HttpContextPtr& ctx) noexcept
     {
+        // 请求内的临时对象从arena分配，返回时一次释放
+        vmpx::arena::RequestArena arena;
         try
         {
             auto& body = ctx->body();
             GenSerialNumberRequest req;
             {
-                auto charset_opt = vmpx::Charset::DetCharset(body);
+                auto charset_opt = [&]
+                {
+                    VMPX_TRACE_SCOPE("Charset::DetCharset");
+                    return vmpx::Charset::DetCharset(body);
+                }();
                 if (!charset_opt)
-                    return CtxSendJson(ctx, ErrorEntity{"can not detect body charset"});
-                auto utf_body = boost::locale::conv::to_utf<char>(body, *charset_opt);
+                    return CtxSendJson(ctx, ErrorEntity{"can not detect body charset"}, HTTP_STATUS_OK, &arena);
+                // 绝大多数请求本来就是UTF-8，不必转换出一份拷贝
+                std::string converted_body;
+                std::string_view utf_body = body;
+                if (std::string_view charset = *charset_opt; charset != "UTF-8" && charset != "ASCII")
+                {
+                    VMPX_TRACE_SCOPE("Request::ToUtf8");
+                    converted_body = boost::locale::conv::to_utf<char>(body, *charset_opt);
+                    utf_body = converted_body;
+                }
                 std::error_code ec;
-                struct_json::from_json(req, utf_body, ec);
+                {
+                    VMPX_TRACE_SCOPE("Request::FromJson");
+                    struct_json::from_json(req, utf_body, ec);
+                }
                 if (ec)
                 {
                     return CtxSendJson(ctx, ErrorEntity{
                                            .message = std::format(
                                                "unable to parse json with error: {}\njson string:\n{}",
                                                (ec).message(), utf_body)
-                                       }, HTTP_STATUS_BAD_REQUEST);
+                                       }, HTTP_STATUS_BAD_REQUEST, &arena);
                 }
             }
             if (req.ignore_network_adapters)
@@ -133,25 +314,159 @@ namespace
                 auto hwid = vmpx::HWID::FromBase64(req.serial_info.hwid);
                 if (!hwid)
                     return CtxSendJson(ctx, std::format("unable to parse HWID:{}", hwid.error()),
-                                       HTTP_STATUS_BAD_REQUEST);
+                                       HTTP_STATUS_BAD_REQUEST, &arena);
                 hwid->network_adapters.clear();
                 req.serial_info.hwid = hwid->ToBase64();
             }
-            auto serial_number_info = vmpx::GenSerialNumber(req.product_info.ToProductInfo(), req.serial_info);
+            auto product_info = req.product_info.ToProductInfo(&arena);
+            if (!product_info)
+                return CtxSendJson(ctx, ErrorEntity{std::format("invalid product_info:{}", product_info.error())},
+                                   HTTP_STATUS_BAD_REQUEST, &arena);
+            auto serial_number_info = vmpx::GenSerialNumber(*product_info, req.serial_info, &arena);
             if (!serial_number_info.has_value())
             {
                 return CtxSendJson(ctx, ErrorEntity{
                                        .message = std::format("unable to generate serial number with error:{}",
                                                               serial_number_info.error())
-                                   }, HTTP_STATUS_BAD_REQUEST);
+                                   }, HTTP_STATUS_BAD_REQUEST, &arena);
             }
-            return CtxSendJson(ctx, serial_number_info.value());
+            return CtxSendJson(ctx, serial_number_info.value(), HTTP_STATUS_OK, &arena);
+        }
+        catch (std::exception& e)
+        {
+            return CtxSendJson(ctx, ErrorEntity{.message = std::format("unknown error:{}", e.what())},
+                               HTTP_STATUS_INTERNAL_SERVER_ERROR, &arena);
+        }
+    }
+
+    /**
+     * ignore_network_adapters时去掉HWID中的网卡
+     * @param serial_info
+     * @param ignore_network_adapters
+     * @return
+     */
+    std::expected<void, std::string> NormalizeHwid(vmpx::SerialInfo& serial_info, bool ignore_network_adapters)
+    {
+        if (!ignore_network_adapters) return {};
+        auto hwid = vmpx::HWID::FromBase64(serial_info.hwid);
+        if (!hwid) return std::unexpected{std::format("unable to parse HWID:{}", hwid.error())};
+        hwid->network_adapters.clear();
+        serial_info.hwid = hwid->ToBase64();
+        return {};
+    }
+
+    /**
+     * 在独立线程上逐个生成序列号，以chunked编码按NDJSON写出
+     * 客户端读得慢时暂停生成，内存占用与批量大小无关；客户端断开或服务停止后停止
+     */
+    void StreamSerialNumbers(const HttpContextPtr& ctx, const GenSerialNumbersRequest& req,
+                             const vmpx::ProductInfo& product_info, std::stop_token stop_token)
+    {
+        vmpx::stream::ChunkedStream stream(ctx->writer, "application/x-ndjson", {{"Cache-Control", "no-cache"}});
+        uint64_t total = req.serial_infos.empty() ? req.count : req.serial_infos.size();
+        std::string chunk;
+        chunk.reserve(STREAM_CHUNK_BYTES * 2);
+        std::string line;
+        auto last_flush = std::chrono::steady_clock::now();
+        auto flush = [&]
+        {
+            // 写缓冲积压时阻塞在这里，等写完成回调唤醒
+            if (!chunk.empty() && !stream.Write(chunk, stop_token)) return false;
+            if (stop_token.stop_requested() || !stream.Connected()) return false;
+            chunk.clear();
+            last_flush = std::chrono::steady_clock::now();
+            return true;
+        };
+        for (uint64_t index = 0; index < total; ++index)
+        {
+            auto serial_info = req.serial_infos.empty() ? req.serial_info : req.serial_infos[index];
+            SerialNumberLineEntity entity{.index = index, .ok = false};
+            try
+            {
+                if (auto normalized = NormalizeHwid(serial_info, req.ignore_network_adapters); !normalized)
+                {
+                    entity.message = normalized.error();
+                }
+                else if (auto serial_number_info = vmpx::GenSerialNumber(product_info, serial_info);
+                    !serial_number_info)
+                {
+                    entity.message = std::format("unable to generate serial number with error:{}",
+                                                 serial_number_info.error());
+                }
+                else
+                {
+                    entity.ok = true;
+                    entity.serial_number = std::move(serial_number_info->serial_number);
+                    entity.expired_year = serial_number_info->expired_year;
+                    entity.expired_month = serial_number_info->expired_month;
+                    entity.expired_day = serial_number_info->expired_day;
+                }
+            }
+            catch (std::exception& e)
+            {
+                entity.message = std::format("unknown error:{}", e.what());
+            }
+            line.clear();
+            struct_json::to_json(entity, line);
+            chunk += line;
+            chunk.push_back('\n');
+            // 第一行立即发出，客户端马上就能开始处理
+            if (index == 0 || chunk.size() >= STREAM_CHUNK_BYTES ||
+                std::chrono::steady_clock::now() - last_flush >= STREAM_FLUSH_INTERVAL)
+            {
+                if (!flush()) return;
+            }
+        }
+        if (flush()) stream.End();
+    }
+
+    int OnGenSerialNumbers(const HttpContextPtr& ctx) noexcept
+    {
+        auto req = std::make_shared<GenSerialNumbersRequest>();
+        try
+        {
+            auto& body = ctx->body();
+            auto charset_opt = vmpx::Charset::DetCharset(body);
+            if (!charset_opt)
+                return CtxSendJson(ctx, ErrorEntity{"can not detect body charset"}, HTTP_STATUS_BAD_REQUEST);
+            std::string converted_body;
+            std::string_view utf_body = body;
+            if (std::string_view charset = *charset_opt; charset != "UTF-8" && charset != "ASCII")
+            {
+                converted_body = boost::locale::conv::to_utf<char>(body, *charset_opt);
+                utf_body = converted_body;
+            }
+            std::error_code ec;
+            struct_json::from_json(*req, utf_body, ec);
+            if (ec)
+                return CtxSendJson(ctx, ErrorEntity{std::format("unable to parse json with error: {}", ec.message())},
+                                   HTTP_STATUS_BAD_REQUEST);
         }
         catch (std::exception& e)
         {
             return CtxSendJson(ctx, ErrorEntity{.message = std::format("unknown error:{}", e.what())},
                                HTTP_STATUS_INTERNAL_SERVER_ERROR);
         }
+        if (req->serial_infos.empty() == (req->count == 0))
+            return CtxSendJson(ctx, ErrorEntity{"exactly one of param [serial_infos] and [count] is required"},
+                               HTTP_STATUS_BAD_REQUEST);
+        if (req->count > MAX_STREAM_SERIALS)
+            return CtxSendJson(ctx, ErrorEntity{std::format("param [count] must be in [1, {}]", MAX_STREAM_SERIALS)},
+                               HTTP_STATUS_BAD_REQUEST);
+        auto product_info = req->product_info.ToProductInfo();
+        if (!product_info)
+            return CtxSendJson(ctx, ErrorEntity{std::format("invalid product_info:{}", product_info.error())},
+                               HTTP_STATUS_BAD_REQUEST);
+        // 生成可能持续很久，不能占用IO线程；写缓冲只有IO线程能发出，阻塞它也会让背压永远等不到
+        bool started = serial_stream_tasks.TryRun(
+            [ctx, req, product_info = std::move(product_info.value())](std::stop_token stop_token)
+            {
+                StreamSerialNumbers(ctx, *req, product_info, stop_token);
+            });
+        if (!started)
+            return CtxSendJson(ctx, ErrorEntity{"too many serial number streams in progress"},
+                               HTTP_STATUS_SERVICE_UNAVAILABLE);
+        return HTTP_STATUS_UNFINISHED;
     }
 
     int OnGenRandomProductInfo(const HttpContextPtr& ctx) noexcept
@@ -159,7 +474,16 @@ namespace
         try
         {
             auto& req_json = ctx->json();
-            size_t key_size = req_json["key_size"].get<size_t>();
+            auto key_size_it = req_json.find("key_size");
+            // 浮点数也能转换为整数，只接受整数
+            if (key_size_it == req_json.end() || !key_size_it->is_number_integer() ||
+                key_size_it->get<int64_t>() < static_cast<int64_t>(vmpx::MIN_KEY_SIZE) ||
+                key_size_it->get<int64_t>() > static_cast<int64_t>(vmpx::MAX_KEY_SIZE))
+                return CtxSendJson(ctx, ErrorEntity{
+                                       std::format("param [key_size] must be an integer in [{}, {}]",
+                                                   vmpx::MIN_KEY_SIZE, vmpx::MAX_KEY_SIZE)
+                                   }, HTTP_STATUS_BAD_REQUEST);
+            auto key_size = key_size_it->get<size_t>();
             auto pi = vmpx::GenRandomProductInfo(key_size);
             auto pi_entity = vmpx::ProductInfoEntity::FromProductInfo(pi);
             return CtxSendJson(ctx, pi_entity);
@@ -189,11 +513,78 @@ namespace
                             request->content_length), vmp_file_path);
         if (!add_result)
             return CtxSendJson(ctx, ErrorEntity{add_result.error()}, HTTP_STATUS_BAD_REQUEST);
-        add_result->vmp_file_path = boost::locale::conv::to_utf<char>(add_result->vmp_file_path, "GBK");
-        add_result->packed_app_path = boost::locale::conv::to_utf<char>(add_result->packed_app_path, "GBK");
+        AppInfoToUtf8(add_result.value());
         return CtxSendJson(ctx, add_result.value());
     }
 
+    int OnAppUpdateDiff(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        AppUpdateDiffRequest req;
+        std::error_code ec;
+        struct_json::from_json(req, ctx->body(), ec);
+        if (ec)
+            return CtxSendJson(ctx, ErrorEntity{std::format("unable to parse json with error: {}", ec.message())},
+                               HTTP_STATUS_BAD_REQUEST);
+        auto diff = pack_service->BeginUpdate(name_it->second, req.files);
+        if (!diff) return CtxSendJson(ctx, ErrorEntity{diff.error()}, HTTP_STATUS_BAD_REQUEST);
+        return CtxSendJson(ctx, diff.value());
+    }
+
+    int OnAppUpdate(const HttpContextPtr& ctx)
+    {
+        auto& request = ctx->request;
+        auto& queries = request->query_params;
+        auto session_id_it = queries.find("session_id");
+        if (session_id_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [session_id] is required"}, HTTP_STATUS_BAD_REQUEST);
+        auto update_result = pack_service->ApplyUpdate(
+            session_id_it->second, std::span(static_cast<uint8_t*>(request->Content()), request->content_length));
+        if (!update_result)
+            return CtxSendJson(ctx, ErrorEntity{update_result.error()}, HTTP_STATUS_BAD_REQUEST);
+        auto& app_info = update_result->app_info;
+        AppInfoToUtf8(app_info);
+        return CtxSendJson(ctx, update_result.value());
+    }
+
+    int OnGetAppProject(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        auto path_it = queries.find("path");
+        auto profile_it = queries.find("profile");
+        auto node = pack_service->GetProjectNode(name_it->second,
+                                                 path_it != queries.end() ? path_it->second : DEFAULT_PROJECT_NODE,
+                                                 profile_it != queries.end() ? profile_it->second : "");
+        if (!node) return CtxSendJson(ctx, ErrorEntity{node.error()}, HTTP_STATUS_BAD_REQUEST);
+        return CtxSendJson(ctx, node.value());
+    }
+
+    int OnPatchAppProject(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        ProjectPatchRequest req;
+        std::error_code ec;
+        struct_json::from_json(req, ctx->body(), ec);
+        if (ec)
+            return CtxSendJson(ctx, ErrorEntity{std::format("unable to parse json with error: {}", ec.message())},
+                               HTTP_STATUS_BAD_REQUEST);
+        auto profile_it = queries.find("profile");
+        auto patch_result = pack_service->PatchProject(name_it->second, req.patches,
+                                                       profile_it != queries.end() ? profile_it->second : "");
+        if (!patch_result) return CtxSendJson(ctx, ErrorEntity{patch_result.error()}, HTTP_STATUS_BAD_REQUEST);
+        AppInfoToUtf8(patch_result.value());
+        return CtxSendJson(ctx, patch_result.value());
+    }
+
     int OnAppRemove(const HttpContextPtr& ctx)
     {
         auto& request = ctx->request;
@@ -208,10 +599,59 @@ namespace
         return CtxSendJson(ctx, ErrorEntity{"app not found"}, HTTP_STATUS_NOT_FOUND);
     }
 
+    /**
+     * 设置ETag，客户端持有的版本与之相同时回复304
+     * @return 已回复304则返回true
+     */
+    bool CtxNotModified(const HttpContextPtr& ctx, uint64_t version)
+    {
+        auto etag = std::format("\"{}\"", version);
+        ctx->setHeader("ETag", etag);
+        ctx->setHeader("Cache-Control", "no-cache");
+        if (ctx->request->GetHeader("If-None-Match") != etag) return false;
+        ctx->setStatus(HTTP_STATUS_NOT_MODIFIED);
+        return true;
+    }
+
     int OnAppList(const HttpContextPtr& ctx)
     {
-        auto app_names = pack_service->List();
-        return CtxSendJson(ctx, app_names);
+        auto& queries = ctx->request->query_params;
+        auto limit_it = queries.find("limit");
+        auto cursor_it = queries.find("cursor");
+        auto prefix_it = queries.find("prefix");
+        if (auto since_it = queries.find("since"); since_it != queries.end())
+        {
+            uint64_t since = 0;
+            auto [ptr, ec] = std::from_chars(since_it->second.data(),
+                                             since_it->second.data() + since_it->second.size(), since);
+            if (ec != std::errc{})
+                return CtxSendJson(ctx, ErrorEntity{"param [since] must be a version number"},
+                                   HTTP_STATUS_BAD_REQUEST);
+            auto delta = pack_service->ListDelta(since);
+            if (CtxNotModified(ctx, delta.version)) return ctx->send();
+            return CtxSendJson(ctx, delta);
+        }
+        // 不带分页参数时保持原来的行为，返回全部名字
+        if (limit_it == queries.end() && cursor_it == queries.end() && prefix_it == queries.end())
+        {
+            // 先取版本再取列表，ETag只会比内容旧，不会让客户端错过修改
+            if (CtxNotModified(ctx, pack_service->RegistryVersion())) return ctx->send();
+            auto app_names = pack_service->List();
+            return CtxSendJson(ctx, app_names);
+        }
+        size_t limit = DEFAULT_LIST_LIMIT;
+        if (limit_it != queries.end())
+        {
+            auto [ptr, ec] = std::from_chars(limit_it->second.data(),
+                                             limit_it->second.data() + limit_it->second.size(), limit);
+            if (ec != std::errc{} || limit == 0 || limit > MAX_LIST_LIMIT)
+                return CtxSendJson(ctx, ErrorEntity{std::format("param [limit] must be in [1, {}]", MAX_LIST_LIMIT)},
+                                   HTTP_STATUS_BAD_REQUEST);
+        }
+        auto page = pack_service->ListPage(prefix_it != queries.end() ? prefix_it->second : "",
+                                           cursor_it != queries.end() ? cursor_it->second : "", limit);
+        if (CtxNotModified(ctx, page.version)) return ctx->send();
+        return CtxSendJson(ctx, page);
     }
 
     int OnAppPack(const HttpContextPtr& ctx)
@@ -228,11 +668,24 @@ namespace
         if (!pack_service->Has(name))
             return CtxSendJson(ctx,
                                ErrorEntity{"unable to find app"}, HTTP_STATUS_BAD_REQUEST);
-        auto packed_app_path = pack_service->GetPacked(name);
+        auto priority = vmpx::app_pack::PackPriority::NORMAL;
+        if (auto priority_it = queries.find("priority"); priority_it != queries.end())
+        {
+            auto priority_opt = magic_enum::enum_cast<vmpx::app_pack::PackPriority>(
+                priority_it->second, magic_enum::case_insensitive);
+            if (!priority_opt)
+                return CtxSendJson(ctx, ErrorEntity{"param [priority] must be one of low, normal, high"},
+                                   HTTP_STATUS_BAD_REQUEST);
+            priority = priority_opt.value();
+        }
+        // 不指定时使用默认配置
+        auto profile_it = queries.find("profile");
+        std::string profile = profile_it != queries.end() ? profile_it->second : "";
+        auto packed_app_path = pack_service->GetPacked(name, profile);
         // 未打包，执行打包程序
         if (packed_app_path.empty())
         {
-            auto pack_result = pack_service->Pack(name);
+            auto pack_result = pack_service->PackProfile(name, profile, priority);
             if (!pack_result)
                 return CtxSendJson(ctx, ErrorEntity{std::format("unable to pack application:{}", pack_result.error())},
                                    HTTP_STATUS_INTERNAL_SERVER_ERROR);
@@ -258,6 +711,52 @@ namespace
                            HTTP_STATUS_INTERNAL_SERVER_ERROR);
     }
 
+    int OnAppPackProfiles(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        auto priority = vmpx::app_pack::PackPriority::NORMAL;
+        if (auto priority_it = queries.find("priority"); priority_it != queries.end())
+        {
+            auto priority_opt = magic_enum::enum_cast<vmpx::app_pack::PackPriority>(
+                priority_it->second, magic_enum::case_insensitive);
+            if (!priority_opt)
+                return CtxSendJson(ctx, ErrorEntity{"param [priority] must be one of low, normal, high"},
+                                   HTTP_STATUS_BAD_REQUEST);
+            priority = priority_opt.value();
+        }
+
+        // 各配置加壳要等到全部完成，与批量加壳共用线程池，不占用IO线程
+        bool started = pack_batch_tasks.TryRun([ctx, name = name_it->second, priority](std::stop_token)
+        {
+            auto pack_results = pack_service->PackAllProfiles(name, priority);
+            if (!pack_results)
+            {
+                CtxSendJson(ctx, ErrorEntity{pack_results.error()}, HTTP_STATUS_BAD_REQUEST);
+                return;
+            }
+            std::vector<ProfilePackResultEntity> result_entities;
+            result_entities.reserve(pack_results->size());
+            for (const auto& [profile, result] : pack_results.value())
+            {
+                if (!result)
+                {
+                    result_entities.push_back({profile, false, result.error()});
+                    continue;
+                }
+                result_entities.push_back({
+                    profile, true, boost::locale::conv::to_utf<char>(result->filename().string(), "GBK")
+                });
+            }
+            CtxSendJson(ctx, result_entities);
+        });
+        if (!started)
+            return CtxSendJson(ctx, ErrorEntity{"too many batch packs in progress"}, HTTP_STATUS_SERVICE_UNAVAILABLE);
+        return HTTP_STATUS_UNFINISHED;
+    }
+
     int OnGetProductInfo(const HttpContextPtr& ctx)
     {
         auto params = ctx->params();
@@ -272,6 +771,299 @@ namespace
         auto json_str = pi_result->ToJson();
         return CtxSendJsonString(ctx, json_str);
     }
+
+    int OnAppPackCancel(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        if (pack_service->CancelPack(name_it->second)) return CtxSendJson(ctx, ErrorEntity{"ok"});
+        return CtxSendJson(ctx, ErrorEntity{"no pack in progress"}, HTTP_STATUS_NOT_FOUND);
+    }
+
+    int OnAppFiles(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        if (!pack_service->Has(name_it->second))
+            return CtxSendJson(ctx, ErrorEntity{"app not found"}, HTTP_STATUS_NOT_FOUND);
+        auto manifest = pack_service->GetManifest(name_it->second);
+        if (!manifest)
+            return CtxSendJson(ctx, ErrorEntity{std::format("unable to read file list:{}", manifest.error())},
+                               HTTP_STATUS_INTERNAL_SERVER_ERROR);
+        std::vector<AppFileEntity> file_entities;
+        file_entities.reserve(manifest.value()->files.size());
+        for (const auto& entry : manifest.value()->files)
+        {
+            file_entities.push_back(AppFileEntity{
+                entry.path, entry.size, entry.crc32, std::string{vmpx::app_pack::FileKindName(entry.kind)}
+            });
+        }
+        return CtxSendJson(ctx, file_entities);
+    }
+
+    /**
+     * 以zip流式返回加壳成功的程序，结果清单results.json放在最后，便于客户端得知失败的app
+     * 加壳后的文件直接从磁盘读出写入连接，不再生成临时压缩包
+     * @param ctx 
+     * @param req 
+     * @param priority 
+     * @param stop_token 
+     */
+    void StreamPackBatchArchive(const HttpContextPtr& ctx, const PackBatchRequest& req,
+                                vmpx::app_pack::PackPriority priority, std::stop_token stop_token)
+    {
+        auto batch_results = pack_service->PackBatch(req.names, priority, req.profiles, stop_token);
+        vmpx::stream::ChunkedStream stream(ctx->writer, "application/zip",
+                                           {{"Content-Disposition", "attachment; filename=\"pack_batch.zip\""}});
+        vmpx::app_pack::ZipStreamWriter zip([&stream, &stop_token](std::string_view data)
+        {
+            return stream.Write(data, stop_token);
+        });
+        std::vector<PackBatchResultEntity> result_entities;
+        result_entities.reserve(batch_results.size());
+        for (const auto& [name, profile, result] : batch_results)
+        {
+            if (!result)
+            {
+                result_entities.push_back({name, profile, false, result.error()});
+                continue;
+            }
+            auto utf_filename = boost::locale::conv::to_utf<char>(result->filename().string(), "GBK");
+            // 未指定加壳配置时保持{name}/{file}的布局
+            auto entry_name = req.profiles.empty()
+                                  ? std::format("{}/{}", name, utf_filename)
+                                  : std::format("{}/{}/{}", name, profile, utf_filename);
+            if (!zip.AddFile(entry_name, result.value()))
+            {
+                stream.Abort();
+                return;
+            }
+            result_entities.push_back({name, profile, true, utf_filename});
+        }
+        std::string results_json;
+        struct_json::to_json(result_entities, results_json);
+        if (!zip.AddData("results.json", results_json) || !zip.Finish())
+        {
+            stream.Abort();
+            return;
+        }
+        stream.End();
+    }
+
+    int OnAppPackBatch(const HttpContextPtr& ctx)
+    {
+        auto req = std::make_shared<PackBatchRequest>();
+        std::error_code ec;
+        struct_json::from_json(*req, ctx->body(), ec);
+        if (ec)
+            return CtxSendJson(ctx, ErrorEntity{std::format("unable to parse json with error: {}", ec.message())},
+                               HTTP_STATUS_BAD_REQUEST);
+        if (req->all) req->names = pack_service->List();
+        if (req->names.empty())
+            return CtxSendJson(ctx, ErrorEntity{"param [names] or [all] is required"}, HTTP_STATUS_BAD_REQUEST);
+        auto priority_opt = magic_enum::enum_cast<vmpx::app_pack::PackPriority>(
+            req->priority, magic_enum::case_insensitive);
+        if (!priority_opt)
+            return CtxSendJson(ctx, ErrorEntity{"param [priority] must be one of low, normal, high"},
+                               HTTP_STATUS_BAD_REQUEST);
+
+        // 加壳可能持续数分钟，不能占用IO线程，放到独立线程中完成后再回复
+        bool started = pack_batch_tasks.TryRun([ctx, req, priority = priority_opt.value()](std::stop_token stop_token)
+        {
+            if (req->archive)
+            {
+                StreamPackBatchArchive(ctx, *req, priority, stop_token);
+                return;
+            }
+            auto batch_results = pack_service->PackBatch(req->names, priority, req->profiles, stop_token);
+            std::vector<PackBatchResultEntity> result_entities;
+            result_entities.reserve(batch_results.size());
+            for (const auto& [name, profile, result] : batch_results)
+            {
+                if (result)
+                    result_entities.push_back(
+                        {name, profile, true, boost::locale::conv::to_utf<char>(result->filename().string(), "GBK")});
+                else
+                    result_entities.push_back({name, profile, false, result.error()});
+            }
+            CtxSendJson(ctx, result_entities);
+        });
+        if (!started)
+            return CtxSendJson(ctx, ErrorEntity{"too many batch packs in progress"}, HTTP_STATUS_SERVICE_UNAVAILABLE);
+        return HTTP_STATUS_UNFINISHED;
+    }
+
+    int OnAppPackEvents(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        if (!pack_service->Has(name_it->second))
+            return CtxSendJson(ctx, ErrorEntity{"unable to find app"}, HTTP_STATUS_BAD_REQUEST);
+        pack_progress_hub.Subscribe(name_it->second, ctx->writer);
+        return HTTP_STATUS_UNFINISHED;
+    }
+
+    int OnGetTrace(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto clear_it = queries.find("clear");
+        bool clear = clear_it != queries.end() && clear_it->second == "true";
+        ctx->setHeader("Content-Disposition", "attachment; filename=\"trace.json\"");
+        return ctx->send(vmpx::trace::ExportChromeJson(clear), http_content_type::APPLICATION_JSON);
+    }
+
+    int OnSetTrace(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto sample_it = queries.find("sample");
+        if (sample_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [sample] is required"}, HTTP_STATUS_BAD_REQUEST);
+        uint32_t sample_every = 0;
+        const auto& sample = sample_it->second;
+        auto [ptr, ec] = std::from_chars(sample.data(), sample.data() + sample.size(), sample_every);
+        if (ec != std::errc{} || ptr != sample.data() + sample.size())
+            return CtxSendJson(ctx, ErrorEntity{"param [sample] must be a non-negative integer"},
+                               HTTP_STATUS_BAD_REQUEST);
+        vmpx::trace::SetSampleEvery(sample_every);
+        return CtxSendJson(ctx, ErrorEntity{"ok"});
+    }
+
+    int OnProfile(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        uint32_t seconds = DEFAULT_PROFILE_SECONDS;
+        if (auto seconds_it = queries.find("seconds"); seconds_it != queries.end())
+        {
+            auto [ptr, ec] = std::from_chars(seconds_it->second.data(),
+                                             seconds_it->second.data() + seconds_it->second.size(), seconds);
+            if (ec != std::errc{} || ptr != seconds_it->second.data() + seconds_it->second.size() || seconds == 0 ||
+                seconds > vmpx::profiler::MAX_DURATION.count())
+                return CtxSendJson(ctx, ErrorEntity{
+                                       std::format("param [seconds] must be in [1, {}]",
+                                                   vmpx::profiler::MAX_DURATION.count())
+                                   }, HTTP_STATUS_BAD_REQUEST);
+        }
+        // 采样期间IO线程照常处理请求，才能采到真实负载下的调用栈
+        bool started = profile_tasks.TryRun([ctx, seconds](std::stop_token stop_token)
+        {
+            auto profile = vmpx::profiler::Profile(std::chrono::seconds(seconds), stop_token);
+            if (!profile)
+            {
+                CtxSendJson(ctx, ErrorEntity{profile.error()}, HTTP_STATUS_CONFLICT);
+                return;
+            }
+            ctx->setHeader("X-Vmpx-Profile-Samples", std::to_string(profile->samples));
+            ctx->setHeader("X-Vmpx-Profile-Dropped", std::to_string(profile->dropped));
+            ctx->send(profile->folded, http_content_type::TEXT_PLAIN);
+        });
+        if (!started) return CtxSendJson(ctx, ErrorEntity{"another profile is running"}, HTTP_STATUS_CONFLICT);
+        return HTTP_STATUS_UNFINISHED;
+    }
+
+    int OnAdmissionStats(const HttpContextPtr& ctx)
+    {
+        return CtxSendJson(ctx, admission_controller->Stats());
+    }
+
+    int OnArenaStats(const HttpContextPtr& ctx)
+    {
+        return CtxSendJson(ctx, vmpx::arena::GetStats());
+    }
+
+    int OnPackMetrics(const HttpContextPtr& ctx)
+    {
+        return CtxSendJson(ctx, pack_service->GetPackMetrics());
+    }
+
+    int OnPackCacheStats(const HttpContextPtr& ctx)
+    {
+        return CtxSendJson(ctx, pack_service->GetPackCacheStats());
+    }
+
+    int OnIssueSubmit(const HttpContextPtr& ctx)
+    {
+        auto& request = ctx->request;
+        auto& queries = request->query_params;
+        auto name_it = queries.find("name");
+        if (name_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [name] is required"}, HTTP_STATUS_BAD_REQUEST);
+        auto format_it = queries.find("format");
+        std::string_view format_name = format_it != queries.end() ? std::string_view{format_it->second} : "csv";
+        auto format = vmpx::issue::IssueJobService::ParseFormat(format_name);
+        if (!format) return CtxSendJson(ctx, ErrorEntity{format.error()}, HTTP_STATUS_BAD_REQUEST);
+        auto ignore_it = queries.find("ignore_network_adapters");
+        bool ignore_network_adapters = ignore_it != queries.end() && ignore_it->second == "true";
+        auto pi_result = pack_service->GetProductInfo(name_it->second);
+        if (!pi_result)
+            return CtxSendJson(ctx, ErrorEntity{std::format("unable to get product:{}", pi_result.error())},
+                               HTTP_STATUS_BAD_REQUEST);
+        auto job = issue_service->Submit(
+            name_it->second, vmpx::ProductInfoEntity::FromProductInfo(*pi_result), *format,
+            std::span(static_cast<uint8_t*>(request->Content()), request->content_length), ignore_network_adapters);
+        if (!job) return CtxSendJson(ctx, ErrorEntity{job.error()}, HTTP_STATUS_BAD_REQUEST);
+        return CtxSendJson(ctx, job.value());
+    }
+
+    int OnIssueStatus(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto id_it = queries.find("id");
+        if (id_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [id] is required"}, HTTP_STATUS_BAD_REQUEST);
+        auto job = issue_service->Get(id_it->second);
+        if (!job) return CtxSendJson(ctx, ErrorEntity{job.error()}, HTTP_STATUS_NOT_FOUND);
+        return CtxSendJson(ctx, job.value());
+    }
+
+    int OnIssueList(const HttpContextPtr& ctx)
+    {
+        return CtxSendJson(ctx, issue_service->List());
+    }
+
+    int OnIssueCancel(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto id_it = queries.find("id");
+        if (id_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [id] is required"}, HTTP_STATUS_BAD_REQUEST);
+        if (issue_service->Cancel(id_it->second)) return CtxSendJson(ctx, ErrorEntity{"ok"});
+        return CtxSendJson(ctx, ErrorEntity{"no job in progress"}, HTTP_STATUS_NOT_FOUND);
+    }
+
+    int OnIssueRemove(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto id_it = queries.find("id");
+        if (id_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [id] is required"}, HTTP_STATUS_BAD_REQUEST);
+        if (auto removed = issue_service->Remove(id_it->second); !removed)
+            return CtxSendJson(ctx, ErrorEntity{removed.error()}, HTTP_STATUS_BAD_REQUEST);
+        return CtxSendJson(ctx, ErrorEntity{"ok"});
+    }
+
+    int OnIssueDownload(const HttpContextPtr& ctx)
+    {
+        auto& queries = ctx->request->query_params;
+        auto id_it = queries.find("id");
+        if (id_it == queries.end())
+            return CtxSendJson(ctx, ErrorEntity{"param [id] is required"}, HTTP_STATUS_BAD_REQUEST);
+        if (auto job = issue_service->Get(id_it->second); !job)
+            return CtxSendJson(ctx, ErrorEntity{job.error()}, HTTP_STATUS_NOT_FOUND);
+        // 未完成时输出文件不完整，不提供下载
+        auto output_path = issue_service->OutputPath(id_it->second);
+        if (!output_path) return CtxSendJson(ctx, ErrorEntity{output_path.error()}, HTTP_STATUS_CONFLICT);
+        auto extension = output_path->extension().string();
+        ctx->setHeader("Content-Disposition",
+                       std::format("attachment; filename=\"{}{}\"", id_it->second, extension));
+        ctx->setHeader("Content-Type", extension == ".csv" ? "text/csv" : "application/x-ndjson");
+        return ctx->sendFile(output_path->string().c_str());
+    }
 }
 
 log4cplus::Logger vmpx::GetLogger() noexcept
@@ -287,9 +1079,13 @@ void vmpx::InitNetwork() noexcept
 }
 
 void vmpx::StartServer(std::string_view ip, uint16_t port,
-                       std::string_view vmp_console_app_path, std::string_view base_url) noexcept
+                       std::string_view vmp_console_app_path,
+                       size_t max_concurrent_packs, uint32_t pack_timeout_seconds,
+                       const admission::AdmissionOptions& admission_options,
+                       std::string_view base_url) noexcept
 {
     using namespace hv;
+    log4cplus::Logger logger = vmpx::GetLogger();
     auto cwd = std::filesystem::current_path();
     auto data_dir = cwd / "data";
     auto http_service = std::make_unique<HttpService>();
@@ -298,20 +1094,78 @@ void vmpx::StartServer(std::string_view ip, uint16_t port,
     http_service->Static("/", "./assets/static");
     http_service->POST("/gen_serial_number", OnGenSerialNumber);
     http_service->POST("/gen_random_product_info", OnGenRandomProductInfo);
+    http_service->POST("/gen_serial_numbers", OnGenSerialNumbers);
+    admission_controller = std::make_unique<admission::AdmissionController>(admission_options);
+    http_service->preprocessor = Preprocessor;
+    http_service->postprocessor = Postprocessor;
+    http_service->GET("/debug/admission", OnAdmissionStats);
+    http_service->GET("/debug/trace", OnGetTrace);
+    http_service->POST("/debug/trace", OnSetTrace);
+    http_service->GET("/debug/profile", OnProfile);
+    http_service->GET("/debug/arena", OnArenaStats);
     // AppPack Service
     if (!vmp_console_app_path.empty())
     {
+        auto pack_timeout = pack_timeout_seconds
+                                ? std::chrono::milliseconds(std::chrono::seconds(pack_timeout_seconds))
+                                : app_pack::PackExecutor::DEFAULT_TIMEOUT;
         pack_service = std::make_unique<app_pack::AppPackService>(
-            vmp_console_app_path, data_dir);
+            vmp_console_app_path, data_dir, max_concurrent_packs, pack_timeout);
+        pack_service->SetPackEventListener([](std::string_view name, const PackEvent& event)
+        {
+            pack_progress_hub.Publish(name, event);
+        });
+        auto load_stats = pack_service->GetLoadStats();
+        LOG4CPLUS_INFO(logger, LOG4CPLUS_STRING_TO_TSTRING(
+                           std::format("app registry loaded: {} apps, {} pages, {} journal records, "
+                               "load {}ms, replay {}ms, total {}ms",
+                               load_stats.apps, load_stats.pages, load_stats.journal_records,
+                               load_stats.load_ms, load_stats.replay_ms, load_stats.total_ms)));
+        // 核对在后台进行，不推迟开始监听
+        pack_service->StartReconcile([](const app_pack::ReconcileReport& report)
+        {
+            log4cplus::Logger logger = vmpx::GetLogger();
+            LOG4CPLUS_INFO(logger, LOG4CPLUS_STRING_TO_TSTRING(
+                               std::format("app registry reconciled: {} checked, {} repaired, {} broken in {}ms",
+                                   report.checked, report.repaired, report.broken, report.elapsed_ms)));
+            for (const auto& name : report.broken_apps)
+            {
+                LOG4CPLUS_WARN(logger, LOG4CPLUS_STRING_TO_TSTRING(
+                                   std::format("app files are missing, add it again:{}", name)));
+            }
+        });
         http_service->POST("/app/add", OnAppAdd);
+        http_service->POST("/app/update_diff", OnAppUpdateDiff);
+        http_service->POST("/app/update", OnAppUpdate);
+        http_service->GET("/app/project", OnGetAppProject);
+        http_service->POST("/app/project", OnPatchAppProject);
         http_service->GET("/app/remove", OnAppRemove);
         http_service->GET("/app/list", OnAppList);
         http_service->POST("/app/pack", OnAppPack);
+        http_service->POST("/app/pack_batch", OnAppPackBatch);
+        http_service->POST("/app/pack_profiles", OnAppPackProfiles);
         http_service->GET("/app/product_info", OnGetProductInfo);
+        http_service->GET("/app/pack_cancel", OnAppPackCancel);
+        http_service->GET("/app/files", OnAppFiles);
+        http_service->GET("/app/pack_events", OnAppPackEvents);
+        http_service->GET("/app/pack_metrics", OnPackMetrics);
+        http_service->GET("/app/pack_cache", OnPackCacheStats);
+        // 批量签发以App的产品信息生成序列号，未完成的任务在这里恢复
+        issue_service = std::make_unique<issue::IssueJobService>(data_dir / "issue");
+        http_service->POST("/issue/submit", OnIssueSubmit);
+        http_service->GET("/issue/status", OnIssueStatus);
+        http_service->GET("/issue/list", OnIssueList);
+        http_service->GET("/issue/cancel", OnIssueCancel);
+        http_service->GET("/issue/download", OnIssueDownload);
+        http_service->GET("/issue/remove", OnIssueRemove);
     }
     server = std::make_unique<hv::HttpServer>();
     server->registerHttpService(http_service.get());
     server->run(std::format("{}:{}", ip, port).c_str(), true);
+    // 服务已停止，结束仍在加壳或发送的请求
+    pack_batch_tasks.Stop();
+    serial_stream_tasks.Stop();
+    profile_tasks.Stop();
 }
 
 void vmpx::StopServer() noexcept
@@ -0,0 +1,59 @@
+﻿#include "StreamTaskPool.h"
+
+#include <algorithm>
+#include <exception>
+#include <ranges>
+
+vmpx::stream::StreamTaskPool::StreamTaskPool(size_t max_tasks): max_tasks_(std::max<size_t>(1, max_tasks))
+{
+}
+
+vmpx::stream::StreamTaskPool::~StreamTaskPool()
+{
+    Stop();
+}
+
+bool vmpx::stream::StreamTaskPool::TryRun(Task task)
+{
+    std::lock_guard lock(mutex_);
+    if (stopped_) return false;
+    // 已返回的任务在这里回收，join不会阻塞
+    slots_.remove_if([](const Slot& slot) { return slot.done.load(); });
+    if (slots_.size() >= max_tasks_) return false;
+    auto& slot = slots_.emplace_back();
+    slot.thread = std::jthread([task = std::move(task), &slot](std::stop_token stop_token)
+    {
+        try
+        {
+            task(stop_token);
+        }
+        catch (std::exception&)
+        {
+            // 任务自己负责报告错误，这里只保证槽位被释放
+        }
+        slot.done = true;
+    });
+    return true;
+}
+
+void vmpx::stream::StreamTaskPool::Stop()
+{
+    std::list<Slot> slots;
+    {
+        std::lock_guard lock(mutex_);
+        stopped_ = true;
+        for (auto& slot : slots_)
+        {
+            slot.thread.request_stop();
+        }
+        slots.splice(slots.end(), slots_);
+    }
+    // 在锁外join，任务返回前可能还会调用Running
+    slots.clear();
+}
+
+size_t vmpx::stream::StreamTaskPool::Running() const
+{
+    std::lock_guard lock(mutex_);
+    return std::ranges::count_if(slots_, [](const Slot& slot) { return !slot.done.load(); });
+}
@@ -0,0 +1,206 @@
+﻿#include "ZipStream.h"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+
+#include <cryptopp/crc.h>
+
+namespace
+{
+    constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+    constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+    constexpr uint32_t ZIP64_END_SIGNATURE = 0x06064b50;
+    constexpr uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+    constexpr uint32_t END_SIGNATURE = 0x06054b50;
+    constexpr uint16_t ZIP64_EXTRA_ID = 0x0001;
+    constexpr uint16_t VERSION_DEFAULT = 20;
+    constexpr uint16_t VERSION_ZIP64 = 45;
+    // 文件名为UTF-8
+    constexpr uint16_t FLAG_UTF8 = 0x0800;
+    constexpr uint32_t MAX_32 = 0xFFFFFFFF;
+    constexpr uint16_t MAX_16 = 0xFFFF;
+    constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+    // zip中的整数均为小端
+    template <typename T>
+    void Put(std::string& out, T value)
+    {
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (i * 8) & 0xFF));
+        }
+    }
+
+    uint32_t Crc32Final(CryptoPP::CRC32& crc)
+    {
+        std::array<CryptoPP::byte, CryptoPP::CRC32::DIGESTSIZE> digest{};
+        crc.Final(digest.data());
+        return digest[0] | digest[1] << 8 | digest[2] << 16 | static_cast<uint32_t>(digest[3]) << 24;
+    }
+}
+
+vmpx::app_pack::ZipStreamWriter::ZipStreamWriter(Sink sink): sink_(std::move(sink))
+{
+    // 所有条目使用同一个修改时间
+    auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+    auto days = std::chrono::floor<std::chrono::days>(now);
+    std::chrono::year_month_day ymd{days};
+    std::chrono::hh_mm_ss hms{now - days};
+    dos_date_ = static_cast<uint16_t>((static_cast<int>(ymd.year()) - 1980) << 9 |
+        static_cast<unsigned>(ymd.month()) << 5 | static_cast<unsigned>(ymd.day()));
+    dos_time_ = static_cast<uint16_t>(hms.hours().count() << 11 | hms.minutes().count() << 5 |
+        hms.seconds().count() / 2);
+}
+
+bool vmpx::app_pack::ZipStreamWriter::AddFile(std::string_view name, const std::filesystem::path& path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.is_open()) return false;
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    CryptoPP::CRC32 crc;
+    uint64_t size = 0;
+    while (ifs)
+    {
+        ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        crc.Update(reinterpret_cast<const CryptoPP::byte*>(buffer.data()), static_cast<size_t>(ifs.gcount()));
+        size += static_cast<uint64_t>(ifs.gcount());
+    }
+    if (!ifs.eof()) return false;
+    Entry entry{std::string{name}, Crc32Final(crc), size, offset_};
+    if (!WriteLocalHeader(entry)) return false;
+    ifs.clear();
+    ifs.seekg(0);
+    uint64_t written = 0;
+    while (ifs && written < size)
+    {
+        ifs.read(buffer.data(), static_cast<std::streamsize>(std::min<uint64_t>(buffer.size(), size - written)));
+        auto count = static_cast<size_t>(ifs.gcount());
+        if (!Emit(std::string_view(buffer.data(), count))) return false;
+        written += count;
+    }
+    // 两次读取之间文件被修改，已输出的头部与内容不符
+    if (written != size) return false;
+    entries_.push_back(std::move(entry));
+    return true;
+}
+
+bool vmpx::app_pack::ZipStreamWriter::AddData(std::string_view name, std::string_view data)
+{
+    CryptoPP::CRC32 crc;
+    crc.Update(reinterpret_cast<const CryptoPP::byte*>(data.data()), data.size());
+    Entry entry{std::string{name}, Crc32Final(crc), data.size(), offset_};
+    if (!WriteLocalHeader(entry) || !Emit(data)) return false;
+    entries_.push_back(std::move(entry));
+    return true;
+}
+
+bool vmpx::app_pack::ZipStreamWriter::Finish()
+{
+    std::string directory;
+    for (const auto& entry : entries_)
+    {
+        bool zip64_size = entry.size >= MAX_32;
+        bool zip64_offset = entry.offset >= MAX_32;
+        std::string extra;
+        if (zip64_size || zip64_offset)
+        {
+            Put<uint16_t>(extra, ZIP64_EXTRA_ID);
+            Put<uint16_t>(extra, static_cast<uint16_t>((zip64_size ? 16 : 0) + (zip64_offset ? 8 : 0)));
+            if (zip64_size)
+            {
+                Put<uint64_t>(extra, entry.size);
+                Put<uint64_t>(extra, entry.size);
+            }
+            if (zip64_offset) Put<uint64_t>(extra, entry.offset);
+        }
+        uint16_t version = extra.empty() ? VERSION_DEFAULT : VERSION_ZIP64;
+        Put<uint32_t>(directory, CENTRAL_HEADER_SIGNATURE);
+        Put<uint16_t>(directory, version);
+        Put<uint16_t>(directory, version);
+        Put<uint16_t>(directory, FLAG_UTF8);
+        // 存储
+        Put<uint16_t>(directory, 0);
+        Put<uint16_t>(directory, dos_time_);
+        Put<uint16_t>(directory, dos_date_);
+        Put<uint32_t>(directory, entry.crc32);
+        Put<uint32_t>(directory, zip64_size ? MAX_32 : static_cast<uint32_t>(entry.size));
+        Put<uint32_t>(directory, zip64_size ? MAX_32 : static_cast<uint32_t>(entry.size));
+        Put<uint16_t>(directory, static_cast<uint16_t>(entry.name.size()));
+        Put<uint16_t>(directory, static_cast<uint16_t>(extra.size()));
+        // 注释长度、磁盘号、内部属性、外部属性
+        Put<uint16_t>(directory, 0);
+        Put<uint16_t>(directory, 0);
+        Put<uint16_t>(directory, 0);
+        Put<uint32_t>(directory, 0);
+        Put<uint32_t>(directory, zip64_offset ? MAX_32 : static_cast<uint32_t>(entry.offset));
+        directory += entry.name;
+        directory += extra;
+    }
+    uint64_t directory_offset = offset_;
+    uint64_t num_entries = entries_.size();
+    bool zip64 = num_entries >= MAX_16 || directory_offset >= MAX_32 || directory.size() >= MAX_32;
+    if (zip64)
+    {
+        uint64_t zip64_end_offset = directory_offset + directory.size();
+        Put<uint32_t>(directory, ZIP64_END_SIGNATURE);
+        // 记录中此字段之后的长度
+        Put<uint64_t>(directory, 44);
+        Put<uint16_t>(directory, VERSION_ZIP64);
+        Put<uint16_t>(directory, VERSION_ZIP64);
+        Put<uint32_t>(directory, 0);
+        Put<uint32_t>(directory, 0);
+        Put<uint64_t>(directory, num_entries);
+        Put<uint64_t>(directory, num_entries);
+        Put<uint64_t>(directory, zip64_end_offset - directory_offset);
+        Put<uint64_t>(directory, directory_offset);
+        Put<uint32_t>(directory, ZIP64_LOCATOR_SIGNATURE);
+        Put<uint32_t>(directory, 0);
+        Put<uint64_t>(directory, zip64_end_offset);
+        Put<uint32_t>(directory, 1);
+    }
+    uint64_t directory_size = zip64 ? directory.size() - 76 : directory.size();
+    Put<uint32_t>(directory, END_SIGNATURE);
+    Put<uint16_t>(directory, 0);
+    Put<uint16_t>(directory, 0);
+    Put<uint16_t>(directory, zip64 ? MAX_16 : static_cast<uint16_t>(num_entries));
+    Put<uint16_t>(directory, zip64 ? MAX_16 : static_cast<uint16_t>(num_entries));
+    Put<uint32_t>(directory, zip64 ? MAX_32 : static_cast<uint32_t>(directory_size));
+    Put<uint32_t>(directory, zip64 ? MAX_32 : static_cast<uint32_t>(directory_offset));
+    // 注释长度
+    Put<uint16_t>(directory, 0);
+    return Emit(directory);
+}
+
+bool vmpx::app_pack::ZipStreamWriter::WriteLocalHeader(const Entry& entry)
+{
+    bool zip64 = entry.size >= MAX_32;
+    std::string header;
+    Put<uint32_t>(header, LOCAL_HEADER_SIGNATURE);
+    Put<uint16_t>(header, zip64 ? VERSION_ZIP64 : VERSION_DEFAULT);
+    Put<uint16_t>(header, FLAG_UTF8);
+    Put<uint16_t>(header, 0);
+    Put<uint16_t>(header, dos_time_);
+    Put<uint16_t>(header, dos_date_);
+    Put<uint32_t>(header, entry.crc32);
+    Put<uint32_t>(header, zip64 ? MAX_32 : static_cast<uint32_t>(entry.size));
+    Put<uint32_t>(header, zip64 ? MAX_32 : static_cast<uint32_t>(entry.size));
+    Put<uint16_t>(header, static_cast<uint16_t>(entry.name.size()));
+    Put<uint16_t>(header, static_cast<uint16_t>(zip64 ? 20 : 0));
+    header += entry.name;
+    if (zip64)
+    {
+        Put<uint16_t>(header, ZIP64_EXTRA_ID);
+        Put<uint16_t>(header, 16);
+        Put<uint64_t>(header, entry.size);
+        Put<uint64_t>(header, entry.size);
+    }
+    return Emit(header);
+}
+
+bool vmpx::app_pack::ZipStreamWriter::Emit(std::string_view data)
+{
+    if (!sink_(data)) return false;
+    offset_ += data.size();
+    return true;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zip.h>
+
+#include "AppPackService.h"
+#include "Utils.h"
+
+namespace
+{
+    constexpr size_t NUM_APPS = 4;
+    constexpr auto PACK_DURATION = std::chrono::milliseconds(1000);
+
+    /**
+     * 测试程序同时充当加壳程序：VMProtect_Con <.vmp文件> <输出文件>
+     */
+    int FakePacker(const std::filesystem::path& vmp_file_path, const std::filesystem::path& output_path)
+    {
+        std::this_thread::sleep_for(PACK_DURATION);
+        auto input_path = vmp_file_path.parent_path() / "app.exe";
+        std::error_code ec;
+        std::filesystem::copy_file(input_path, output_path, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) return -1;
+        std::cout << "Compilation completed" << std::endl;
+        return 0;
+    }
+
+    std::vector<uint8_t> MakeAppZip(const std::filesystem::path& zip_path, size_t index)
+    {
+        static constexpr std::string_view vmp_content =
+            R"(<?xml version="1.0" encoding="UTF-8" standalone="yes"?>)"
+            R"(<Document><Protection InputFileName="app.exe"/></Document>)";
+        // 每个app的内容不同，避免命中加壳缓存
+        std::string exe_content = std::format("fake app {}", index);
+        int err = 0;
+        zip* za = zip_open(zip_path.string().c_str(), ZIP_CREATE | ZIP_TRUNCATE, &err);
+        zip_file_add(za, "app.exe", zip_source_buffer(za, exe_content.data(), exe_content.size(), 0), 0);
+        zip_file_add(za, "app.vmp", zip_source_buffer(za, vmp_content.data(), vmp_content.size(), 0), 0);
+        zip_close(za);
+        return vmpx::ReadFile(zip_path).value_or(std::vector<uint8_t>{});
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 3 && std::filesystem::path(argv[1]).extension() == ".vmp")
+        return FakePacker(argv[1], argv[2]);
+
+    std::filesystem::path data_dir{"./test_concurrent_pack_data"};
+    std::filesystem::remove_all(data_dir);
+    // 并发上限默认是CPU核数，核数少于NUM_APPS的机器上会被迫串行
+    vmpx::app_pack::AppPackService service(std::filesystem::absolute(argv[0]), data_dir, NUM_APPS);
+    for (size_t i = 0; i < NUM_APPS; ++i)
+    {
+        auto zip_data = MakeAppZip(data_dir / std::format("app{}.zip", i), i);
+        if (auto result = service.Add(std::format("app{}", i), zip_data); !result)
+        {
+            std::cerr << std::format("unable to add app{}:{}", i, result.error()) << "\n";
+            return -1;
+        }
+    }
+
+    std::atomic_size_t num_packed{0};
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::jthread> threads;
+    for (size_t i = 0; i < NUM_APPS; ++i)
+    {
+        threads.emplace_back([&service, &num_packed, i]
+        {
+            auto result = service.Pack(std::format("app{}", i));
+            if (result) ++num_packed;
+            else std::cerr << std::format("unable to pack app{}:{}", i, result.error()) << "\n";
+        });
+    }
+    // 加壳期间读操作不应被阻塞
+    auto max_list_latency = std::chrono::steady_clock::duration::zero();
+    while (num_packed < NUM_APPS && std::chrono::steady_clock::now() - begin < PACK_DURATION * NUM_APPS * 2)
+    {
+        auto list_begin = std::chrono::steady_clock::now();
+        auto apps = service.List();
+        max_list_latency = std::max(max_list_latency, std::chrono::steady_clock::now() - list_begin);
+        if (apps.size() != NUM_APPS) return -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    threads.clear();
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    std::cout << std::format("packed {} apps in {}ms, max List latency {}us", num_packed.load(),
+                             std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),
+                             std::chrono::duration_cast<std::chrono::microseconds>(max_list_latency).count())
+        << "\n";
+    if (num_packed != NUM_APPS) return -1;
+    for (size_t i = 0; i < NUM_APPS; ++i)
+    {
+        if (service.GetPacked(std::format("app{}", i)).empty()) return -1;
+    }
+    // 串行需要NUM_APPS倍的时间
+    if (elapsed >= PACK_DURATION * NUM_APPS / 2) return -1;
+    if (max_list_latency >= PACK_DURATION / 2) return -1;
+    return 0;
+}
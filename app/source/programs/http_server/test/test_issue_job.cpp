@@ -0,0 +1,123 @@
+﻿#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IssueJobService.h"
+
+namespace
+{
+    constexpr size_t NUM_ROWS = 3000;
+    constexpr size_t BAD_ROW = 1234;
+    constexpr uint64_t CHECKPOINT_ROWS = 64;
+    constexpr size_t NUM_THREADS = 4;
+
+    std::string MakeCsv()
+    {
+        // 带BOM和表头，部分字段带引号和逗号
+        std::string csv = "\xEF\xBB\xBFuser_name,email,hwid,exp_date\r\n";
+        for (size_t i = 0; i < NUM_ROWS; ++i)
+        {
+            if (i == BAD_ROW) csv += "bad,bad@example.com,,2030-13-01\r\n";
+            else csv += std::format("\"user, {}\",user{}@example.com,,2030-01-{:02}\r\n", i, i, i % 28 + 1);
+            if (i % 100 == 0) csv += "\r\n";
+        }
+        return csv;
+    }
+
+    std::optional<vmpx::issue::IssueJobInfo> WaitFor(vmpx::issue::IssueJobService& service, const std::string& id,
+                                                     const std::function<bool(const vmpx::issue::IssueJobInfo&)>& pred)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - begin < std::chrono::minutes(5))
+        {
+            auto info = service.Get(id);
+            if (!info) return std::nullopt;
+            if (pred(*info)) return *info;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return std::nullopt;
+    }
+}
+
+int main()
+{
+    std::filesystem::path data_dir{"./test_issue_job_data"};
+    std::filesystem::remove_all(data_dir);
+    auto product_info = vmpx::ProductInfoEntity::FromProductInfo(vmpx::GenRandomProductInfo(2048));
+    auto csv = MakeCsv();
+
+    std::string id;
+    bool interrupted = false;
+    {
+        vmpx::issue::IssueJobService service(data_dir, NUM_THREADS, CHECKPOINT_ROWS);
+        auto submitted = service.Submit("app", product_info, vmpx::issue::IssueFormat::CSV,
+                                        std::span(reinterpret_cast<const uint8_t*>(csv.data()), csv.size()));
+        if (!submitted)
+        {
+            std::cerr << submitted.error() << "\n";
+            return -1;
+        }
+        if (submitted->total_rows != NUM_ROWS) return -1;
+        id = submitted->id;
+        // 写出第一个检查点后模拟重启
+        auto info = WaitFor(service, id, [](const auto& info) { return info.rows_done > 0; });
+        if (!info) return -1;
+        interrupted = info->state != "done";
+    }
+
+    vmpx::issue::IssueJobService service(data_dir, NUM_THREADS, CHECKPOINT_ROWS);
+    auto info = WaitFor(service, id, [](const auto& info)
+    {
+        return info.state != "queued" && info.state != "running";
+    });
+    if (!info || info->state != "done") return -1;
+    std::cout << std::format("issued {} rows, {} failed, {:.0f} rows/s, resumed {}", info->rows_done,
+                             info->rows_failed, info->rows_per_second, info->resumed) << "\n";
+    if (info->rows_done != NUM_ROWS || info->rows_failed != 1) return -1;
+    if (interrupted && info->resumed != 1) return -1;
+
+    // 恢复后既不重复也不遗漏，且保持输入顺序
+    auto output_path = service.OutputPath(id);
+    if (!output_path) return -1;
+    std::ifstream ifs(*output_path);
+    std::string line;
+    std::getline(ifs, line);
+    if (!line.starts_with("index,")) return -1;
+    size_t num_lines = 0;
+    while (std::getline(ifs, line))
+    {
+        if (!line.starts_with(std::format("{},", num_lines))) return -1;
+        bool ok = line.find(",true,") != std::string::npos;
+        if (ok == (num_lines == BAD_ROW)) return -1;
+        ++num_lines;
+    }
+    if (num_lines != NUM_ROWS) return -1;
+
+    // 只保留最近结束的任务，更早的连同目录一起删除
+    std::filesystem::path retention_dir{"./test_issue_job_retention"};
+    std::filesystem::remove_all(retention_dir);
+    vmpx::issue::IssueJobService retention_service(retention_dir, NUM_THREADS, CHECKPOINT_ROWS, 1);
+    std::string small_csv = "a,a@example.com,,2030-01-01\n";
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        auto submitted = retention_service.Submit(
+            "app", product_info, vmpx::issue::IssueFormat::CSV,
+            std::span(reinterpret_cast<const uint8_t*>(small_csv.data()), small_csv.size()));
+        if (!submitted) return -1;
+        ids.push_back(submitted->id);
+    }
+    if (!WaitFor(retention_service, ids[1], [](const auto& info) { return info.state == "done"; })) return -1;
+    if (retention_service.Get(ids[0]) || std::filesystem::exists(retention_dir / ids[0])) return -1;
+    if (!retention_service.Remove(ids[1]) || retention_service.Get(ids[1])) return -1;
+    if (std::filesystem::exists(retention_dir / ids[1])) return -1;
+    return 0;
+}
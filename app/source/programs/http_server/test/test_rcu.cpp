@@ -0,0 +1,76 @@
+﻿#include <atomic>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <ranges>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Rcu.h"
+
+namespace
+{
+    constexpr size_t NUM_READERS = 4;
+    constexpr size_t NUM_KEYS = 64;
+    constexpr uint64_t NUM_UPDATES = 20000;
+}
+
+int main()
+{
+    // 每次更新把所有键改成同一代，读者看到的快照必须完整一致
+    vmpx::app_pack::Rcu<std::unordered_map<size_t, uint64_t>> rcu;
+    rcu.Update([](auto& map)
+    {
+        for (size_t key = 0; key < NUM_KEYS; ++key) map[key] = 0;
+        return true;
+    });
+    std::atomic_bool stop{false};
+    std::atomic_size_t num_torn{0};
+    std::atomic_uint64_t num_reads{0};
+    {
+        std::vector<std::jthread> readers;
+        for (size_t i = 0; i < NUM_READERS; ++i)
+        {
+            readers.emplace_back([&]
+            {
+                uint64_t last_generation = 0;
+                while (!stop)
+                {
+                    auto generation = rcu.Read([&](const auto& map) -> std::optional<uint64_t>
+                    {
+                        auto first = map.at(0);
+                        for (const auto& [key, value] : map)
+                        {
+                            if (value != first) return std::nullopt;
+                        }
+                        return first;
+                    });
+                    // 快照不能撕裂，也不能倒退
+                    if (!generation || generation.value() < last_generation) ++num_torn;
+                    else last_generation = generation.value();
+                    ++num_reads;
+                }
+            });
+        }
+        for (uint64_t generation = 1; generation <= NUM_UPDATES; ++generation)
+        {
+            rcu.Update([generation](auto& map)
+            {
+                for (auto& value : map | std::views::values) value = generation;
+                return true;
+            });
+        }
+        // 放弃的更新不能发布
+        rcu.Update([](auto& map)
+        {
+            map.clear();
+            return false;
+        });
+        stop = true;
+    }
+    auto size = rcu.Read([](const auto& map) { return map.size(); });
+    std::cout << std::format("{} reads, {} torn, {} keys", num_reads.load(), num_torn.load(), size) << "\n";
+    if (num_torn != 0 || size != NUM_KEYS) return -1;
+    return 0;
+}
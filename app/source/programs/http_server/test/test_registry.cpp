@@ -0,0 +1,79 @@
+﻿#include <filesystem>
+#include <format>
+#include <iostream>
+#include <map>
+#include <ranges>
+#include <string>
+
+#include "RegistryIndex.h"
+#include "RegistryStore.h"
+
+namespace
+{
+    constexpr size_t NUM_APPS = 5000;
+}
+
+int main()
+{
+    std::filesystem::path data_dir{"./test_registry_data"};
+    std::filesystem::remove_all(data_dir);
+    std::filesystem::create_directories(data_dir);
+
+    vmpx::app_pack::RegistryIndex index;
+    std::map<std::string, std::string> expected;
+    for (size_t i = 0; i < NUM_APPS; ++i)
+    {
+        auto name = std::format("app{}", i);
+        index.Put(name, {std::format("{}.vmp", name), ""});
+        expected[name] = std::format("{}.vmp", name);
+    }
+    for (size_t i = 0; i < NUM_APPS; i += 3)
+    {
+        auto name = std::format("app{}", i);
+        index.Erase(name);
+        expected.erase(name);
+    }
+    if (index.Size() != expected.size()) return -1;
+
+    // 按前缀分页列出，结果应与有序map一致
+    std::vector<std::string> listed;
+    std::string cursor;
+    do
+    {
+        auto page = index.List("app1", cursor, 37);
+        listed.insert(listed.end(), page.names.begin(), page.names.end());
+        cursor = page.next_cursor;
+    }
+    while (!cursor.empty());
+    std::vector<std::string> expected_listed;
+    for (const auto& name : expected | std::views::keys)
+    {
+        if (name.starts_with("app1")) expected_listed.push_back(name);
+    }
+    if (listed != expected_listed) return -1;
+
+    // 保存后只修改一页，增量保存写入的字节远小于全量
+    uint64_t full_bytes = 0, incremental_bytes = 0;
+    {
+        vmpx::app_pack::RegistryStore store(data_dir);
+        if (!store.Save(index)) return -1;
+        full_bytes = std::filesystem::file_size(data_dir / "registry.1.pages");
+        index.Put("app1", {"changed.vmp", "changed.exe"});
+        expected["app1"] = "changed.vmp";
+        if (!store.Save(index)) return -1;
+        incremental_bytes = std::filesystem::file_size(data_dir / "registry.1.pages") - full_bytes;
+    }
+    std::cout << std::format("{} apps in {} pages, full save {}B, incremental save {}B", index.Size(),
+                             index.Pages().size(), full_bytes, incremental_bytes) << "\n";
+    if (incremental_bytes * 10 > full_bytes) return -1;
+
+    vmpx::app_pack::RegistryStore store(data_dir);
+    auto loaded = store.Load();
+    if (!loaded || loaded->Size() != expected.size()) return -1;
+    for (const auto& [name, vmp_file_path] : expected)
+    {
+        auto app_info = loaded->Find(name);
+        if (!app_info || app_info->vmp_file_path != vmp_file_path) return -1;
+    }
+    return 0;
+}
@@ -1,9 +1,13 @@
 local target_name = "vmpx_server"
 local kind = "binary"
 local group_name = "program"
-local pkgs = { "log4cplus", "libhv", "yalantinglibs", "argparse", "libzip", "utfcpp", "uchardet" }
+local pkgs = { "log4cplus", "libhv", "yalantinglibs", "argparse", "libzip", "utfcpp", "uchardet", "cryptopp" }
 local deps = { "runtime" }
 local syslinks = {}
 local function callback()
+    if is_plat("linux") then
+        -- 导出符号，/debug/profile才能解析出函数名
+        add_ldflags("-rdynamic")
+    end
 end
 CreateTarget(target_name, kind, os.scriptdir(), group_name, pkgs, deps, syslinks, callback)
@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vmpx
+{
+    namespace loadgen
+    {
+        /**
+         * 对数-线性分桶的延迟直方图，每个2的幂区间分128个桶，相对误差小于1%
+         * 各线程各自记录，结束后合并
+         */
+        class LatencyHistogram
+        {
+        public:
+            static constexpr uint32_t SUB_BUCKET_BITS = 7;
+            static constexpr uint32_t SUB_BUCKET_COUNT = 1u << SUB_BUCKET_BITS;
+            // 以微秒计，上限约12天
+            static constexpr uint32_t MAX_VALUE_BITS = 40;
+
+            LatencyHistogram();
+
+            void Record(uint64_t value, uint64_t count = 1);
+
+            void Merge(const LatencyHistogram& other);
+
+            /**
+             * 修正协调遗漏：长于期望间隔的样本说明期间本应发出的请求被推迟了，
+             * 按间隔递减补上这些请求本应观察到的延迟
+             * @param expected_interval 期望的请求间隔，0表示不修正
+             * @return 修正后的副本
+             */
+            LatencyHistogram CorrectedCopy(uint64_t expected_interval) const;
+
+            /**
+             * @param percentile 0~100
+             * @return 该分位所在桶的上界，没有样本时为0
+             */
+            uint64_t Percentile(double percentile) const;
+
+            uint64_t Count() const { return total_count_; }
+            uint64_t Max() const { return max_; }
+            double Mean() const;
+
+        private:
+            static size_t IndexOf(uint64_t value);
+            static uint64_t HighestValueAt(size_t index);
+
+            std::vector<uint64_t> counts_;
+            uint64_t total_count_{0};
+            uint64_t max_{0};
+            double sum_{0};
+        };
+    }
+}
@@ -0,0 +1,93 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vmpx
+{
+    namespace loadgen
+    {
+        /**
+         * 负载中的一个接口及其权重，name为OpenAPI中去掉/api/v1前缀的路径，如app/list
+         */
+        struct WorkloadRoute
+        {
+            std::string name;
+            uint32_t weight;
+        };
+
+        struct LoadOptions
+        {
+            // 如http://127.0.0.1:80/api/v1
+            std::string base_url;
+            std::vector<WorkloadRoute> mix;
+            // 大于0时按固定速率（次/秒）发送，否则每个连接收到回复后立即发下一个
+            double rate = 0;
+            size_t connections = 8;
+            std::chrono::seconds duration{30};
+            // 预热期间的结果不计入统计
+            std::chrono::seconds warmup{5};
+            std::chrono::seconds timeout{30};
+            // app/pack、app/product_info使用的app
+            std::string app_name;
+            // app/add上传的压缩包
+            std::filesystem::path zip_path;
+            // gen_random_product_info、gen_serial_number使用的密钥长度
+            uint32_t key_size = 2048;
+        };
+
+        struct RouteReport
+        {
+            std::string route;
+            uint64_t requests;
+            uint64_t errors;
+            // 成功请求数/秒
+            double throughput;
+            // 以下为修正协调遗漏后的延迟，微秒
+            double mean_us;
+            uint64_t p50_us;
+            uint64_t p99_us;
+            uint64_t p999_us;
+            uint64_t max_us;
+            // 未修正的p99，与p99_us相差很大说明服务端有停顿
+            uint64_t raw_p99_us;
+        };
+
+        struct LoadReport
+        {
+            // rate或concurrency
+            std::string mode;
+            double target_rate;
+            uint64_t connections;
+            double elapsed_seconds;
+            uint64_t requests;
+            uint64_t errors;
+            double throughput;
+            std::vector<RouteReport> routes;
+        };
+
+        /**
+         * @return 可以出现在负载中的接口
+         */
+        std::vector<std::string_view> SupportedRoutes();
+
+        /**
+         * 解析形如app/list=80,gen_serial_number=20的负载配置
+         * @param mix 
+         * @return 
+         */
+        std::expected<std::vector<WorkloadRoute>, std::string> ParseMix(std::string_view mix);
+
+        /**
+         * 对服务端施加负载，阻塞到结束
+         * 固定速率时延迟从计划发送的时间算起；固定并发时以平均延迟为期望间隔事后修正
+         * @param options 
+         * @return 
+         */
+        std::expected<LoadReport, std::string> RunLoad(const LoadOptions& options);
+    }
+}
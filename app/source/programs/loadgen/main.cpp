@@ -0,0 +1,129 @@
+﻿#include <chrono>
+#include <expected>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <argparse/argparse.hpp>
+#include <ylt/struct_json/json_writer.h>
+
+#include "LoadGenerator.h"
+
+namespace
+{
+    struct Arguments
+    {
+        vmpx::loadgen::LoadOptions load_options;
+        std::string json_path;
+    };
+
+    std::expected<Arguments, std::string> ParseArguments(int argc, char* argv[])
+    {
+        std::string supported_routes;
+        for (auto route : vmpx::loadgen::SupportedRoutes())
+        {
+            supported_routes += std::format("{}{}", supported_routes.empty() ? "" : ",", route);
+        }
+        argparse::ArgumentParser argument_parser("vmpx_loadgen");
+        argument_parser.add_argument("url").default_value(std::string{"http://127.0.0.1:80/api/v1"})
+                       .help("api base url,default: http://127.0.0.1:80/api/v1");
+        argument_parser.add_argument("--mix").default_value(std::string{"app/list=1"})
+                       .help(std::format("weighted routes,e.g. app/list=80,gen_serial_number=20,supported: {}",
+                                         supported_routes));
+        argument_parser.add_argument("--rate").default_value(0.0)
+                       .help("requests per second,default 0(fixed concurrency)").scan<'g', double>();
+        argument_parser.add_argument("--connections").default_value(static_cast<size_t>(8))
+                       .help("number of connections,default 8").scan<'u', size_t>();
+        argument_parser.add_argument("--duration").default_value(static_cast<uint32_t>(30))
+                       .help("seconds to measure,default 30").scan<'u', uint32_t>();
+        argument_parser.add_argument("--warmup").default_value(static_cast<uint32_t>(5))
+                       .help("seconds to run before measuring,default 5").scan<'u', uint32_t>();
+        argument_parser.add_argument("--timeout").default_value(static_cast<uint32_t>(30))
+                       .help("request timeout in seconds,default 30").scan<'u', uint32_t>();
+        argument_parser.add_argument("--app").default_value(std::string{})
+                       .help("app used by app/pack and app/product_info");
+        argument_parser.add_argument("--zip").default_value(std::string{})
+                       .help("zip uploaded by app/add");
+        argument_parser.add_argument("--key-size").default_value(static_cast<uint32_t>(2048))
+                       .help("key size used by gen_random_product_info and gen_serial_number,default 2048")
+                       .scan<'u', uint32_t>();
+        argument_parser.add_argument("--json").default_value(std::string{})
+                       .help("write the report to this file as json");
+        try
+        {
+            argument_parser.parse_args(argc, argv);
+        }
+        catch (const std::exception& e)
+        {
+            return std::unexpected{std::format("{}\n{}", e.what(), argument_parser.help().str())};
+        }
+        auto mix = vmpx::loadgen::ParseMix(argument_parser.get<std::string>("--mix"));
+        if (!mix) return std::unexpected{mix.error()};
+        auto url = argument_parser.get<std::string>("url");
+        while (url.ends_with('/')) url.pop_back();
+        return Arguments{
+            .load_options = {
+                .base_url = url,
+                .mix = std::move(mix.value()),
+                .rate = argument_parser.get<double>("--rate"),
+                .connections = argument_parser.get<size_t>("--connections"),
+                .duration = std::chrono::seconds(argument_parser.get<uint32_t>("--duration")),
+                .warmup = std::chrono::seconds(argument_parser.get<uint32_t>("--warmup")),
+                .timeout = std::chrono::seconds(argument_parser.get<uint32_t>("--timeout")),
+                .app_name = argument_parser.get<std::string>("--app"),
+                .zip_path = argument_parser.get<std::string>("--zip"),
+                .key_size = argument_parser.get<uint32_t>("--key-size"),
+            },
+            .json_path = argument_parser.get<std::string>("--json"),
+        };
+    }
+
+    void PrintReport(const vmpx::loadgen::LoadReport& report)
+    {
+        std::cout << std::format("mode:{} rate:{} connections:{} elapsed:{:.1f}s requests:{} errors:{} "
+                                 "throughput:{:.1f}/s\n",
+                                 report.mode, report.target_rate, report.connections, report.elapsed_seconds,
+                                 report.requests, report.errors, report.throughput);
+        std::cout << std::format("{:<26}{:>10}{:>8}{:>12}{:>12}{:>12}{:>12}{:>12}{:>14}\n", "route", "requests",
+                                 "errors", "req/s", "p50(us)", "p99(us)", "p999(us)", "max(us)", "raw p99(us)");
+        for (const auto& route : report.routes)
+        {
+            std::cout << std::format("{:<26}{:>10}{:>8}{:>12.1f}{:>12}{:>12}{:>12}{:>12}{:>14}\n", route.route,
+                                     route.requests, route.errors, route.throughput, route.p50_us, route.p99_us,
+                                     route.p999_us, route.max_us, route.raw_p99_us);
+        }
+    }
+}
+
+/**
+ * vmpx_loadgen [url] --mix app/list=80,gen_serial_number=20 [--rate 200 | --connections 16]
+ */
+int main(int argc, char* argv[])
+{
+    auto arguments = ParseArguments(argc, argv);
+    if (!arguments)
+    {
+        std::cerr << arguments.error() << "\n";
+        return 1;
+    }
+    auto report = vmpx::loadgen::RunLoad(arguments->load_options);
+    if (!report)
+    {
+        std::cerr << std::format("unable to run load:{}", report.error()) << "\n";
+        return 1;
+    }
+    PrintReport(report.value());
+    if (!arguments->json_path.empty())
+    {
+        std::string json;
+        struct_json::to_json(report.value(), json);
+        std::ofstream ofs(arguments->json_path, std::ios::binary);
+        ofs << json;
+        if (!ofs)
+        {
+            std::cerr << std::format("unable to write report:{}", arguments->json_path) << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
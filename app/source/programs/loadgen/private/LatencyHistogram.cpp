@@ -0,0 +1,85 @@
+﻿#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+vmpx::loadgen::LatencyHistogram::LatencyHistogram():
+    counts_((MAX_VALUE_BITS - SUB_BUCKET_BITS + 2) * SUB_BUCKET_COUNT, 0)
+{
+}
+
+void vmpx::loadgen::LatencyHistogram::Record(uint64_t value, uint64_t count)
+{
+    if (count == 0) return;
+    value = std::min(value, (uint64_t{1} << MAX_VALUE_BITS) - 1);
+    counts_[IndexOf(value)] += count;
+    total_count_ += count;
+    max_ = std::max(max_, value);
+    sum_ += static_cast<double>(value) * static_cast<double>(count);
+}
+
+void vmpx::loadgen::LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+        counts_[i] += other.counts_[i];
+    }
+    total_count_ += other.total_count_;
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+vmpx::loadgen::LatencyHistogram vmpx::loadgen::LatencyHistogram::CorrectedCopy(uint64_t expected_interval) const
+{
+    LatencyHistogram corrected;
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+        if (counts_[i] == 0) continue;
+        auto value = std::min(HighestValueAt(i), max_);
+        corrected.Record(value, counts_[i]);
+        if (expected_interval == 0 || value <= expected_interval) continue;
+        for (auto missing = value - expected_interval; missing >= expected_interval; missing -= expected_interval)
+        {
+            corrected.Record(missing, counts_[i]);
+        }
+    }
+    return corrected;
+}
+
+uint64_t vmpx::loadgen::LatencyHistogram::Percentile(double percentile) const
+{
+    if (total_count_ == 0) return 0;
+    auto target = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 *
+        static_cast<double>(total_count_)));
+    target = std::max<uint64_t>(target, 1);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+        cumulative += counts_[i];
+        if (cumulative >= target) return std::min(HighestValueAt(i), max_);
+    }
+    return max_;
+}
+
+double vmpx::loadgen::LatencyHistogram::Mean() const
+{
+    return total_count_ == 0 ? 0 : sum_ / static_cast<double>(total_count_);
+}
+
+size_t vmpx::loadgen::LatencyHistogram::IndexOf(uint64_t value)
+{
+    // 小于128的值每个值一个桶，之后每翻一倍128个桶
+    if (value < SUB_BUCKET_COUNT) return static_cast<size_t>(value);
+    auto shift = static_cast<uint32_t>(std::bit_width(value)) - SUB_BUCKET_BITS - 1;
+    auto sub_bucket = (value >> shift) - SUB_BUCKET_COUNT;
+    return (shift + 1) * SUB_BUCKET_COUNT + static_cast<size_t>(sub_bucket);
+}
+
+uint64_t vmpx::loadgen::LatencyHistogram::HighestValueAt(size_t index)
+{
+    if (index < SUB_BUCKET_COUNT) return index;
+    auto shift = static_cast<uint32_t>(index / SUB_BUCKET_COUNT) - 1;
+    auto sub_bucket = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+    return ((sub_bucket + 1) << shift) - 1;
+}
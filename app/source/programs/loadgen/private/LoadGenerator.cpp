@@ -0,0 +1,282 @@
+﻿#include "LoadGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <ranges>
+#include <thread>
+#include <hv/HttpClient.h>
+
+#include "LatencyHistogram.h"
+
+namespace
+{
+    constexpr std::string_view SAMPLE_HWID = "eENCrFnwMIMzwzPH3pgmMMInHQUy5rsv7qM52r5jO30=";
+    constexpr std::string_view ADDED_APP_PREFIX = "loadgen-";
+
+    struct RouteSpec
+    {
+        std::string_view name;
+        http_method method;
+        // app/add需要每次使用不同的名字
+        bool unique_name;
+    };
+
+    constexpr std::array ROUTE_SPECS{
+        RouteSpec{"gen_random_product_info", HTTP_POST, false},
+        RouteSpec{"gen_serial_number", HTTP_POST, false},
+        RouteSpec{"app/list", HTTP_GET, false},
+        RouteSpec{"app/add", HTTP_POST, true},
+        RouteSpec{"app/pack", HTTP_POST, false},
+        RouteSpec{"app/product_info", HTTP_GET, false},
+    };
+
+    /**
+     * 发送前准备好的请求，url和请求体在整个运行期间不变
+     */
+    struct PreparedRoute
+    {
+        std::string name;
+        http_method method;
+        std::string url;
+        std::string body;
+        std::string content_type;
+        bool unique_name;
+    };
+
+    struct RouteStats
+    {
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        vmpx::loadgen::LatencyHistogram corrected;
+        vmpx::loadgen::LatencyHistogram raw;
+    };
+
+    bool Send(hv::HttpClient& client, const PreparedRoute& route, std::chrono::seconds timeout, uint64_t sequence,
+              std::string* response_body = nullptr)
+    {
+        HttpRequest request;
+        request.method = route.method;
+        request.url = route.unique_name ? std::format("{}{}{}", route.url, ADDED_APP_PREFIX, sequence) : route.url;
+        request.timeout = static_cast<int>(timeout.count());
+        if (!route.body.empty())
+        {
+            request.body = route.body;
+            request.headers["Content-Type"] = route.content_type;
+        }
+        HttpResponse response;
+        if (client.send(&request, &response) != 0) return false;
+        if (response_body) *response_body = std::move(response.body);
+        return response.status_code >= 200 && response.status_code < 300;
+    }
+
+    std::expected<std::string, std::string> ReadFileString(const std::filesystem::path& path)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open()) return std::unexpected{std::format("unable to open file:{}", path.string())};
+        return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+
+    /**
+     * 生成各接口的请求，gen_serial_number需要先向服务端要一份ProductInfo
+     * @param options 
+     * @return 与options.mix一一对应
+     */
+    std::expected<std::vector<PreparedRoute>, std::string> PrepareRoutes(const vmpx::loadgen::LoadOptions& options)
+    {
+        std::vector<PreparedRoute> routes;
+        for (const auto& [name, weight] : options.mix)
+        {
+            auto spec = std::ranges::find(ROUTE_SPECS, std::string_view{name}, &RouteSpec::name);
+            if (spec == ROUTE_SPECS.end()) return std::unexpected{std::format("unsupported route:{}", name)};
+            PreparedRoute route{
+                .name = name,
+                .method = spec->method,
+                .url = std::format("{}/{}", options.base_url, name),
+                .unique_name = spec->unique_name
+            };
+            if (name == "gen_random_product_info")
+            {
+                route.body = std::format(R"({{"key_size":{}}})", options.key_size);
+                route.content_type = "application/json";
+            }
+            else if (name == "gen_serial_number")
+            {
+                hv::HttpClient client;
+                PreparedRoute product_info_route{
+                    .name = "gen_random_product_info",
+                    .method = HTTP_POST,
+                    .url = std::format("{}/gen_random_product_info", options.base_url),
+                    .body = std::format(R"({{"key_size":{}}})", options.key_size),
+                    .content_type = "application/json",
+                };
+                std::string product_info_json;
+                if (!Send(client, product_info_route, options.timeout, 0, &product_info_json))
+                    return std::unexpected{"unable to get product info for gen_serial_number"};
+                route.body = std::format(
+                    R"({{"product_info":{},"serial_info":{{"user_name":"loadgen","email":"loadgen@vmpx.local",)"
+                    R"("hwid":"{}","exp_year":2030,"exp_month":1,"exp_day":1}},"ignore_network_adapters":false}})",
+                    product_info_json, SAMPLE_HWID);
+                route.content_type = "application/json";
+            }
+            else if (name == "app/add")
+            {
+                if (options.zip_path.empty()) return std::unexpected{"app/add requires a zip file"};
+                auto zip_data = ReadFileString(options.zip_path);
+                if (!zip_data) return std::unexpected{zip_data.error()};
+                route.url += "?name=";
+                route.body = std::move(zip_data.value());
+                route.content_type = "application/octet-stream";
+            }
+            else if (name == "app/pack" || name == "app/product_info")
+            {
+                if (options.app_name.empty()) return std::unexpected{std::format("{} requires an app name", name)};
+                route.url += std::format("?name={}", options.app_name);
+            }
+            routes.push_back(std::move(route));
+        }
+        return routes;
+    }
+}
+
+std::vector<std::string_view> vmpx::loadgen::SupportedRoutes()
+{
+    std::vector<std::string_view> names;
+    for (const auto& spec : ROUTE_SPECS)
+    {
+        names.push_back(spec.name);
+    }
+    return names;
+}
+
+std::expected<std::vector<vmpx::loadgen::WorkloadRoute>, std::string> vmpx::loadgen::ParseMix(std::string_view mix)
+{
+    std::vector<WorkloadRoute> routes;
+    for (auto part : std::views::split(mix, ','))
+    {
+        std::string_view item(part.begin(), part.end());
+        if (item.empty()) continue;
+        auto pos = item.find('=');
+        WorkloadRoute route{std::string{item.substr(0, pos)}, 1};
+        if (pos != std::string_view::npos)
+        {
+            auto weight = item.substr(pos + 1);
+            auto [ptr, ec] = std::from_chars(weight.data(), weight.data() + weight.size(), route.weight);
+            if (ec != std::errc{} || ptr != weight.data() + weight.size())
+                return std::unexpected{std::format("invalid weight:{}", item)};
+        }
+        if (std::ranges::find(ROUTE_SPECS, std::string_view{route.name}, &RouteSpec::name) == ROUTE_SPECS.end())
+            return std::unexpected{std::format("unsupported route:{}", route.name)};
+        if (route.weight > 0) routes.push_back(std::move(route));
+    }
+    if (routes.empty()) return std::unexpected{"workload mix is empty"};
+    return routes;
+}
+
+std::expected<vmpx::loadgen::LoadReport, std::string> vmpx::loadgen::RunLoad(const LoadOptions& options)
+{
+    if (options.mix.empty()) return std::unexpected{"workload mix is empty"};
+    if (options.connections == 0) return std::unexpected{"at least one connection is required"};
+    auto routes = PrepareRoutes(options);
+    if (!routes) return std::unexpected{routes.error()};
+    std::vector<uint32_t> weights;
+    for (const auto& route : options.mix)
+    {
+        weights.push_back(route.weight);
+    }
+
+    using Clock = std::chrono::steady_clock;
+    bool fixed_rate = options.rate > 0;
+    auto start = Clock::now();
+    auto warmup_end = start + options.warmup;
+    auto end = warmup_end + options.duration;
+    auto interval = std::chrono::duration<double>(fixed_rate ? 1.0 / options.rate : 0);
+    std::atomic_uint64_t next_slot{0};
+    std::atomic_uint64_t next_sequence{0};
+    std::vector<std::vector<RouteStats>> worker_stats(options.connections, std::vector<RouteStats>(routes->size()));
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(options.connections);
+        for (size_t i = 0; i < options.connections; ++i)
+        {
+            workers.emplace_back([&, i]
+            {
+                hv::HttpClient client;
+                std::mt19937_64 rng{i};
+                std::discrete_distribution<size_t> pick_route(weights.begin(), weights.end());
+                auto& stats = worker_stats[i];
+                while (true)
+                {
+                    // 固定速率：请求按计划时间排布，发不出去的请求排队等待，等待时间计入延迟
+                    auto intended = Clock::now();
+                    if (fixed_rate)
+                    {
+                        intended = start + std::chrono::duration_cast<Clock::duration>(interval * next_slot++);
+                        if (intended >= end) break;
+                        std::this_thread::sleep_until(intended);
+                    }
+                    else if (intended >= end) break;
+                    auto route_index = pick_route(rng);
+                    auto send_time = Clock::now();
+                    bool ok = Send(client, routes.value()[route_index], options.timeout, next_sequence++);
+                    auto done = Clock::now();
+                    if (intended < warmup_end) continue;
+                    auto& route_stats = stats[route_index];
+                    ++route_stats.requests;
+                    if (!ok) ++route_stats.errors;
+                    route_stats.corrected.Record(
+                        std::chrono::duration_cast<std::chrono::microseconds>(done - intended).count());
+                    route_stats.raw.Record(
+                        std::chrono::duration_cast<std::chrono::microseconds>(done - send_time).count());
+                }
+            });
+        }
+    }
+    auto elapsed_seconds = std::chrono::duration<double>(std::min(Clock::now(), end) - warmup_end).count();
+    elapsed_seconds = std::max(elapsed_seconds, 1e-3);
+
+    LoadReport report{
+        .mode = fixed_rate ? "rate" : "concurrency",
+        .target_rate = options.rate,
+        .connections = options.connections,
+        .elapsed_seconds = elapsed_seconds,
+    };
+    for (size_t route_index = 0; route_index < routes->size(); ++route_index)
+    {
+        RouteStats merged;
+        for (const auto& stats : worker_stats)
+        {
+            const auto& route_stats = stats[route_index];
+            merged.requests += route_stats.requests;
+            merged.errors += route_stats.errors;
+            merged.corrected.Merge(route_stats.corrected);
+            merged.raw.Merge(route_stats.raw);
+        }
+        // 固定并发时每个连接等回复才发下一个，以平均延迟作为期望间隔补上被推迟的请求
+        auto corrected = fixed_rate
+                             ? merged.corrected
+                             : merged.raw.CorrectedCopy(static_cast<uint64_t>(merged.raw.Mean()));
+        auto succeeded = merged.requests - merged.errors;
+        report.routes.push_back(RouteReport{
+            .route = routes.value()[route_index].name,
+            .requests = merged.requests,
+            .errors = merged.errors,
+            .throughput = static_cast<double>(succeeded) / elapsed_seconds,
+            .mean_us = corrected.Mean(),
+            .p50_us = corrected.Percentile(50),
+            .p99_us = corrected.Percentile(99),
+            .p999_us = corrected.Percentile(99.9),
+            .max_us = corrected.Max(),
+            .raw_p99_us = merged.raw.Percentile(99),
+        });
+        report.requests += merged.requests;
+        report.errors += merged.errors;
+    }
+    report.throughput = static_cast<double>(report.requests - report.errors) / elapsed_seconds;
+    return report;
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace vmpx
+{
+    namespace arena
+    {
+        struct ArenaStats
+        {
+            uint64_t requests;
+            // 单个请求从arena分配的最大字节数
+            uint64_t high_water_bytes;
+            uint64_t total_bytes;
+            // 线程缓冲不够、向堆申请过内存的请求数
+            uint64_t overflowed;
+            uint64_t thread_buffer_bytes;
+        };
+
+        /**
+         * 请求级的单调分配器，分配只移动指针，析构时一次性释放
+         * 优先使用线程局部的缓冲（每个线程只分配一次），用完后才向堆申请
+         * 从arena分配的容器不能移动到请求之外，复制出去的会改用默认分配器
+         */
+        class RequestArena : public std::pmr::memory_resource
+        {
+        public:
+            static constexpr size_t THREAD_BUFFER_BYTES = 64 * 1024;
+
+            RequestArena();
+            ~RequestArena() override;
+            RequestArena(const RequestArena& other) = delete;
+            RequestArena(RequestArena&& other) noexcept = delete;
+            RequestArena& operator=(const RequestArena& other) = delete;
+            RequestArena& operator=(RequestArena&& other) noexcept = delete;
+
+            size_t BytesAllocated() const noexcept
+            {
+                return bytes_allocated_;
+            }
+
+        protected:
+            void* do_allocate(size_t bytes, size_t alignment) override;
+            void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        private:
+            /**
+             * 记录是否向堆申请过内存
+             */
+            class UpstreamResource : public std::pmr::memory_resource
+            {
+            public:
+                bool used = false;
+
+            protected:
+                void* do_allocate(size_t bytes, size_t alignment) override;
+                void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+                bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+            };
+
+            // 同一线程上嵌套的arena不能共用线程缓冲
+            bool owns_thread_buffer_;
+            UpstreamResource upstream_;
+            std::pmr::monotonic_buffer_resource resource_;
+            size_t bytes_allocated_{0};
+        };
+
+        ArenaStats GetStats() noexcept;
+    }
+}
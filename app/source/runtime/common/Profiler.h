@@ -0,0 +1,35 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <stop_token>
+#include <string>
+
+namespace vmpx
+{
+    namespace profiler
+    {
+        // 不取100，避免和周期为10ms的定时任务同步而总是采到同一处
+        constexpr uint32_t SAMPLE_FREQUENCY = 99;
+        constexpr auto MAX_DURATION = std::chrono::seconds(60);
+
+        struct ProfileResult
+        {
+            // 折叠栈，每行为"根;...;叶 次数"，可直接交给flamegraph.pl或speedscope
+            std::string folded;
+            uint64_t samples;
+            // 缓冲已满而丢弃的采样数
+            uint64_t dropped;
+        };
+
+        /**
+         * 按CPU时间对进程内所有线程的调用栈采样，阻塞直到采样结束
+         * 不采样时不启用定时器也不运行采样线程，没有额外开销；同一时间只能有一个采样
+         * @param duration 不超过MAX_DURATION
+         * @param stop_token 请求停止后提前结束，返回已采到的样本
+         * @return 
+         */
+        std::expected<ProfileResult, std::string> Profile(std::chrono::milliseconds duration,
+                                                          std::stop_token stop_token = {});
+    }
+}
@@ -0,0 +1,118 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace vmpx
+{
+    namespace trace
+    {
+        /**
+         * 请求的追踪上下文，request_id为0表示当前请求未被采样
+         */
+        struct TraceContext
+        {
+            uint64_t request_id = 0;
+        };
+
+        namespace detail
+        {
+            inline thread_local TraceContext current_context;
+
+            uint64_t NowNs() noexcept;
+            void Record(const char* name, uint64_t begin_ns, uint64_t end_ns) noexcept;
+        }
+
+        /**
+         * 设置采样间隔，0为关闭，1为每个请求，N为每N个请求采样一个
+         * @param sample_every 
+         */
+        void SetSampleEvery(uint32_t sample_every) noexcept;
+
+        uint32_t GetSampleEvery() noexcept;
+
+        /**
+         * 请求开始，按采样设置决定本线程接下来的span是否记录
+         * @param name 请求名，一般为路径
+         * @param force 不论采样设置都记录
+         * @return 是否被采样
+         */
+        bool BeginRequest(std::string_view name, bool force = false);
+
+        /**
+         * 请求结束，记录整个请求的span，未被采样时什么都不做
+         */
+        void EndRequest() noexcept;
+
+        inline TraceContext CurrentContext() noexcept
+        {
+            return detail::current_context;
+        }
+
+        /**
+         * 在其它线程上继续记录某个请求的span，析构时恢复原来的上下文
+         */
+        class ContextScope
+        {
+        public:
+            explicit ContextScope(TraceContext context) noexcept: previous_(detail::current_context)
+            {
+                detail::current_context = context;
+            }
+
+            ~ContextScope()
+            {
+                detail::current_context = previous_;
+            }
+
+            ContextScope(const ContextScope& other) = delete;
+            ContextScope(ContextScope&& other) noexcept = delete;
+            ContextScope& operator=(const ContextScope& other) = delete;
+            ContextScope& operator=(ContextScope&& other) noexcept = delete;
+
+        private:
+            TraceContext previous_;
+        };
+
+        /**
+         * 作用域span，当前请求未被采样时只有一次线程局部变量的读取
+         * name必须是字符串字面量
+         */
+        class Span
+        {
+        public:
+            explicit Span(const char* name) noexcept
+            {
+                if (detail::current_context.request_id == 0) return;
+                name_ = name;
+                begin_ns_ = detail::NowNs();
+            }
+
+            ~Span()
+            {
+                if (name_) detail::Record(name_, begin_ns_, detail::NowNs());
+            }
+
+            Span(const Span& other) = delete;
+            Span(Span&& other) noexcept = delete;
+            Span& operator=(const Span& other) = delete;
+            Span& operator=(Span&& other) noexcept = delete;
+
+        private:
+            const char* name_{nullptr};
+            uint64_t begin_ns_{0};
+        };
+
+        /**
+         * 以Chrome trace JSON导出所有线程缓冲中的事件，可直接在Perfetto中打开
+         * 已退出线程的事件只导出一次，之后缓冲被移除
+         * @param clear 导出后清空
+         * @return 
+         */
+        std::string ExportChromeJson(bool clear = false);
+    }
+}
+
+#define VMPX_TRACE_CONCAT_IMPL(a, b) a##b
+#define VMPX_TRACE_CONCAT(a, b) VMPX_TRACE_CONCAT_IMPL(a, b)
+#define VMPX_TRACE_SCOPE(name) ::vmpx::trace::Span VMPX_TRACE_CONCAT(vmpx_trace_span_, __LINE__){name}
@@ -1,6 +1,9 @@
 ﻿#pragma once
+#include <cstdint>
+#include <cstdio>
 #include <filesystem>
 #include <functional>
+#include <memory_resource>
 #include <optional>
 #include <span>
 #include <string>
@@ -37,8 +40,47 @@ namespace vmpx
 
     std::optional<std::vector<uint8_t>> ReadFile(const std::filesystem::path& path);
 
+    /**
+     * CRC32校验值，用于检测写了一半或损坏的数据
+     * @param data 
+     * @return 
+     */
+    uint32_t Crc32(std::span<const uint8_t> data);
+
+    /**
+     * 以二进制方式打开文件，路径在Windows下按宽字符处理
+     * @param path 
+     * @param mode fopen的模式，如"ab"
+     * @return 失败返回nullptr
+     */
+    std::FILE* OpenFile(const std::filesystem::path& path, const char* mode);
+
+    /**
+     * 刷新缓冲并将文件内容落盘
+     * @param file 
+     * @return 
+     */
+    bool SyncFile(std::FILE* file);
+
+    /**
+     * 先写临时文件并落盘，再重命名覆盖目标文件
+     * 中途崩溃时目标文件要么是旧内容，要么是新内容
+     * @param data 
+     * @param path 
+     * @return 
+     */
+    bool WriteFileAtomic(std::span<const uint8_t> data, const std::filesystem::path& path);
+
     [[maybe_unused]] std::vector<wchar_t> U8ToWVec(const std::string& utf8_str);
 
+    /**
+     * 直接转换到指定分配器的容器，不经过中间字符串
+     * @param utf8_str 
+     * @param resource 
+     * @return 以空字符结尾
+     */
+    std::pmr::vector<wchar_t> U8ToWVec(std::string_view utf8_str, std::pmr::memory_resource* resource);
+
     /**
      * 
      * @param root 
@@ -9,6 +9,11 @@
 #include <expected>
 #include <filesystem>
 #include <memory>
+#include <memory_resource>
+#include <chrono>
+#include <stop_token>
+#include <functional>
+#include <string>
 
 namespace vmpx
 {
@@ -43,15 +48,20 @@ namespace vmpx
     struct ProductInfo
     {
         uint32_t key_size;
-        std::vector<byte> modulus;
-        std::vector<byte> public_exponent;
-        std::vector<byte> private_exponent;
-        std::vector<byte> product_code;
+        // 处理请求时从请求的arena分配
+        std::pmr::vector<byte> modulus;
+        std::pmr::vector<byte> public_exponent;
+        std::pmr::vector<byte> private_exponent;
+        std::pmr::vector<byte> product_code;
 
         static std::string ToJson(const ProductInfo& pi) noexcept;
         static std::expected<ProductInfo, std::string> FromJson(const std::string& json) noexcept;
 
-        std::unique_ptr<VMProtectProductInfo> ToVMP() const noexcept;
+        /**
+         * 指向本对象的数据，使用期间本对象必须存活
+         * @return 
+         */
+        VMProtectProductInfo ToVMP() const noexcept;
 
         std::string ToJson() const
         {
@@ -73,13 +83,22 @@ namespace vmpx
 
         std::string ToJson() noexcept;
 
-        ProductInfo ToProductInfo() const noexcept;
+        /**
+         * 解码为ProductInfo
+         * @param resource 解码结果的分配器
+         * @return 任一字段不是合法的base64时返回错误
+         */
+        std::expected<ProductInfo, std::string> ToProductInfo(
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const noexcept;
     };
 
+    /**
+     * VMProtect需要的宽字符字段
+     */
     struct WideFields
     {
-        mutable std::vector<wchar_t> user_name;
-        mutable std::vector<wchar_t> email;
+        std::pmr::vector<wchar_t> user_name;
+        std::pmr::vector<wchar_t> email;
     };
 
     struct SerialInfo
@@ -90,9 +109,13 @@ namespace vmpx
         int exp_year;
         int exp_month;
         int exp_day;
-        std::shared_ptr<WideFields> wide_fields = std::make_shared<WideFields>();
 
-        std::unique_ptr<VMProtectSerialNumberInfo> ToVMP() const noexcept;
+        /**
+         * 
+         * @param wide_fields 存放转换后的宽字符字段，使用返回值期间必须存活
+         * @return 
+         */
+        VMProtectSerialNumberInfo ToVMP(WideFields& wide_fields) const noexcept;
     };
 
     struct SerialNumberInfo
@@ -103,14 +126,72 @@ namespace vmpx
         int expired_day;
     };
 
+    /**
+     * 
+     * @param pi 
+     * @param si 
+     * @param resource 临时对象的分配器，处理请求时传入请求的arena
+     * @return 
+     */
     std::expected<SerialNumberInfo, std::string> GenSerialNumber(
         const ProductInfo& pi,
-        const SerialInfo& si) noexcept;
+        const SerialInfo& si,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept;
+
+    // GenRandomProductInfo接受的密钥长度（位）
+    constexpr size_t MIN_KEY_SIZE = 1024;
+    constexpr size_t MAX_KEY_SIZE = 16384;
 
     ProductInfo GenRandomProductInfo(size_t key_size, bool random_public_exponent = false) noexcept;
 
+    struct PackTarget
+    {
+        // 待加壳的程序，即.vmp中的InputFileName
+        std::filesystem::path input_file_path;
+        // 加壳输出文件，已转换为传给加壳程序的编码
+        std::string output_file_name;
+    };
+
+    /**
+     * 解析.vmp工程文件，得到加壳的输入输出
+     * @param vmp_file_path 
+     * @param output_dir 输出目录，默认为输入程序所在目录
+     * @return 
+     */
+    std::expected<PackTarget, std::string> ResolvePackTarget(const std::filesystem::path& vmp_file_path,
+                                                             const std::filesystem::path& output_dir =
+                                                                 std::filesystem::path{});
+
+    /**
+     * 从加壳程序输出中解析出的进度
+     */
+    struct PackEvent
+    {
+        // queued, loading, analyzing, compiling, saving, completed, cached, failed
+        std::string phase;
+        // 当前阶段的百分比，未知时为-1
+        int percent = -1;
+        std::string message;
+        bool warning = false;
+        // 本次加壳已结束
+        bool done = false;
+        // 所属的加壳配置，由调用者填写
+        std::string profile;
+    };
+
+    struct PackOptions
+    {
+        // 超过该时长则杀掉加壳进程，0表示不限制
+        std::chrono::milliseconds timeout{0};
+        // 请求停止后杀掉加壳进程
+        std::stop_token stop_token;
+        // 加壳程序每输出一行调用一次，在加壳线程上调用
+        std::function<void(const PackEvent& event)> on_event;
+    };
+
     std::expected<std::filesystem::path, std::string> PackApp(const std::filesystem::path& vmp_console_app_path,
                                                               const std::filesystem::path& vmp_file_path,
                                                               const std::filesystem::path& output_dir =
-                                                                  std::filesystem::path{});
+                                                                  std::filesystem::path{},
+                                                              const PackOptions& options = {});
 }
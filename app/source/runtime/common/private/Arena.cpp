@@ -0,0 +1,86 @@
+﻿#include "Arena.h"
+
+#include <atomic>
+#include <memory>
+
+namespace
+{
+    thread_local std::unique_ptr<std::byte[]> thread_buffer;
+    thread_local bool thread_buffer_in_use = false;
+
+    std::atomic_uint64_t requests{0};
+    std::atomic_uint64_t high_water_bytes{0};
+    std::atomic_uint64_t total_bytes{0};
+    std::atomic_uint64_t overflowed{0};
+
+    std::byte* AcquireThreadBuffer()
+    {
+        if (thread_buffer_in_use) return nullptr;
+        if (!thread_buffer) thread_buffer = std::make_unique<std::byte[]>(vmpx::arena::RequestArena::THREAD_BUFFER_BYTES);
+        thread_buffer_in_use = true;
+        return thread_buffer.get();
+    }
+}
+
+vmpx::arena::RequestArena::RequestArena(): owns_thread_buffer_(!thread_buffer_in_use),
+                                           resource_(owns_thread_buffer_ ? AcquireThreadBuffer() : nullptr,
+                                                     owns_thread_buffer_ ? THREAD_BUFFER_BYTES : 0, &upstream_)
+{
+}
+
+vmpx::arena::RequestArena::~RequestArena()
+{
+    resource_.release();
+    if (owns_thread_buffer_) thread_buffer_in_use = false;
+    requests.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(bytes_allocated_, std::memory_order_relaxed);
+    if (upstream_.used) overflowed.fetch_add(1, std::memory_order_relaxed);
+    auto high_water = high_water_bytes.load(std::memory_order_relaxed);
+    while (bytes_allocated_ > high_water &&
+        !high_water_bytes.compare_exchange_weak(high_water, bytes_allocated_, std::memory_order_relaxed))
+    {
+    }
+}
+
+void* vmpx::arena::RequestArena::do_allocate(size_t bytes, size_t alignment)
+{
+    bytes_allocated_ += bytes;
+    return resource_.allocate(bytes, alignment);
+}
+
+void vmpx::arena::RequestArena::do_deallocate(void*, size_t, size_t)
+{
+    // 单调分配，析构时统一释放
+}
+
+bool vmpx::arena::RequestArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+void* vmpx::arena::RequestArena::UpstreamResource::do_allocate(size_t bytes, size_t alignment)
+{
+    used = true;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void vmpx::arena::RequestArena::UpstreamResource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool vmpx::arena::RequestArena::UpstreamResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+vmpx::arena::ArenaStats vmpx::arena::GetStats() noexcept
+{
+    return ArenaStats{
+        .requests = requests.load(std::memory_order_relaxed),
+        .high_water_bytes = high_water_bytes.load(std::memory_order_relaxed),
+        .total_bytes = total_bytes.load(std::memory_order_relaxed),
+        .overflowed = overflowed.load(std::memory_order_relaxed),
+        .thread_buffer_bytes = RequestArena::THREAD_BUFFER_BYTES,
+    };
+}
@@ -0,0 +1,446 @@
+﻿#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <thread>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <unordered_set>
+#include <windows.h>
+#include <tlhelp32.h>
+#include <dbghelp.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#endif
+
+namespace
+{
+    constexpr size_t MAX_DEPTH = 64;
+    // 约34MB，只在采样期间分配
+    constexpr size_t MAX_SAMPLES = 1 << 16;
+
+    struct Sample
+    {
+        uint32_t depth;
+        // 叶在前
+        uintptr_t frames[MAX_DEPTH];
+    };
+
+    /**
+     * 预先分配的采样缓冲，写入只有一次原子加，可以在信号处理函数中使用
+     */
+    class SampleBuffer
+    {
+    public:
+        explicit SampleBuffer(size_t capacity): samples_(std::make_unique<Sample[]>(capacity)), capacity_(capacity)
+        {
+        }
+
+        void Push(const uintptr_t* frames, size_t depth) noexcept
+        {
+            if (depth == 0) return;
+            auto index = next_.fetch_add(1, std::memory_order_relaxed);
+            if (index >= capacity_)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            auto& sample = samples_[index];
+            sample.depth = static_cast<uint32_t>(std::min(depth, MAX_DEPTH));
+            std::copy_n(frames, sample.depth, sample.frames);
+        }
+
+        size_t Size() const noexcept
+        {
+            return std::min(next_.load(), capacity_);
+        }
+
+        uint64_t Dropped() const noexcept
+        {
+            return dropped_.load();
+        }
+
+        const Sample& operator[](size_t index) const noexcept
+        {
+            return samples_[index];
+        }
+
+    private:
+        std::unique_ptr<Sample[]> samples_;
+        size_t capacity_;
+        std::atomic_size_t next_{0};
+        std::atomic_uint64_t dropped_{0};
+    };
+
+    std::atomic_bool running{false};
+
+#if defined(_WIN32)
+    // 每隔多少个周期重新枚举一次线程，枚举本身比采样贵得多
+    constexpr uint64_t THREAD_REFRESH_TICKS = 16;
+
+    struct SampledThread
+    {
+        HANDLE handle;
+        uint64_t cycles;
+    };
+
+    uint64_t ThreadCycles(HANDLE thread) noexcept
+    {
+        ULONG64 cycles = 0;
+        QueryThreadCycleTime(thread, &cycles);
+        return cycles;
+    }
+
+    void RefreshThreads(std::unordered_map<DWORD, SampledThread>& threads)
+    {
+        auto snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+        if (snapshot == INVALID_HANDLE_VALUE) return;
+        auto process_id = GetCurrentProcessId();
+        auto self_id = GetCurrentThreadId();
+        std::unordered_set<DWORD> alive;
+        THREADENTRY32 entry{};
+        entry.dwSize = sizeof(entry);
+        for (BOOL ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry))
+        {
+            if (entry.th32OwnerProcessID != process_id || entry.th32ThreadID == self_id) continue;
+            alive.insert(entry.th32ThreadID);
+            if (threads.contains(entry.th32ThreadID)) continue;
+            auto handle = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION, FALSE,
+                                     entry.th32ThreadID);
+            if (handle) threads.emplace(entry.th32ThreadID, SampledThread{handle, ThreadCycles(handle)});
+        }
+        CloseHandle(snapshot);
+        std::erase_if(threads, [&alive](const auto& item)
+        {
+            if (alive.contains(item.first)) return false;
+            CloseHandle(item.second.handle);
+            return true;
+        });
+    }
+
+    /**
+     * 从挂起线程的上下文回溯调用栈
+     * 目标线程挂起期间不能分配内存或加锁，它可能正持有同一把锁
+     */
+    size_t WalkStack(CONTEXT& context, uintptr_t* frames) noexcept
+    {
+        size_t depth = 0;
+#if defined(_M_X64)
+        while (depth < MAX_DEPTH && context.Rip)
+        {
+            frames[depth++] = context.Rip;
+            DWORD64 image_base = 0;
+            auto function = RtlLookupFunctionEntry(context.Rip, &image_base, nullptr);
+            if (!function)
+            {
+                // 叶函数没有展开信息，返回地址就在栈顶
+                context.Rip = *reinterpret_cast<DWORD64*>(context.Rsp);
+                context.Rsp += sizeof(DWORD64);
+                continue;
+            }
+            PVOID handler_data = nullptr;
+            DWORD64 establisher_frame = 0;
+            RtlVirtualUnwind(UNW_FLAG_NHANDLER, image_base, context.Rip, function, &context, &handler_data,
+                             &establisher_frame, nullptr);
+        }
+#elif defined(_M_ARM64)
+        while (depth < MAX_DEPTH && context.Pc)
+        {
+            frames[depth++] = context.Pc;
+            DWORD64 image_base = 0;
+            auto function = RtlLookupFunctionEntry(context.Pc, &image_base, nullptr);
+            if (!function)
+            {
+                if (depth > 1 || !context.Lr) break;
+                context.Pc = context.Lr;
+                context.Lr = 0;
+                continue;
+            }
+            PVOID handler_data = nullptr;
+            DWORD64 establisher_frame = 0;
+            RtlVirtualUnwind(UNW_FLAG_NHANDLER, image_base, context.Pc, function, &context, &handler_data,
+                             &establisher_frame, nullptr);
+        }
+#endif
+        return depth;
+    }
+
+    /**
+     * Windows没有SIGPROF，在当前线程上按周期挂起其它线程并回溯
+     * 只采样上个周期里用过CPU的线程，与POSIX下按CPU时间触发的SIGPROF一致
+     */
+    std::expected<void, std::string> CollectSamples(SampleBuffer& buffer, std::chrono::milliseconds duration,
+                                                    std::stop_token stop_token)
+    {
+        constexpr auto interval = std::chrono::microseconds(1000000 / vmpx::profiler::SAMPLE_FREQUENCY);
+        // 默认的时钟精度约15.6ms，不够按99Hz采样
+        auto timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        std::unordered_map<DWORD, SampledThread> threads;
+        auto deadline = std::chrono::steady_clock::now() + duration;
+        for (uint64_t tick = 0; std::chrono::steady_clock::now() < deadline && !stop_token.stop_requested(); ++tick)
+        {
+            if (tick % THREAD_REFRESH_TICKS == 0) RefreshThreads(threads);
+            for (auto& thread : threads | std::views::values)
+            {
+                auto cycles = ThreadCycles(thread.handle);
+                if (cycles == thread.cycles) continue;
+                thread.cycles = cycles;
+                uintptr_t frames[MAX_DEPTH];
+                size_t depth = 0;
+                if (SuspendThread(thread.handle) == static_cast<DWORD>(-1)) continue;
+                CONTEXT context{};
+                context.ContextFlags = CONTEXT_FULL;
+                if (GetThreadContext(thread.handle, &context)) depth = WalkStack(context, frames);
+                ResumeThread(thread.handle);
+                buffer.Push(frames, depth);
+            }
+            if (timer)
+            {
+                LARGE_INTEGER due_time{};
+                // 负数表示相对时间，单位100ns
+                due_time.QuadPart = -std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count() / 100;
+                SetWaitableTimer(timer, &due_time, 0, nullptr, nullptr, FALSE);
+                WaitForSingleObject(timer, INFINITE);
+            }
+            else std::this_thread::sleep_for(interval);
+        }
+        for (const auto& thread : threads | std::views::values)
+        {
+            CloseHandle(thread.handle);
+        }
+        if (timer) CloseHandle(timer);
+        return {};
+    }
+
+    void InitSymbols()
+    {
+        static std::once_flag init_once;
+        auto process = GetCurrentProcess();
+        std::call_once(init_once, [process]
+        {
+            SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
+            SymInitialize(process, nullptr, TRUE);
+        });
+        // 上次采样之后可能加载了新的模块
+        SymRefreshModuleList(process);
+    }
+
+    std::string FrameName(uintptr_t pc)
+    {
+        alignas(SYMBOL_INFO) char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME]{};
+        auto symbol = reinterpret_cast<SYMBOL_INFO*>(buffer);
+        symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+        symbol->MaxNameLen = MAX_SYM_NAME;
+        DWORD64 displacement = 0;
+        if (SymFromAddr(GetCurrentProcess(), pc, &displacement, symbol))
+            return std::string(symbol->Name, symbol->NameLen);
+        // 没有pdb时给出模块内偏移，之后可以离线解析
+        HMODULE module = nullptr;
+        if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                                reinterpret_cast<LPCSTR>(pc), &module))
+            return std::format("0x{:x}", pc);
+        char module_path[MAX_PATH]{};
+        GetModuleFileNameA(module, module_path, MAX_PATH);
+        std::string_view module_name{module_path};
+        module_name = module_name.substr(module_name.find_last_of("\\/") + 1);
+        return std::format("{}+0x{:x}", module_name, pc - reinterpret_cast<uintptr_t>(module));
+    }
+#else
+    // 帧指针离被中断时的栈顶超过此距离就认为已不在栈上
+    constexpr uintptr_t MAX_STACK_BYTES = 64 * 1024 * 1024;
+
+    std::atomic_bool active{false};
+    std::atomic_uint32_t handlers_running{0};
+    SampleBuffer* active_buffer = nullptr;
+
+    /**
+     * 等待采样时长结束或被请求停止
+     */
+    void WaitFor(std::chrono::milliseconds duration, std::stop_token stop_token)
+    {
+        std::mutex mutex;
+        std::condition_variable_any cv;
+        std::unique_lock lock(mutex);
+        cv.wait_for(lock, stop_token, duration, [] { return false; });
+    }
+
+    /**
+     * 从信号上下文沿帧指针链回溯，只读取栈上的内存，不调用任何函数，可以在信号处理函数中使用
+     * backtrace会加载器锁，信号打断dlopen或异常展开时会死锁
+     * 帧指针必须在被中断线程的栈上且逐帧递增，遇到省略了帧指针的函数（如未带帧指针编译的库）就停止
+     */
+    size_t WalkFramePointers(const ucontext_t* context, uintptr_t* frames) noexcept
+    {
+#if defined(__x86_64__)
+        auto pc = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+        auto fp = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RBP]);
+        auto sp = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+        auto pc = static_cast<uintptr_t>(context->uc_mcontext.pc);
+        auto fp = static_cast<uintptr_t>(context->uc_mcontext.regs[29]);
+        auto sp = static_cast<uintptr_t>(context->uc_mcontext.sp);
+#else
+        return 0;
+#endif
+        size_t depth = 0;
+        frames[depth++] = pc;
+        while (depth < MAX_DEPTH && fp >= sp && fp - sp < MAX_STACK_BYTES && fp % sizeof(uintptr_t) == 0)
+        {
+            // 帧中依次为上一帧的帧指针和返回地址
+            auto frame = reinterpret_cast<const uintptr_t*>(fp);
+            auto next_fp = frame[0];
+            auto return_address = frame[1];
+            if (return_address == 0) break;
+            frames[depth++] = return_address;
+            if (next_fp <= fp) break;
+            fp = next_fp;
+        }
+        return depth;
+    }
+
+    void OnSigProf(int, siginfo_t*, void* context)
+    {
+        auto saved_errno = errno;
+        handlers_running.fetch_add(1);
+        if (active.load())
+        {
+            uintptr_t frames[MAX_DEPTH];
+            auto depth = WalkFramePointers(static_cast<const ucontext_t*>(context), frames);
+            active_buffer->Push(frames, depth);
+        }
+        handlers_running.fetch_sub(1);
+        errno = saved_errno;
+    }
+
+    /**
+     * ITIMER_PROF按整个进程消耗的CPU时间计时，SIGPROF投递给当时正在运行的线程，空闲线程不会被采样
+     */
+    std::expected<void, std::string> CollectSamples(SampleBuffer& buffer, std::chrono::milliseconds duration,
+                                                    std::stop_token stop_token)
+    {
+        // 处理函数装上后不再卸下，否则停止计时后仍在途的SIGPROF会按默认行为终止进程
+        static const bool handler_installed = []
+        {
+            struct sigaction action{};
+            action.sa_sigaction = OnSigProf;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            return sigaction(SIGPROF, &action, nullptr) == 0;
+        }();
+        if (!handler_installed) return std::unexpected{"unable to install SIGPROF handler"};
+        active_buffer = &buffer;
+        active = true;
+        itimerval timer{};
+        timer.it_interval.tv_usec = 1000000 / vmpx::profiler::SAMPLE_FREQUENCY;
+        timer.it_value = timer.it_interval;
+        bool started = setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+        if (started) WaitFor(duration, stop_token);
+        timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        active = false;
+        // 等待正在执行的处理函数写完，之后缓冲才能读取和释放
+        while (handlers_running.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+        active_buffer = nullptr;
+        if (!started) return std::unexpected{std::format("unable to start profiling timer:{}", errno)};
+        return {};
+    }
+
+    void InitSymbols()
+    {
+    }
+
+    std::string FrameName(uintptr_t pc)
+    {
+        Dl_info info{};
+        if (!dladdr(reinterpret_cast<void*>(pc), &info)) return std::format("0x{:x}", pc);
+        if (info.dli_sname)
+        {
+            int status = 0;
+            std::unique_ptr<char, decltype(&std::free)> demangled{
+                abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), &std::free
+            };
+            return status == 0 ? std::string{demangled.get()} : std::string{info.dli_sname};
+        }
+        // 没有导出的符号，给出模块内偏移，之后可以用addr2line解析
+        std::string_view module_name{info.dli_fname ? info.dli_fname : "?"};
+        module_name = module_name.substr(module_name.find_last_of('/') + 1);
+        return std::format("{}+0x{:x}", module_name, pc - reinterpret_cast<uintptr_t>(info.dli_fbase));
+    }
+#endif
+
+    std::string Fold(const SampleBuffer& buffer)
+    {
+        InitSymbols();
+        std::unordered_map<uintptr_t, std::string> names;
+        auto name_of = [&names](uintptr_t pc) -> const std::string&
+        {
+            auto [it, inserted] = names.try_emplace(pc);
+            if (inserted)
+            {
+                it->second = FrameName(pc);
+                // 分号是折叠栈的分隔符
+                std::ranges::replace(it->second, ';', ':');
+            }
+            return it->second;
+        };
+        std::map<std::string, uint64_t> stacks;
+        std::string stack;
+        for (size_t i = 0; i < buffer.Size(); ++i)
+        {
+            const auto& sample = buffer[i];
+            stack.clear();
+            for (size_t depth = sample.depth; depth > 0; --depth)
+            {
+                // 除了叶都是返回地址，减一才落在调用指令所在的函数里
+                auto pc = sample.frames[depth - 1];
+                if (depth > 1) pc -= 1;
+                if (!stack.empty()) stack.push_back(';');
+                stack += name_of(pc);
+            }
+            ++stacks[stack];
+        }
+        std::string folded;
+        for (const auto& [folded_stack, count] : stacks)
+        {
+            folded += std::format("{} {}\n", folded_stack, count);
+        }
+        return folded;
+    }
+}
+
+std::expected<vmpx::profiler::ProfileResult, std::string> vmpx::profiler::Profile(std::chrono::milliseconds duration,
+                                                                                   std::stop_token stop_token)
+{
+    if (duration <= std::chrono::milliseconds::zero() || duration > MAX_DURATION)
+        return std::unexpected{std::format("profile duration must be in (0, {}] seconds", MAX_DURATION.count())};
+    if (running.exchange(true)) return std::unexpected{"another profile is running"};
+    struct RunningGuard
+    {
+        ~RunningGuard()
+        {
+            running = false;
+        }
+    } running_guard;
+    // 最坏情况下所有核都在忙
+    auto capacity = static_cast<size_t>(std::chrono::duration<double>(duration).count() * SAMPLE_FREQUENCY) *
+        std::max(1u, std::thread::hardware_concurrency());
+    SampleBuffer buffer(std::clamp<size_t>(capacity, 1, MAX_SAMPLES));
+    if (auto collected = CollectSamples(buffer, duration, stop_token); !collected) return std::unexpected{collected.error()};
+    return ProfileResult{Fold(buffer), buffer.Size(), buffer.Dropped()};
+}
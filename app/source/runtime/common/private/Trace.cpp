@@ -0,0 +1,222 @@
+﻿#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // 每个线程保留最近的事件数
+    constexpr size_t MAX_EVENTS_PER_THREAD = 16384;
+
+    struct TraceEvent
+    {
+        // span名为字面量，不必复制；请求的名字是动态的，存在detail里
+        const char* name;
+        std::string detail;
+        uint64_t begin_ns;
+        uint64_t end_ns;
+        uint64_t request_id;
+    };
+
+    /**
+     * 每个线程一个环形缓冲，只有所属线程写入，导出时加锁复制，锁几乎没有竞争
+     */
+    struct ThreadBuffer
+    {
+        uint32_t tid;
+        // 所属线程已退出，不会再写入
+        std::atomic_bool dead{false};
+        std::mutex mutex;
+        std::vector<TraceEvent> events;
+        size_t next = 0;
+
+        void Push(TraceEvent event)
+        {
+            std::lock_guard lock(mutex);
+            if (events.size() < MAX_EVENTS_PER_THREAD) events.push_back(std::move(event));
+            else events[next] = std::move(event);
+            next = (next + 1) % MAX_EVENTS_PER_THREAD;
+        }
+    };
+
+    /**
+     * 线程退出时把缓冲标记为已退出，下次导出后从列表中移除
+     */
+    struct ThreadBufferHolder
+    {
+        std::shared_ptr<ThreadBuffer> buffer;
+
+        ~ThreadBufferHolder()
+        {
+            if (buffer) buffer->dead.store(true, std::memory_order_release);
+        }
+    };
+
+    const auto trace_epoch = std::chrono::steady_clock::now();
+    std::atomic_uint32_t sample_every{0};
+    std::atomic_uint64_t request_counter{0};
+    std::atomic_uint64_t next_request_id{1};
+    std::atomic_uint32_t next_tid{1};
+    std::mutex buffers_mutex;
+    // 线程退出后缓冲保留到下一次导出，之后移除，线程不断创建退出时列表不会一直增长
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+    thread_local ThreadBufferHolder thread_buffer;
+    thread_local std::string request_name;
+    thread_local uint64_t request_begin_ns = 0;
+
+    ThreadBuffer& CurrentThreadBuffer()
+    {
+        if (!thread_buffer.buffer)
+        {
+            auto buffer = std::make_shared<ThreadBuffer>();
+            buffer->tid = next_tid.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard lock(buffers_mutex);
+                buffers.push_back(buffer);
+            }
+            thread_buffer.buffer = std::move(buffer);
+        }
+        return *thread_buffer.buffer;
+    }
+
+    void AppendJsonString(std::string& out, std::string_view str)
+    {
+        out.push_back('"');
+        for (char c : str)
+        {
+            switch (c)
+            {
+            case '"': out += "\\\"";
+                break;
+            case '\\': out += "\\\\";
+                break;
+            case '\n': out += "\\n";
+                break;
+            case '\r': out += "\\r";
+                break;
+            case '\t': out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) out += std::format("\\u{:04x}", c);
+                else out.push_back(c);
+            }
+        }
+        out.push_back('"');
+    }
+}
+
+uint64_t vmpx::trace::detail::NowNs() noexcept
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_epoch).count());
+}
+
+void vmpx::trace::detail::Record(const char* name, uint64_t begin_ns, uint64_t end_ns) noexcept
+{
+    try
+    {
+        CurrentThreadBuffer().Push(TraceEvent{name, {}, begin_ns, end_ns, current_context.request_id});
+    }
+    catch (...)
+    {
+        // 追踪不能影响请求本身
+    }
+}
+
+void vmpx::trace::SetSampleEvery(uint32_t every) noexcept
+{
+    sample_every = every;
+}
+
+uint32_t vmpx::trace::GetSampleEvery() noexcept
+{
+    return sample_every;
+}
+
+bool vmpx::trace::BeginRequest(std::string_view name, bool force)
+{
+    auto every = sample_every.load(std::memory_order_relaxed);
+    bool sampled = force || (every > 0 && request_counter.fetch_add(1, std::memory_order_relaxed) % every == 0);
+    if (!sampled)
+    {
+        detail::current_context = {};
+        return false;
+    }
+    detail::current_context.request_id = next_request_id.fetch_add(1, std::memory_order_relaxed);
+    request_name.assign(name);
+    request_begin_ns = detail::NowNs();
+    return true;
+}
+
+void vmpx::trace::EndRequest() noexcept
+{
+    if (detail::current_context.request_id == 0) return;
+    try
+    {
+        CurrentThreadBuffer().Push(TraceEvent{
+            "request", std::move(request_name), request_begin_ns, detail::NowNs(), detail::current_context.request_id
+        });
+    }
+    catch (...)
+    {
+    }
+    request_name.clear();
+    detail::current_context = {};
+}
+
+std::string vmpx::trace::ExportChromeJson(bool clear)
+{
+    std::vector<std::shared_ptr<ThreadBuffer>> thread_buffers;
+    {
+        std::lock_guard lock(buffers_mutex);
+        thread_buffers = buffers;
+    }
+    std::string json = R"({"displayTimeUnit":"ms","traceEvents":[)";
+    bool first = true;
+    std::vector<ThreadBuffer*> dead_buffers;
+    for (const auto& buffer : thread_buffers)
+    {
+        // 先看是否已退出再复制事件，已退出的线程的事件都已写入，移除时不会丢失
+        if (buffer->dead.load(std::memory_order_acquire)) dead_buffers.push_back(buffer.get());
+        std::vector<TraceEvent> events;
+        {
+            std::lock_guard lock(buffer->mutex);
+            if (clear)
+            {
+                events.swap(buffer->events);
+                buffer->next = 0;
+            }
+            else events = buffer->events;
+        }
+        if (events.empty()) continue;
+        std::ranges::sort(events, {}, &TraceEvent::begin_ns);
+        if (!first) json.push_back(',');
+        first = false;
+        json += std::format(R"({{"ph":"M","name":"thread_name","pid":1,"tid":{},"args":{{"name":"vmpx-{}"}}}})",
+                            buffer->tid, buffer->tid);
+        for (const auto& event : events)
+        {
+            json += R"(,{"ph":"X","cat":"vmpx","name":)";
+            AppendJsonString(json, event.detail.empty() ? std::string_view{event.name} : event.detail);
+            json += std::format(R"(,"pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f},"args":{{"request_id":{}}}}})",
+                                buffer->tid, static_cast<double>(event.begin_ns) / 1000.0,
+                                static_cast<double>(event.end_ns - event.begin_ns) / 1000.0, event.request_id);
+        }
+    }
+    json += "]}";
+    if (!dead_buffers.empty())
+    {
+        std::lock_guard lock(buffers_mutex);
+        std::erase_if(buffers, [&dead_buffers](const auto& buffer)
+        {
+            return std::ranges::find(dead_buffers, buffer.get()) != dead_buffers.end();
+        });
+    }
+    return json;
+}
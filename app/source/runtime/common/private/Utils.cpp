@@ -1,10 +1,19 @@
 ﻿#include "Utils.h"
 
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <utf8cpp/utf8.h>
 #include <boost/locale.hpp>
 #include <uchardet.h>
+#include <cryptopp/crc.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace
 {
@@ -101,6 +110,62 @@ std::optional<std::vector<uint8_t>> vmpx::ReadFile(const std::filesystem::path&
     return buffer;
 }
 
+uint32_t vmpx::Crc32(std::span<const uint8_t> data)
+{
+    CryptoPP::CRC32 crc;
+    uint32_t digest = 0;
+    crc.CalculateDigest(reinterpret_cast<CryptoPP::byte*>(&digest), data.data(), data.size());
+    return digest;
+}
+
+std::FILE* vmpx::OpenFile(const std::filesystem::path& path, const char* mode)
+{
+#if defined(_WIN32)
+    std::wstring wmode(mode, mode + std::strlen(mode));
+    return _wfopen(path.c_str(), wmode.c_str());
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+bool vmpx::SyncFile(std::FILE* file)
+{
+    if (std::fflush(file) != 0) return false;
+#if defined(_WIN32)
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool vmpx::WriteFileAtomic(std::span<const uint8_t> data, const std::filesystem::path& path)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+    std::FILE* file = OpenFile(tmp_path, "wb");
+    if (!file) return false;
+    bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size() && SyncFile(file);
+    written = std::fclose(file) == 0 && written;
+    if (written) std::filesystem::rename(tmp_path, path, ec);
+    if (!written || ec)
+    {
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+#if !defined(_WIN32)
+    // 目录项也要落盘，否则重命名本身可能丢失
+    int dir_fd = open(path.parent_path().empty() ? "." : path.parent_path().c_str(), O_RDONLY);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+#endif
+    return true;
+}
+
 std::vector<wchar_t> vmpx::U8ToWVec(const std::string& utf8_str)
 {
     std::vector<wchar_t> output;
@@ -126,6 +191,21 @@ std::vector<wchar_t> vmpx::U8ToWVec(const std::string& utf8_str)
     return output;
 }
 
+std::pmr::vector<wchar_t> vmpx::U8ToWVec(std::string_view utf8_str, std::pmr::memory_resource* resource)
+{
+    std::pmr::vector<wchar_t> output{resource};
+    // 码元数不会超过UTF-8的字节数
+    output.reserve(utf8_str.size() + 1);
+    if (sizeof(wchar_t) == 2)
+        utf8::utf8to16(utf8_str.begin(), utf8_str.end(), std::back_inserter(output));
+    else if (sizeof(wchar_t) == 4)
+        utf8::utf8to32(utf8_str.begin(), utf8_str.end(), std::back_inserter(output));
+    else
+        throw std::runtime_error("Unsupported wchar_t size");
+    output.push_back(L'\0');
+    return output;
+}
+
 std::vector<std::filesystem::path> vmpx::FindFiles(const std::filesystem::path& root,
                                                    const std::function<bool(const std::filesystem::path& filename)>&
                                                    filter)
@@ -1,5 +1,9 @@
 ﻿#include "../VMPX.h"
 
+#include <charconv>
+#include <cctype>
+#include <optional>
+#include <thread>
 #include <magic_enum.hpp>
 #include <ylt/struct_json/json_reader.h>
 #include <ylt/struct_json/json_writer.h>
@@ -13,9 +17,12 @@
 #include <boost/locale.hpp>
 
 #include "Utils.h"
+#include "Trace.h"
 
 namespace
 {
+    constexpr auto PACK_POLL_INTERVAL = std::chrono::milliseconds(100);
+
     template <typename T>
     std::vector<T> B64DecToVec(const byte* str, size_t size)
     {
@@ -36,6 +43,48 @@ namespace
         return base64::encode_into<std::string>(bytes.begin(), bytes.end());
     }
 
+    /**
+     * 直接解码到指定分配器的容器，base64库只能先解码到临时vector再复制
+     * 只接受标准字母表，=只能作为末尾的填充
+     */
+    std::expected<std::pmr::vector<byte>, std::string> B64DecToPmrVec(std::string_view str,
+                                                                       std::pmr::memory_resource* resource)
+    {
+        static constexpr auto decode_table = []
+        {
+            constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            std::array<int8_t, 256> table{};
+            table.fill(-1);
+            for (size_t i = 0; i < alphabet.size(); ++i)
+            {
+                table[static_cast<uint8_t>(alphabet[i])] = static_cast<int8_t>(i);
+            }
+            return table;
+        }();
+        auto data = str.substr(0, str.find_last_not_of('=') + 1);
+        if (auto padding = str.size() - data.size(); padding > 2 || (padding > 0 && str.size() % 4 != 0))
+            return std::unexpected{"invalid base64 padding"};
+        std::pmr::vector<byte> bytes{resource};
+        bytes.reserve(data.size() / 4 * 3 + 3);
+        uint32_t bits = 0;
+        int bit_count = 0;
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            auto value = decode_table[static_cast<uint8_t>(data[i])];
+            if (value < 0) return std::unexpected{std::format("invalid base64 character at {}", i)};
+            bits = ((bits << 6) | static_cast<uint32_t>(value)) & 0xFFFFFF;
+            bit_count += 6;
+            if (bit_count >= 8)
+            {
+                bit_count -= 8;
+                bytes.push_back(static_cast<byte>(bits >> bit_count));
+            }
+        }
+        // 最后一组只剩一个字符时凑不出一个字节
+        if (data.size() % 4 == 1) return std::unexpected{"invalid base64 length"};
+        return bytes;
+    }
+
     // 将 CryptoPP Integer 编码为 std::vector<uint8_t>
     std::vector<uint8_t> Integer2Vec(const CryptoPP::Integer& n)
     {
@@ -49,6 +98,87 @@ namespace
     {
         return {vec.data(), vec.size()};
     }
+
+    /**
+     * 把加壳程序的输出按行（\r或\n）切分，解析出阶段、百分比和警告
+     */
+    class PackOutputParser
+    {
+    public:
+        explicit PackOutputParser(const std::function<void(const vmpx::PackEvent&)>& on_event): on_event_(on_event)
+        {
+        }
+
+        void Feed(std::string_view data)
+        {
+            if (!on_event_) return;
+            for (char c : data)
+            {
+                if (c == '\r' || c == '\n') Flush();
+                else line_.push_back(c);
+            }
+        }
+
+        void Flush()
+        {
+            if (!on_event_ || line_.empty()) return;
+            auto event = Parse(line_);
+            line_.clear();
+            on_event_(event);
+        }
+
+    private:
+        vmpx::PackEvent Parse(std::string_view line)
+        {
+            static constexpr std::array<std::pair<std::string_view, std::string_view>, 5> phases{
+                {
+                    {"Compilation completed", "completed"},
+                    {"Loading", "loading"},
+                    {"Analyz", "analyzing"},
+                    {"Compil", "compiling"},
+                    {"Saving", "saving"},
+                }
+            };
+            for (const auto& [keyword, phase] : phases)
+            {
+                if (line.find(keyword) != std::string_view::npos)
+                {
+                    if (phase_ != phase) percent_ = -1;
+                    phase_ = phase;
+                    break;
+                }
+            }
+            // 取行内最后一个百分比
+            if (auto pos = line.rfind('%'); pos != std::string_view::npos)
+            {
+                auto begin = pos;
+                while (begin > 0 && std::isdigit(static_cast<unsigned char>(line[begin - 1]))) --begin;
+                int percent = -1;
+                if (begin < pos && std::from_chars(line.data() + begin, line.data() + pos, percent).ec == std::errc{}
+                    && percent <= 100)
+                    percent_ = percent;
+            }
+            if (phase_ == "completed") percent_ = 100;
+            auto contains_ci = [line](std::string_view word)
+            {
+                return std::ranges::search(line, word, [](char a, char b)
+                {
+                    return std::tolower(static_cast<unsigned char>(a)) == b;
+                }).begin() != line.end();
+            };
+            return vmpx::PackEvent{
+                .phase = phase_,
+                .percent = percent_,
+                .message = std::string(line),
+                .warning = contains_ci("warning") || contains_ci("error"),
+            };
+        }
+
+        const std::function<void(const vmpx::PackEvent&)>& on_event_;
+        std::string line_;
+        std::string phase_ = "loading";
+        int percent_ = -1;
+    };
 }
 
 static std::expected<std::string, std::string> GenerateSerialNumber(
@@ -78,6 +208,7 @@ vmpx::HWID vmpx::HWID::FromData(std::span<uint8_t> bytes) noexcept
 
 std::expected<vmpx::HWID, std::string> vmpx::HWID::FromBase64(std::string_view str)
 {
+    VMPX_TRACE_SCOPE("HWID::FromBase64");
     try
     {
         auto vec = B64DecToVec<uint8_t>(reinterpret_cast<const byte*>(str.data()), str.size());
@@ -124,6 +255,7 @@ std::vector<uint8_t> vmpx::HWID::ToBytes() const noexcept
 
 auto vmpx::HWID::ToBase64() const noexcept -> std::string
 {
+    VMPX_TRACE_SCOPE("HWID::ToBase64");
     auto bytes = ToBytes();
     return BytesToB64(std::span(bytes));
 }
@@ -142,22 +274,23 @@ std::expected<vmpx::ProductInfo, std::string> vmpx::ProductInfo::FromJson(const
     return entity.value().ToProductInfo();
 }
 
-std::unique_ptr<VMProtectProductInfo> vmpx::ProductInfo::ToVMP() const noexcept
+VMProtectProductInfo vmpx::ProductInfo::ToVMP() const noexcept
 {
-    auto p_pi = std::make_unique<VMProtectProductInfo>();
-    p_pi->algorithm = DEFAULT_ALGORITHM;
-    p_pi->nBits = this->key_size;
-    p_pi->nModulusSize = this->modulus.size();
-    p_pi->pModulus = const_cast<byte*>(this->modulus.data());
-    p_pi->nPrivateSize = this->private_exponent.size();
-    p_pi->pPrivate = const_cast<byte*>(this->private_exponent.data());
-    p_pi->nProductCodeSize = this->product_code.size();
-    p_pi->pProductCode = const_cast<byte*>(this->product_code.data());
-    return p_pi;
+    VMProtectProductInfo pi{};
+    pi.algorithm = DEFAULT_ALGORITHM;
+    pi.nBits = this->key_size;
+    pi.nModulusSize = this->modulus.size();
+    pi.pModulus = const_cast<byte*>(this->modulus.data());
+    pi.nPrivateSize = this->private_exponent.size();
+    pi.pPrivate = const_cast<byte*>(this->private_exponent.data());
+    pi.nProductCodeSize = this->product_code.size();
+    pi.pProductCode = const_cast<byte*>(this->product_code.data());
+    return pi;
 }
 
 vmpx::ProductInfoEntity vmpx::ProductInfoEntity::FromProductInfo(const vmpx::ProductInfo& info)
 {
+    VMPX_TRACE_SCOPE("ProductInfoEntity::FromProductInfo");
     ProductInfoEntity entity;
     entity.key_size = info.key_size;
     entity.modulus = base64::encode_into<std::string>(info.modulus.begin(), info.modulus.end());
@@ -170,6 +303,7 @@ vmpx::ProductInfoEntity vmpx::ProductInfoEntity::FromProductInfo(const vmpx::Pro
 
 std::expected<vmpx::ProductInfoEntity, std::string> vmpx::ProductInfoEntity::FromJson(const std::string& str) noexcept
 {
+    VMPX_TRACE_SCOPE("ProductInfoEntity::FromJson");
     ProductInfoEntity entity;
     std::error_code ec;
     struct_json::from_json(entity, str, ec);
@@ -182,39 +316,52 @@ std::expected<vmpx::ProductInfoEntity, std::string> vmpx::ProductInfoEntity::Fro
 
 std::string vmpx::ProductInfoEntity::ToJson() noexcept
 {
+    VMPX_TRACE_SCOPE("ProductInfoEntity::ToJson");
     std::string ss;
     struct_json::to_json(*this, ss);
     return ss;
 }
 
-vmpx::ProductInfo vmpx::ProductInfoEntity::ToProductInfo() const noexcept
+std::expected<vmpx::ProductInfo, std::string> vmpx::ProductInfoEntity::ToProductInfo(
+    std::pmr::memory_resource* resource) const noexcept
 {
-    ProductInfo pi;
-    pi.key_size = key_size;
-    pi.modulus = base64::decode_into<std::vector<byte>>(modulus);
-    pi.public_exponent = base64::decode_into<std::vector<byte>>(public_exponent);
-    pi.private_exponent = base64::decode_into<std::vector<byte>>(private_exponent);
-    pi.product_code = base64::decode_into<std::vector<byte>>(product_code);
-    return pi;
+    VMPX_TRACE_SCOPE("ProductInfoEntity::ToProductInfo");
+    auto modulus_bytes = B64DecToPmrVec(modulus, resource);
+    if (!modulus_bytes) return std::unexpected{std::format("invalid modulus:{}", modulus_bytes.error())};
+    auto public_exponent_bytes = B64DecToPmrVec(public_exponent, resource);
+    if (!public_exponent_bytes)
+        return std::unexpected{std::format("invalid public_exponent:{}", public_exponent_bytes.error())};
+    auto private_exponent_bytes = B64DecToPmrVec(private_exponent, resource);
+    if (!private_exponent_bytes)
+        return std::unexpected{std::format("invalid private_exponent:{}", private_exponent_bytes.error())};
+    auto product_code_bytes = B64DecToPmrVec(product_code, resource);
+    if (!product_code_bytes) return std::unexpected{std::format("invalid product_code:{}", product_code_bytes.error())};
+    return ProductInfo{
+        .key_size = key_size,
+        .modulus = std::move(modulus_bytes.value()),
+        .public_exponent = std::move(public_exponent_bytes.value()),
+        .private_exponent = std::move(private_exponent_bytes.value()),
+        .product_code = std::move(product_code_bytes.value()),
+    };
 }
 
-std::unique_ptr<VMProtectSerialNumberInfo> vmpx::SerialInfo::ToVMP() const noexcept
+VMProtectSerialNumberInfo vmpx::SerialInfo::ToVMP(WideFields& wide_fields) const noexcept
 {
-    this->wide_fields->user_name.clear();
-    this->wide_fields->email.clear();
-    this->wide_fields->user_name = U8ToWVec(this->user_name);
-    this->wide_fields->email = U8ToWVec(this->email);
-    auto si = std::make_unique<VMProtectSerialNumberInfo>();
-    si->flags = HAS_USER_NAME | HAS_EMAIL | HAS_HARDWARE_ID | HAS_EXP_DATE;
-    si->pUserName = this->wide_fields->user_name.data();
-    si->pEMail = this->wide_fields->email.data();
-    si->pHardwareID = const_cast<char*>(this->hwid.data());
-    si->dwExpDate = MAKEDATE(exp_year, exp_month, exp_day);
+    VMPX_TRACE_SCOPE("SerialInfo::ToVMP");
+    auto resource = wide_fields.user_name.get_allocator().resource();
+    wide_fields.user_name = U8ToWVec(this->user_name, resource);
+    wide_fields.email = U8ToWVec(this->email, resource);
+    VMProtectSerialNumberInfo si{};
+    si.flags = HAS_USER_NAME | HAS_EMAIL | HAS_HARDWARE_ID | HAS_EXP_DATE;
+    si.pUserName = wide_fields.user_name.data();
+    si.pEMail = wide_fields.email.data();
+    si.pHardwareID = const_cast<char*>(this->hwid.data());
+    si.dwExpDate = MAKEDATE(exp_year, exp_month, exp_day);
     return si;
 }
 
 std::expected<vmpx::SerialNumberInfo, std::string> vmpx::GenSerialNumber(
-    const ProductInfo& pi, const SerialInfo& si) noexcept
+    const ProductInfo& pi, const SerialInfo& si, std::pmr::memory_resource* resource) noexcept
 {
     // auto sn = GenerateSerialNumber(pi, si);
     // if (!sn)
@@ -225,9 +372,14 @@ std::expected<vmpx::SerialNumberInfo, std::string> vmpx::GenSerialNumber(
     //     .expired_year = si.exp_year, .expired_month = si.exp_month, .expired_day = si.exp_day
     // };
     char* pBuf = nullptr;
+    WideFields wide_fields{std::pmr::vector<wchar_t>{resource}, std::pmr::vector<wchar_t>{resource}};
     auto vmp_pi = pi.ToVMP();
-    auto vmp_si = si.ToVMP();
-    auto res = VMProtectGenerateSerialNumber(vmp_pi.get(), vmp_si.get(), &pBuf);
+    auto vmp_si = si.ToVMP(wide_fields);
+    auto res = [&]
+    {
+        VMPX_TRACE_SCOPE("VMProtectGenerateSerialNumber");
+        return VMProtectGenerateSerialNumber(&vmp_pi, &vmp_si, &pBuf);
+    }();
     if (res == ALL_RIGHT)
     {
         auto sni = SerialNumberInfo{
@@ -267,17 +419,16 @@ vmpx::ProductInfo vmpx::GenRandomProductInfo(size_t key_size, bool random_public
     std::vector<uint8_t> modulusBytes = Integer2Vec(modulus);
     ProductInfo pi;
     pi.key_size = static_cast<uint32_t>(key_size);
-    pi.modulus = modulusBytes;
-    pi.public_exponent = public_key_exponent_bytes;
-    pi.private_exponent = private_key_exponent_bytes;
+    pi.modulus.assign(modulusBytes.begin(), modulusBytes.end());
+    pi.public_exponent.assign(public_key_exponent_bytes.begin(), public_key_exponent_bytes.end());
+    pi.private_exponent.assign(private_key_exponent_bytes.begin(), private_key_exponent_bytes.end());
     pi.product_code.resize(8);
     rng.GenerateBlock(pi.product_code.data(), pi.product_code.size());
     return pi;
 }
 
-std::expected<std::filesystem::path, std::string> vmpx::PackApp(const std::filesystem::path& vmp_console_app_path,
-                                                                const std::filesystem::path& vmp_file_path,
-                                                                const std::filesystem::path& output_dir)
+std::expected<vmpx::PackTarget, std::string> vmpx::ResolvePackTarget(const std::filesystem::path& vmp_file_path,
+                                                                      const std::filesystem::path& output_dir)
 {
     pugi::xml_document doc;
     if (auto xml_parse_result = doc.load_file(vmp_file_path.c_str()); !xml_parse_result)
@@ -299,16 +450,31 @@ std::expected<std::filesystem::path, std::string> vmpx::PackApp(const std::files
     }
     auto input_file_name = input_file_name_attr.as_string();
     auto app_file_path = std::filesystem::path{vmp_file_path.parent_path().string() + "/" + input_file_name};
-    auto app_file_path_name = app_file_path.string();
     auto output_file_name_attr = protection_node.attribute("OutputFileName");
     auto output_dir_tmp = output_dir.empty() ? app_file_path.parent_path() : output_dir;
     std::string output_file_name = output_file_name_attr.empty()
                                        ? output_dir_tmp.string() + "/" + app_file_path.stem().string() + "-vmp" +
                                        app_file_path.extension().string()
                                        : output_dir_tmp.string() + "/" + output_file_name_attr.as_string();
+    output_file_name = boost::locale::conv::from_utf(output_file_name, "GBK");
+    // app_file_path按原样拼接用于生成输出文件名，这里另外构造一个能直接打开的路径
+    return PackTarget{
+        .input_file_path = vmp_file_path.parent_path() / ToTString(input_file_name),
+        .output_file_name = output_file_name
+    };
+}
+
+std::expected<std::filesystem::path, std::string> vmpx::PackApp(const std::filesystem::path& vmp_console_app_path,
+                                                                const std::filesystem::path& vmp_file_path,
+                                                                const std::filesystem::path& output_dir,
+                                                                const PackOptions& options)
+{
+    VMPX_TRACE_SCOPE("PackApp");
+    auto pack_target = ResolvePackTarget(vmp_file_path, output_dir);
+    if (!pack_target) return std::unexpected(pack_target.error());
+    const auto& output_file_name = pack_target->output_file_name;
     boost::asio::io_context ctx;
     boost::asio::readable_pipe rp{ctx};
-    output_file_name = boost::locale::conv::from_utf(output_file_name, "GBK");
     auto proc = boost::process::process{
         ctx, vmp_console_app_path.string(),
         {boost::locale::conv::to_utf<char>(vmp_file_path.string(), "GBK"), output_file_name},
@@ -317,18 +483,75 @@ std::expected<std::filesystem::path, std::string> vmpx::PackApp(const std::files
     std::string sub_proc_stdout_buf;
     sub_proc_stdout_buf.reserve(4096);
     boost::system::error_code ec;
-    boost::asio::read(rp, boost::asio::dynamic_buffer(sub_proc_stdout_buf), ec);
-    if (ec && ec.value() != 109)
+    bool read_done = false;
+    // 边读边解析，不必等加壳程序退出才知道进度
+    std::array<char, 4096> read_buf{};
+    PackOutputParser parser{options.on_event};
+    std::function<void()> async_read_some = [&]
+    {
+        rp.async_read_some(boost::asio::buffer(read_buf),
+                           [&](const boost::system::error_code& read_ec, std::size_t bytes_transferred)
+                           {
+                               auto data = std::string_view(read_buf.data(), bytes_transferred);
+                               sub_proc_stdout_buf.append(data);
+                               parser.Feed(data);
+                               if (read_ec)
+                               {
+                                   parser.Flush();
+                                   ec = read_ec;
+                                   read_done = true;
+                                   return;
+                               }
+                               async_read_some();
+                           });
+    };
+    async_read_some();
+    // 定期检查是否超时或被取消，是则杀掉子进程，管道随之关闭
+    const auto deadline = options.timeout.count() > 0
+                              ? std::chrono::steady_clock::now() + options.timeout
+                              : std::chrono::steady_clock::time_point::max();
+    std::optional<std::string> kill_reason;
+    // 加壳程序可能先关闭stdout再继续运行，读完之后仍要检查到它退出为止
+    auto running = [&proc]
+    {
+        boost::system::error_code running_ec;
+        return proc.running(running_ec);
+    };
+    while (!read_done || running())
+    {
+        if (read_done) std::this_thread::sleep_for(PACK_POLL_INTERVAL);
+        else ctx.run_for(PACK_POLL_INTERVAL);
+        if (kill_reason) continue;
+        if (options.stop_token.stop_requested())
+            kill_reason = "pack cancelled";
+        else if (std::chrono::steady_clock::now() >= deadline)
+            kill_reason = std::format("pack timed out after {}ms", options.timeout.count());
+        if (kill_reason)
+        {
+            boost::system::error_code kill_ec;
+            proc.terminate(kill_ec);
+            rp.close(kill_ec);
+        }
+    }
+    if (kill_reason)
+    {
+        boost::system::error_code wait_ec;
+        proc.wait(wait_ec);
+        return std::unexpected(kill_reason.value());
+    }
+    // 子进程退出后管道关闭，windows下为ERROR_BROKEN_PIPE(109)，其他平台为eof
+    if (ec && ec != boost::asio::error::eof && ec.value() != 109)
     {
         auto error_msg = std::format("subprocess io exception occurred:{}", ec.message());
         return std::unexpected(error_msg);
     }
-    proc.wait();
+    boost::system::error_code wait_ec;
+    proc.wait(wait_ec);
     if (sub_proc_stdout_buf.rfind("Compilation completed") != std::string::npos)
     {
         return std::filesystem::path(output_file_name);
     }
-    return std::unexpected(std::format("pack failed,stdout log:\n", sub_proc_stdout_buf));
+    return std::unexpected(std::format("pack failed,stdout log:\n{}", sub_proc_stdout_buf));
 }
 
 
@@ -6,6 +6,14 @@ local pkgs = { "tobiaslocker_base64", "cryptopp", "VMProtect", "yalantinglibs",
 local deps = {}
 local syslinks = {}
 local function callback()
+    -- 采样分析器：Windows下用DbgHelp解析符号，Linux下用dladdr
+    if is_plat("windows") then
+        add_syslinks("dbghelp", { public = true })
+    elseif is_plat("linux") then
+        add_syslinks("dl", { public = true })
+        -- 信号处理函数中沿帧指针回溯调用栈，保留帧指针
+        add_cxflags("-fno-omit-frame-pointer", { public = true })
+    end
     set_configdir("$(buildir)/config")
     add_includedirs("$(buildir)/config", { public = true })
     add_headerfiles("$(buildir)/config/config.h",
@@ -1,6 +1,6 @@
 IncludeSubDirs(os.scriptdir())
 add_requires("log4cplus", "libhv", "VMProtect", "VMProtectSDK", "yalantinglibs", "tobiaslocker_base64", "cryptopp",
-    "magic_enum", "utfcpp", "argparse", "pugixml", "boost", "libzip", "uchardet")
+    "magic_enum", "utfcpp", "argparse", "pugixml", "boost", "libzip", "uchardet", "benchmark")
 
 add_requireconfs("boost",
     {
@@ -43,7 +43,8 @@ function TargetAddSources(base_dir --[[string]])
     end
 end
 
-function TargetAddTests(target_name --[[string]], base_dir --[[string]], group_name --[[string]], is_add_deps --[[bool]])
+function TargetAddTests(target_name --[[string]], base_dir --[[string]], group_name --[[string]], is_add_deps --[[bool]],
+                        binary --[[table]])
     local test_file_patterns = {}
     for _, test_file_prefix in ipairs(test_file_prefixes) do
         for _, source_suffix in ipairs(source_suffixes) do
@@ -77,6 +78,23 @@ function TargetAddTests(target_name --[[string]], base_dir --[[string]], group_n
         for _, header_suffix in ipairs(header_suffixes) do
             add_headerfiles(path.join(public_dir, "*." .. header_suffix), { install = false })
         end
+        -- binary无法被链接，测试直接编译其private下的源文件
+        if type(binary) == "table" then
+            add_includedirs(binary.base_dir, { public = false })
+            for _, private_dir_name in ipairs(private_dirs) do
+                local private_dir = path.join(binary.base_dir, private_dir_name)
+                add_includedirs(private_dir, { public = false })
+                for _, source_suffix in ipairs(source_suffixes) do
+                    add_files(path.join(private_dir, "*." .. source_suffix))
+                end
+            end
+            for _, pkg_name in ipairs(binary.pkgs or {}) do
+                add_packages(pkg_name)
+            end
+            for _, dep_name in ipairs(binary.deps or {}) do
+                add_deps(dep_name, { inherit = true })
+            end
+        end
         add_files(path.join("test", test_target_filename))
         add_tests("default")
         add_rules("auto_cp_deps_assets_configs_to_build")
@@ -130,7 +148,8 @@ function CreateTarget(target_name --[[string]], kind --[[string]], base_dir --[[
 
     -- tests
     if string.find(kind, "binary") then
-        TargetAddTests(target_name, test_base_dir, test_group_name, true)
+        TargetAddTests(target_name, test_base_dir, test_group_name, true,
+            { base_dir = base_dir, pkgs = pub_pkgs, deps = pub_deps })
     else
         TargetAddTests(target_name, test_base_dir, test_group_name, true)
     end